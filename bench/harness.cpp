@@ -0,0 +1,462 @@
+// Нагрузочный прогон прокси целиком на одной машине: поднимает bench_origin и http_proxy
+// из того же каталога сборки, гоняет bench_load по сценариям и сводит результаты:
+// пропускная способность, p50/p99/p99.9 задержки и процессорное время прокси на запрос.
+// Кеш и схлопывание запросов в прокси выключены: измеряется пересылка, а не попадания в кеш.
+// Сценарий coalesce-cookie идёт через второй прокси со схлопыванием: ответ с Set-Cookie не
+// делится, и каждый ведомый запрос должен сам дойти до сервера; любой не-2xx - провал прогона.
+// После сценариев идут проверки (тоже выбираются через -s), каждая - провал прогона при ошибке:
+//   coalesce-memory  ответ больше предела буфера схлопывания лидеру и ведомому, который не
+//                    читает: память прокси не растёт на размер тела
+//   breaker-table    запросы к 20000 разным закрытым портам: таблица CircuitBreaker не больше
+//                    своего предела (16 шардов по 1024 записи)
+//   cache-vary       через третий прокси с кешем два клиента по очереди запрашивают один URL
+//                    с Vary: Accept-Encoding и разными Accept-Encoding: после разогрева оба
+//                    получают свой вариант из кеша
+// Использование: bench_harness [-d SEC] [-c CONNS] [-m PROXY_THREADS] [-s SCENARIO] [-- PROXY_ARGS...]
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr int kOriginPort = 19080;
+    constexpr int kProxyPort = 18080;
+    constexpr int kMetricsPort = 18090;
+    constexpr int kCoalesceProxyPort = 18081;
+    constexpr int kCoalesceMetricsPort = 18091;
+    constexpr int kCacheProxyPort = 18082;
+    constexpr int kCacheMetricsPort = 18092;
+
+    struct Scenario {
+        const char *name;
+        const char *path;
+        const char *extra;   // дополнительные аргументы bench_load
+        int connectionsDiv;  // доля соединений: большие ответы гоняем меньшим числом
+        bool coalesce;       // через прокси со схлопыванием запросов; ответы только 2xx
+    };
+
+    const Scenario kScenarios[] = {
+            {"small", "/size/1024", "", 1, false},
+            {"medium", "/size/65536", "", 1, false},
+            {"large", "/size/1048576", "", 4, false},
+            {"chunked", "/chunked/65536/4096", "", 1, false},
+            {"redirect", "/redirect/2/1024", "", 1, false},
+            {"no-keepalive", "/size/1024", "-k", 1, false},
+            {"open-loop", "/size/1024", "open", 1, false}, // частота - половина пропускной способности small
+            {"coalesce-cookie", "/cookie/1024", "", 1, true},
+    };
+
+    struct LoadResult {
+        bool ok = false;
+        double rps = 0;
+        unsigned long long requests = 0, errors = 0, non2xx = 0, p50 = 0, p99 = 0, p999 = 0;
+    };
+
+    std::string binDir() {
+        char path[PATH_MAX];
+        ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        if (n <= 0) return ".";
+        path[n] = '\0';
+        std::string dir(path);
+        return dir.substr(0, dir.rfind('/'));
+    }
+
+    pid_t spawn(const std::vector<std::string> &args) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            std::vector<char*> argv;
+            for (auto &a : args) argv.push_back(const_cast<char*>(a.c_str()));
+            argv.push_back(nullptr);
+            // Журнал прокси и источника мешал бы таблице; не запустившийся процесс
+            // обнаружится по закрытому порту
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+        return pid;
+    }
+
+    void terminate(pid_t pid) {
+        if (pid <= 0) return;
+        kill(pid, SIGINT);
+        int status;
+        for (int i = 0; i < 50; i++) {
+            if (waitpid(pid, &status, WNOHANG) == pid) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+
+    bool waitForPort(int port) {
+        for (int i = 0; i < 100; i++) {
+            int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bool ok = connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+            close(fd);
+            if (ok) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return false;
+    }
+
+    // Процессорное время процесса (user + system) в секундах, из /proc/PID/stat
+    double cpuSeconds(pid_t pid) {
+        std::ifstream in("/proc/" + std::to_string(pid) + "/stat");
+        std::string stat((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        size_t pos = stat.rfind(')');
+        if (pos == std::string::npos) return 0;
+        std::istringstream fields(stat.substr(pos + 2));
+        std::string field;
+        unsigned long long utime = 0, stime = 0;
+        // После имени процесса: state - поле 3, utime - 14, stime - 15
+        for (int i = 3; i <= 15 && fields >> field; i++) {
+            if (i == 14) utime = std::stoull(field);
+            if (i == 15) stime = std::stoull(field);
+        }
+        return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+    }
+
+    LoadResult runLoad(const std::string &command) {
+        LoadResult res;
+        FILE *out = popen(command.c_str(), "r");
+        if (!out) return res;
+        char line[512];
+        while (fgets(line, sizeof(line), out)) {
+            if (strncmp(line, "RESULT ", 7) != 0) continue;
+            res.ok = sscanf(line, "RESULT requests=%llu errors=%llu non2xx=%llu rps=%lf p50_us=%llu p99_us=%llu p999_us=%llu",
+                            &res.requests, &res.errors, &res.non2xx, &res.rps, &res.p50, &res.p99, &res.p999) == 7;
+        }
+        pclose(out);
+        return res;
+    }
+
+    int connectTo(int port, int rcvbuf = 0) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        // Маленький приёмный буфер - до connect(), иначе окно уже объявлено
+        if (rcvbuf > 0) setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    bool sendAll(int fd, const std::string &data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            sent += (size_t)n;
+        }
+        return true;
+    }
+
+    std::string proxyRequest(const std::string &url) {
+        return "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1:" + std::to_string(kOriginPort) + "\r\n\r\n";
+    }
+
+    // Значение метрики из /metrics сервера метрик прокси; -1 - не удалось получить
+    double metric(int port, const std::string &name) {
+        int fd = connectTo(port);
+        if (fd < 0) return -1;
+        std::string page;
+        if (sendAll(fd, "GET /metrics HTTP/1.0\r\n\r\n")) {
+            char buf[4096];
+            ssize_t n;
+            while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) page.append(buf, n);
+        }
+        close(fd);
+        size_t pos = page.find("\n" + name + " ");
+        return pos == std::string::npos ? -1 : atof(page.c_str() + pos + name.size() + 2);
+    }
+
+    // Резидентная память процесса в КБ, из /proc/PID/status
+    long rssKb(pid_t pid) {
+        std::ifstream in("/proc/" + std::to_string(pid) + "/status");
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.compare(0, 6, "VmRSS:") == 0) return atol(line.c_str() + 6);
+        }
+        return 0;
+    }
+
+    // Лидер читает ответ в 256 МБ, ведомый с крошечным окном не читает вовсе: лидер не должен
+    // держать тело ради отставшего ведомого (предел буфера - 4 МБ)
+    bool checkCoalesceMemory(pid_t proxy) {
+        constexpr uint64_t kBody = 256ull << 20;
+        constexpr long kMaxGrowthKb = 64 * 1024;
+        std::string request = proxyRequest("http://127.0.0.1:" + std::to_string(kOriginPort) + "/size/" +
+                                          std::to_string(kBody));
+        double collapsedBefore = metric(kCoalesceMetricsPort, "http_proxy_collapsed_requests_total");
+        long rssBefore = rssKb(proxy);
+        int leader = connectTo(kCoalesceProxyPort);
+        if (leader < 0 || !sendAll(leader, request)) {
+            if (leader >= 0) close(leader);
+            return false;
+        }
+        // Дожидаемся заголовков лидера и перестаём читать: ответ остаётся в пути, пока подписывается ведомый
+        std::string head;
+        char buf[64 * 1024];
+        while (head.find("\r\n\r\n") == std::string::npos) {
+            ssize_t n = recv(leader, buf, 1, 0);
+            if (n <= 0) break;
+            head.append(buf, 1);
+        }
+        int follower = connectTo(kCoalesceProxyPort, 4096);
+        bool ok = follower >= 0 && sendAll(follower, request);
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+        uint64_t received = 0;
+        long peakKb = rssKb(proxy);
+        while (ok && received < kBody) {
+            ssize_t n = recv(leader, buf, sizeof(buf), 0);
+            if (n <= 0) break;
+            received += (uint64_t)n;
+            if (received % (8 << 20) < (uint64_t)n) peakKb = std::max(peakKb, rssKb(proxy));
+        }
+        peakKb = std::max(peakKb, rssKb(proxy));
+        if (follower >= 0) close(follower);
+        close(leader);
+        double collapsed = metric(kCoalesceMetricsPort, "http_proxy_collapsed_requests_total") - collapsedBefore;
+
+        long growth = peakKb - rssBefore;
+        printf("%-14s leader received %llu of %llu bytes, collapsed %.0f, proxy RSS +%ld KB\n", "coalesce-memory",
+               (unsigned long long)received, (unsigned long long)kBody, collapsed, growth);
+        if (received != kBody || collapsed < 1) {
+            printf("%-14s FAILED: the follower did not join the leader's response\n", "coalesce-memory");
+            return false;
+        }
+        if (growth > kMaxGrowthKb) {
+            printf("%-14s FAILED: the leader buffered the body for a stalled follower\n", "coalesce-memory");
+            return false;
+        }
+        return true;
+    }
+
+    // Каждый запрос - к своему закрытому порту: неудача подключения заводит запись предохранителя
+    bool checkBreakerTable() {
+        constexpr int kFirstPort = 40000;
+        constexpr int kKeys = 20000;
+        constexpr double kMaxEntries = 16 * 1024;
+        constexpr int kThreads = 4;
+        std::atomic<int> next{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; t++) {
+            threads.emplace_back([&next] {
+                char buf[4096];
+                for (int i = next++; i < kKeys; i = next++) {
+                    int fd = connectTo(kProxyPort);
+                    if (fd < 0) continue;
+                    std::string target = "127.0.0.1:" + std::to_string(kFirstPort + i);
+                    if (sendAll(fd, "GET http://" + target + "/ HTTP/1.1\r\nHost: " + target +
+                                        "\r\nConnection: close\r\n\r\n")) {
+                        while (recv(fd, buf, sizeof(buf), 0) > 0) {}
+                    }
+                    close(fd);
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        double hosts = metric(kMetricsPort, "http_proxy_breaker_hosts");
+        double evicted = metric(kMetricsPort, "http_proxy_breaker_evicted_total");
+        printf("%-14s %d failing upstreams: %.0f tracked, %.0f evicted\n", "breaker-table", kKeys, hosts, evicted);
+        if (hosts < 0 || hosts > kMaxEntries || evicted <= 0) {
+            printf("%-14s FAILED: the circuit breaker table is not bounded\n", "breaker-table");
+            return false;
+        }
+        return true;
+    }
+
+    // Ответ целиком по соединению с Connection: close; пустая строка - ошибка
+    std::string fetch(int port, const std::string &request) {
+        int fd = connectTo(port);
+        if (fd < 0) return "";
+        std::string response;
+        if (sendAll(fd, request)) {
+            char buf[4096];
+            ssize_t n;
+            while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) response.append(buf, n);
+        }
+        close(fd);
+        return response;
+    }
+
+    // Два варианта одного URL по Accept-Encoding чередуются: каждый должен остаться в кеше,
+    // а не вытеснять другой, и отдаваться только своему клиенту
+    bool checkCacheVary(const std::vector<std::string> &proxyArgs) {
+        constexpr int kRounds = 10;
+        const char *encodings[] = {"gzip", "identity"};
+        pid_t proxy = spawn(proxyArgs);
+        if (!waitForPort(kCacheProxyPort) || !waitForPort(kCacheMetricsPort)) {
+            printf("%-14s FAILED: the caching proxy did not start\n", "cache-vary");
+            terminate(proxy);
+            return false;
+        }
+        std::string url = "http://127.0.0.1:" + std::to_string(kOriginPort) + "/vary/1024";
+        bool served = true;
+        for (int round = 0; round < kRounds && served; round++) {
+            for (const char *encoding : encodings) {
+                std::string response = fetch(kCacheProxyPort, "GET " + url + " HTTP/1.1\r\nHost: 127.0.0.1:" +
+                                                                  std::to_string(kOriginPort) + "\r\nAccept-Encoding: " +
+                                                                  encoding + "\r\nConnection: close\r\n\r\n");
+                std::string echo = std::string("\r\nX-Accept-Encoding: ") + encoding + "\r\n";
+                if (response.compare(0, 12, "HTTP/1.1 200") != 0 || response.find(echo) == std::string::npos) {
+                    served = false;
+                    break;
+                }
+            }
+        }
+        double hits = metric(kCacheMetricsPort, "http_proxy_cache_hits_total");
+        double misses = metric(kCacheMetricsPort, "http_proxy_cache_misses_total");
+        terminate(proxy);
+
+        // Первый круг - промахи, все остальные запросы - попадания
+        double expected = (kRounds - 1) * 2;
+        printf("%-14s %d requests over 2 variants: %.0f hits, %.0f misses\n", "cache-vary", kRounds * 2, hits, misses);
+        if (!served) {
+            printf("%-14s FAILED: a client got another variant's response\n", "cache-vary");
+            return false;
+        }
+        if (hits < expected) {
+            printf("%-14s FAILED: alternating Vary values evict each other from the cache\n", "cache-vary");
+            return false;
+        }
+        return true;
+    }
+
+    void usage() {
+        fprintf(stderr, "Usage: bench_harness [-d SEC] [-c CONNS] [-m PROXY_THREADS] [-s SCENARIO] [-- PROXY_ARGS...]\n"
+                        "  -d SEC            measured seconds per scenario (default 5)\n"
+                        "  -c CONNS          client connections (default 64)\n"
+                        "  -m PROXY_THREADS  proxy event loops (default 2)\n"
+                        "  -s SCENARIO       run only this scenario\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    double duration = 5;
+    int connections = 64;
+    int proxyThreads = 2;
+    std::string only;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:c:m:s:h")) != -1) {
+        switch (opt) {
+            case 'd': duration = atof(optarg); break;
+            case 'c': connections = std::max(1, atoi(optarg)); break;
+            case 'm': proxyThreads = std::max(1, atoi(optarg)); break;
+            case 's': only = optarg; break;
+            default:
+                usage();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    std::string dir = binDir();
+    pid_t origin = spawn({dir + "/bench_origin", "-p", std::to_string(kOriginPort), "-t", "2"});
+    std::vector<std::string> proxyArgs = {dir + "/http_proxy", "-p", std::to_string(kProxyPort),
+                                          "-m", std::to_string(proxyThreads), "--cache-size", "0",
+                                          "--no-coalesce", "--metrics-port", std::to_string(kMetricsPort),
+                                          "--log-level", "error"};
+    for (int i = optind; i < argc; i++) proxyArgs.push_back(argv[i]);
+    pid_t proxy = spawn(proxyArgs);
+    std::vector<std::string> coalesceArgs = {dir + "/http_proxy", "-p", std::to_string(kCoalesceProxyPort),
+                                             "-m", std::to_string(proxyThreads), "--cache-size", "0",
+                                             "--metrics-port", std::to_string(kCoalesceMetricsPort),
+                                             "--log-level", "error"};
+    for (int i = optind; i < argc; i++) coalesceArgs.push_back(argv[i]);
+    pid_t coalesceProxy = spawn(coalesceArgs);
+    if (!waitForPort(kOriginPort) || !waitForPort(kProxyPort) || !waitForPort(kMetricsPort) ||
+        !waitForPort(kCoalesceProxyPort) || !waitForPort(kCoalesceMetricsPort)) {
+        fprintf(stderr, "bench_harness: origin or proxy did not start\n");
+        terminate(coalesceProxy);
+        terminate(proxy);
+        terminate(origin);
+        return 1;
+    }
+
+    printf("proxy: %d event loops; load: %d connections, %.0fs per scenario\n", proxyThreads, connections, duration);
+    printf("%-14s %10s %10s %10s %10s %8s %8s %12s\n", "scenario", "req/s", "p50", "p99", "p99.9",
+           "errors", "non-2xx", "cpu us/req");
+    double smallRps = 0;
+    bool failed = false;
+    for (const Scenario &sc : kScenarios) {
+        if (!only.empty() && only != sc.name) continue;
+        std::string extra = sc.extra;
+        if (extra == "open") {
+            if (smallRps <= 0) {
+                // Частоту открытого цикла задаёт замер small
+                LoadResult probe = runLoad(dir + "/bench_load -t 127.0.0.1:" + std::to_string(kProxyPort) +
+                                           " -u http://127.0.0.1:" + std::to_string(kOriginPort) + "/size/1024 -c " +
+                                           std::to_string(connections) + " -d 2 -w 0.5");
+                smallRps = probe.rps;
+            }
+            extra = "-r " + std::to_string((long)std::max(1.0, smallRps / 2));
+        }
+        int port = sc.coalesce ? kCoalesceProxyPort : kProxyPort;
+        pid_t target = sc.coalesce ? coalesceProxy : proxy;
+        std::string command = dir + "/bench_load -t 127.0.0.1:" + std::to_string(port) +
+                              " -u http://127.0.0.1:" + std::to_string(kOriginPort) + sc.path +
+                              " -c " + std::to_string(std::max(1, connections / sc.connectionsDiv)) +
+                              " -d " + std::to_string(duration) + " " + extra;
+        double cpuBefore = cpuSeconds(target);
+        LoadResult res = runLoad(command);
+        double cpu = cpuSeconds(target) - cpuBefore;
+        if (!res.ok) {
+            printf("%-14s %10s\n", sc.name, "failed");
+            failed = true;
+            continue;
+        }
+        if (std::string(sc.name) == "small") smallRps = res.rps;
+        // CPU считается за весь прогон, включая разогрев bench_load
+        double cpuPerRequest = res.requests ? cpu * 1e6 / (res.requests * (1 + 1.0 / duration)) : 0;
+        printf("%-14s %10.0f %8lluus %8lluus %8lluus %8llu %8llu %12.1f\n", sc.name, res.rps, res.p50, res.p99,
+               res.p999, res.errors, res.non2xx, cpuPerRequest);
+        if (sc.coalesce && (res.errors > 0 || res.non2xx > 0)) {
+            printf("%-14s FAILED: requests that fell back from a coalesced response did not reach the origin\n",
+                   sc.name);
+            failed = true;
+        }
+        fflush(stdout);
+    }
+
+    if ((only.empty() || only == "coalesce-memory") && !checkCoalesceMemory(coalesceProxy)) failed = true;
+    if ((only.empty() || only == "breaker-table") && !checkBreakerTable()) failed = true;
+    if (only.empty() || only == "cache-vary") {
+        std::vector<std::string> cacheArgs = {dir + "/http_proxy", "-p", std::to_string(kCacheProxyPort),
+                                              "-m", std::to_string(proxyThreads), "--no-coalesce",
+                                              "--metrics-port", std::to_string(kCacheMetricsPort),
+                                              "--log-level", "error"};
+        for (int i = optind; i < argc; i++) cacheArgs.push_back(argv[i]);
+        if (!checkCacheVary(cacheArgs)) failed = true;
+    }
+
+    terminate(coalesceProxy);
+    terminate(proxy);
+    terminate(origin);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,470 @@
+// Генератор нагрузки HTTP/1.1 для прогонов через прокси.
+// Замкнутый цикл (по умолчанию): каждое соединение шлёт следующий запрос сразу после ответа.
+// Открытый цикл (-r RATE): запросы уходят по расписанию с общей частотой RATE в секунду,
+// задержка считается от запланированного момента, а не от фактической отправки,
+// поэтому отставание сервера не прячется (coordinated omission).
+// Использование: bench_load [-t HOST:PORT] [-u URL] [-c CONNS] [-T THREADS] [-d SEC] [-w SEC] [-r RATE] [-k]
+// Последняя строка вывода - RESULT key=value ... для bench_harness.
+#include "metrics.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::string host = "127.0.0.1";
+        int port = 8080;
+        std::string url = "http://127.0.0.1:9080/size/1024";
+        int connections = 64;
+        int threads = 2;
+        double duration = 10;
+        double warmup = 1;
+        double rate = 0;        // запросов в секунду на всех, 0 - замкнутый цикл
+        bool keepAlive = true;
+    };
+
+    struct Result {
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        uint64_t bytes = 0;
+        uint64_t statuses[6] = {};
+        std::array<uint64_t, LatencyHistogram::kBuckets> latency = {};
+        uint64_t latencySum = 0;
+    };
+
+    // Разбор ответа по мере поступления: заголовки, затем тело по Content-Length,
+    // chunked или до закрытия соединения
+    class ResponseReader {
+    public:
+        enum class Status { NeedMore, Done, Error };
+
+        void reset() {
+            head.clear();
+            state = State::Head;
+        }
+
+        int statusCode() const { return status; }
+        bool closeAfter() const { return connectionClose; }
+
+        Status feed(const char *data, size_t len, size_t &used);
+        // Соединение закрыто: ответ до закрытия завершён, любой другой оборван
+        Status eof() const { return state == State::UntilClose ? Status::Done : Status::Error; }
+
+    private:
+        enum class State { Head, Length, ChunkSize, ChunkData, ChunkEnd, Trailer, UntilClose, Done };
+
+        Status parseHead();
+
+        State state = State::Head;
+        std::string head;
+        std::string line;
+        uint64_t remaining = 0;
+        int status = 0;
+        bool connectionClose = false;
+    };
+
+    ResponseReader::Status ResponseReader::parseHead() {
+        std::string lower = head;
+        for (auto &c : lower) c = (char)tolower(c);
+        size_t sp = head.find(' ');
+        if (head.compare(0, 5, "HTTP/") != 0 || sp == std::string::npos) return Status::Error;
+        status = atoi(head.c_str() + sp + 1);
+        connectionClose = lower.find("\r\nconnection: close") != std::string::npos ||
+                          (lower.compare(0, 8, "http/1.0") == 0 && lower.find("\r\nconnection: keep-alive") == std::string::npos);
+        size_t cl = lower.find("\r\ncontent-length:");
+        if (lower.find("\r\ntransfer-encoding: chunked") != std::string::npos) {
+            state = State::ChunkSize;
+            line.clear();
+        } else if (cl != std::string::npos) {
+            remaining = strtoull(lower.c_str() + cl + 17, nullptr, 10);
+            state = remaining > 0 ? State::Length : State::Done;
+        } else if ((status >= 100 && status < 200) || status == 204 || status == 304) {
+            state = State::Done;
+        } else {
+            state = State::UntilClose;
+            connectionClose = true;
+        }
+        return Status::NeedMore;
+    }
+
+    ResponseReader::Status ResponseReader::feed(const char *data, size_t len, size_t &used) {
+        used = 0;
+        while (used < len && state != State::Done) {
+            switch (state) {
+                case State::Head: {
+                    size_t before = head.size();
+                    head.append(data + used, len - used);
+                    size_t end = head.find("\r\n\r\n", before >= 3 ? before - 3 : 0);
+                    if (end == std::string::npos) {
+                        used = len;
+                        if (head.size() > 64 * 1024) return Status::Error;
+                        break;
+                    }
+                    used += end + 4 - before;
+                    head.resize(end + 2);
+                    if (parseHead() == Status::Error) return Status::Error;
+                    break;
+                }
+                case State::Length: {
+                    size_t n = (size_t)std::min<uint64_t>(remaining, len - used);
+                    used += n;
+                    remaining -= n;
+                    if (remaining == 0) state = State::Done;
+                    break;
+                }
+                case State::ChunkSize:
+                case State::ChunkEnd:
+                case State::Trailer: {
+                    const char *nl = static_cast<const char*>(memchr(data + used, '\n', len - used));
+                    size_t n = nl ? (size_t)(nl - (data + used)) + 1 : len - used;
+                    line.append(data + used, n);
+                    used += n;
+                    if (!nl) break;
+                    if (state == State::ChunkSize) {
+                        remaining = strtoull(line.c_str(), nullptr, 16);
+                        state = remaining > 0 ? State::ChunkData : State::Trailer;
+                    } else if (state == State::ChunkEnd) {
+                        state = State::ChunkSize;
+                    } else if (line == "\r\n" || line == "\n") {
+                        state = State::Done;
+                    }
+                    line.clear();
+                    break;
+                }
+                case State::ChunkData: {
+                    size_t n = (size_t)std::min<uint64_t>(remaining, len - used);
+                    used += n;
+                    remaining -= n;
+                    if (remaining == 0) state = State::ChunkEnd;
+                    break;
+                }
+                case State::UntilClose:
+                    used = len;
+                    break;
+                case State::Done:
+                    break;
+            }
+        }
+        return state == State::Done ? Status::Done : Status::NeedMore;
+    }
+
+    struct Connection {
+        int fd = -1;
+        bool busy = false;        // запрос отправлен, ответ ещё не дочитан
+        bool connecting = false;
+        size_t sent = 0;
+        Clock::time_point scheduled; // от этого момента считается задержка запроса
+        Clock::time_point retryAt;   // переподключение после ошибки
+        ResponseReader reader;
+    };
+
+    class Worker {
+    public:
+        Worker(const Options &options, int connections, double rate, Clock::time_point start)
+                : opt(options), conns((size_t)connections), start(start),
+                  measureFrom(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup))),
+                  end(measureFrom + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration))) {
+            std::string path = opt.url;
+            std::string hostHeader = "localhost";
+            if (path.compare(0, 7, "http://") == 0) {
+                size_t slash = path.find('/', 7);
+                hostHeader = path.substr(7, slash == std::string::npos ? std::string::npos : slash - 7);
+            }
+            request = "GET " + opt.url + " HTTP/1.1\r\nHost: " + hostHeader + "\r\nUser-Agent: bench_load\r\n" +
+                      (opt.keepAlive ? "" : "Connection: close\r\n") + "\r\n";
+            // Расписание открытого цикла: соединения этого потока по очереди, равные интервалы
+            if (rate > 0) interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(connections / rate));
+            for (size_t i = 0; i < conns.size(); i++) {
+                conns[i].scheduled = start + (rate > 0 ? interval * (long)i / (long)conns.size() : Clock::duration::zero());
+            }
+        }
+
+        void run();
+        const Result &result() const { return res; }
+
+    private:
+        bool openLoop() const { return interval != Clock::duration::zero(); }
+        bool connect(Connection &conn);
+        void closeConn(Connection &conn, bool error);
+        void sendRequest(Connection &conn);
+        void onReadable(Connection &conn);
+        void finish(Connection &conn);
+
+        const Options &opt;
+        std::vector<Connection> conns;
+        Clock::time_point start, measureFrom, end;
+        Clock::duration interval = Clock::duration::zero();
+        std::string request;
+        int ep = -1;
+        Result res;
+        LatencyHistogram histogram;
+    };
+
+    bool Worker::connect(Connection &conn) {
+        conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opt.port);
+        inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr);
+        if (::connect(conn.fd, (sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+            close(conn.fd);
+            conn.fd = -1;
+            return false;
+        }
+        conn.connecting = true;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = &conn;
+        epoll_ctl(ep, EPOLL_CTL_ADD, conn.fd, &ev);
+        return true;
+    }
+
+    void Worker::closeConn(Connection &conn, bool error) {
+        if (conn.fd >= 0) close(conn.fd);
+        conn.fd = -1;
+        conn.connecting = false;
+        if (error) {
+            if (Clock::now() >= measureFrom) res.errors++;
+            conn.busy = false;
+            conn.retryAt = Clock::now() + std::chrono::milliseconds(10);
+            if (!openLoop()) conn.scheduled = conn.retryAt;
+        }
+    }
+
+    void Worker::sendRequest(Connection &conn) {
+        if (!conn.busy) {
+            conn.busy = true;
+            conn.sent = 0;
+            conn.reader.reset();
+        }
+        if (conn.connecting) return; // отправим, когда подключение установится
+        while (conn.sent < request.size()) {
+            ssize_t n = send(conn.fd, request.data() + conn.sent, request.size() - conn.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.sent += (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            closeConn(conn, true);
+            return;
+        }
+    }
+
+    void Worker::finish(Connection &conn) {
+        auto now = Clock::now();
+        if (conn.scheduled >= measureFrom && now < end) {
+            res.requests++;
+            int cls = conn.reader.statusCode() / 100;
+            res.statuses[cls >= 1 && cls <= 5 ? cls : 0]++;
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - conn.scheduled).count();
+            histogram.record(us > 0 ? (uint64_t)us : 0);
+        }
+        conn.busy = false;
+        conn.scheduled = openLoop() ? conn.scheduled + interval : now;
+        if (conn.reader.closeAfter()) closeConn(conn, false);
+    }
+
+    void Worker::onReadable(Connection &conn) {
+        char buf[65536];
+        while (conn.fd >= 0) {
+            ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                if (Clock::now() >= measureFrom) res.bytes += (uint64_t)n;
+                size_t pos = 0;
+                while (pos < (size_t)n) {
+                    if (!conn.busy) {
+                        // Байты без запроса: ответ не соответствует запросам, соединение сбито
+                        closeConn(conn, true);
+                        return;
+                    }
+                    size_t used;
+                    auto st = conn.reader.feed(buf + pos, (size_t)n - pos, used);
+                    pos += used;
+                    if (st == ResponseReader::Status::Error) {
+                        closeConn(conn, true);
+                        return;
+                    }
+                    if (st == ResponseReader::Status::Done) {
+                        finish(conn);
+                        if (conn.fd < 0) return;
+                    }
+                }
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+            // Сервер закрыл соединение
+            if (conn.busy && conn.sent == request.size() && conn.reader.eof() == ResponseReader::Status::Done) {
+                finish(conn);
+                closeConn(conn, false);
+            } else {
+                closeConn(conn, conn.busy);
+            }
+            return;
+        }
+    }
+
+    void Worker::run() {
+        ep = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event events[256];
+        while (true) {
+            auto now = Clock::now();
+            if (now >= end) break;
+            // Запросы, чей срок подошёл, и соединения, которые пора открыть заново
+            auto wake = end;
+            for (auto &conn : conns) {
+                if (conn.fd < 0) {
+                    if (now < conn.retryAt) {
+                        wake = std::min(wake, conn.retryAt);
+                        continue;
+                    }
+                    if (!connect(conn)) {
+                        closeConn(conn, true);
+                        continue;
+                    }
+                }
+                if (conn.busy) continue;
+                if (conn.scheduled <= now) {
+                    sendRequest(conn);
+                } else {
+                    wake = std::min(wake, conn.scheduled);
+                }
+            }
+            int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(wake - Clock::now()).count();
+            int n = epoll_wait(ep, events, 256, std::max(0, std::min(timeout, 100)));
+            for (int i = 0; i < n; i++) {
+                Connection &conn = *static_cast<Connection*>(events[i].data.ptr);
+                if (conn.fd < 0) continue;
+                if (conn.connecting && (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0) {
+                        closeConn(conn, true);
+                        continue;
+                    }
+                    conn.connecting = false;
+                }
+                if (conn.busy && conn.sent < request.size()) sendRequest(conn);
+                if (conn.fd >= 0 && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) onReadable(conn);
+            }
+        }
+        for (auto &conn : conns) {
+            if (conn.fd >= 0) close(conn.fd);
+        }
+        close(ep);
+        histogram.addTo(res.latency, res.latencySum);
+    }
+
+    uint64_t percentile(const Result &res, double q) {
+        if (res.requests == 0) return 0;
+        uint64_t rank = std::min<uint64_t>((uint64_t)(q * (double)res.requests), res.requests - 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LatencyHistogram::kBuckets; i++) {
+            seen += res.latency[i];
+            if (seen > rank) return LatencyHistogram::upperBound(i);
+        }
+        return LatencyHistogram::upperBound(LatencyHistogram::kBuckets - 1);
+    }
+
+    void usage() {
+        fprintf(stderr, "Usage: bench_load [-t HOST:PORT] [-u URL] [-c CONNS] [-T THREADS] [-d SEC] [-w SEC] [-r RATE] [-k]\n"
+                        "  -t HOST:PORT  proxy to send requests through (default 127.0.0.1:8080)\n"
+                        "  -u URL        absolute URL to request (default http://127.0.0.1:9080/size/1024)\n"
+                        "  -c CONNS      connections (default 64)\n"
+                        "  -T THREADS    generator threads (default 2)\n"
+                        "  -d SEC        measured duration (default 10), -w SEC warm-up before it (default 1)\n"
+                        "  -r RATE       open loop at RATE requests/s in total (default: closed loop)\n"
+                        "  -k            close the connection after every request\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    Options opt;
+    int c;
+    while ((c = getopt(argc, argv, "t:u:c:T:d:w:r:kh")) != -1) {
+        switch (c) {
+            case 't': {
+                std::string target = optarg;
+                size_t colon = target.rfind(':');
+                if (colon == std::string::npos) {
+                    usage();
+                    return 1;
+                }
+                opt.host = target.substr(0, colon);
+                opt.port = atoi(target.c_str() + colon + 1);
+                break;
+            }
+            case 'u': opt.url = optarg; break;
+            case 'c': opt.connections = std::max(1, atoi(optarg)); break;
+            case 'T': opt.threads = std::max(1, atoi(optarg)); break;
+            case 'd': opt.duration = atof(optarg); break;
+            case 'w': opt.warmup = atof(optarg); break;
+            case 'r': opt.rate = atof(optarg); break;
+            case 'k': opt.keepAlive = false; break;
+            default:
+                usage();
+                return c == 'h' ? 0 : 1;
+        }
+    }
+    opt.threads = std::min(opt.threads, opt.connections);
+
+    auto start = Clock::now();
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < opt.threads; i++) {
+        int conns = opt.connections / opt.threads + (i < opt.connections % opt.threads ? 1 : 0);
+        workers.push_back(std::make_unique<Worker>(opt, conns, opt.rate * conns / opt.connections, start));
+    }
+    std::vector<std::thread> threads;
+    for (auto &w : workers) threads.emplace_back([&w] { w->run(); });
+    for (auto &t : threads) t.join();
+
+    Result total;
+    for (auto &w : workers) {
+        const Result &r = w->result();
+        total.requests += r.requests;
+        total.errors += r.errors;
+        total.bytes += r.bytes;
+        total.latencySum += r.latencySum;
+        for (int i = 0; i < 6; i++) total.statuses[i] += r.statuses[i];
+        for (size_t i = 0; i < LatencyHistogram::kBuckets; i++) total.latency[i] += r.latency[i];
+    }
+
+    double rps = total.requests / opt.duration;
+    printf("%s, %d connections, %d threads, %.1fs: %s\n", opt.url.c_str(), opt.connections, opt.threads, opt.duration,
+           opt.rate > 0 ? ("open loop at " + std::to_string((int)opt.rate) + " req/s").c_str() : "closed loop");
+    printf("requests %llu (%.0f req/s), errors %llu, %.1f MB/s\n", (unsigned long long)total.requests, rps,
+           (unsigned long long)total.errors, total.bytes / opt.duration / (1024 * 1024));
+    printf("status 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu\n", (unsigned long long)total.statuses[2],
+           (unsigned long long)total.statuses[3], (unsigned long long)total.statuses[4], (unsigned long long)total.statuses[5]);
+    printf("latency mean %.0fus p50 %lluus p90 %lluus p99 %lluus p99.9 %lluus max %lluus\n",
+           total.requests ? (double)total.latencySum / total.requests : 0.0,
+           (unsigned long long)percentile(total, 0.5), (unsigned long long)percentile(total, 0.9),
+           (unsigned long long)percentile(total, 0.99), (unsigned long long)percentile(total, 0.999),
+           (unsigned long long)percentile(total, 1.0));
+    printf("RESULT requests=%llu errors=%llu non2xx=%llu rps=%.1f p50_us=%llu p99_us=%llu p999_us=%llu\n",
+           (unsigned long long)total.requests, (unsigned long long)total.errors,
+           (unsigned long long)(total.requests - total.statuses[2]), rps,
+           (unsigned long long)percentile(total, 0.5), (unsigned long long)percentile(total, 0.99),
+           (unsigned long long)percentile(total, 0.999));
+    return 0;
+}
@@ -0,0 +1,230 @@
+// Микробенчмарки функций, через которые проходит каждый запрос: разбор запроса
+// (HttpParser, RequestParser), Utils::parseUrl, Utils::trim и разбор заголовков ответа
+// сервера (HeaderScan::scan + inspectResponse). Кроме ns/op выводится allocs/op -
+// выделений памяти на одну операцию, по счётчику в глобальном operator new.
+// Запуск: micro_bench [--benchmark_filter=REGEX] и прочие ключи Google Benchmark.
+#include "http_parser.hpp"
+#include "request_parser.hpp"
+#include "header_scan.hpp"
+#include "utils.hpp"
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace {
+    size_t allocations = 0;
+
+    struct Sample {
+        const char *name;
+        std::string data;
+    };
+
+    std::string manyHeaders(const std::string &startLine, size_t count) {
+        std::string s = startLine + "\r\nHost: cdn.example.com\r\n";
+        for (size_t i = 0; i < count; i++) {
+            s += "X-Header-" + std::to_string(i) + ": value-" + std::to_string(i * 7919) + "; q=0.5\r\n";
+        }
+        return s + "\r\n";
+    }
+
+    const std::vector<Sample> &requests() {
+        static const std::vector<Sample> samples = {
+                {"minimal", "GET / HTTP/1.0\r\nHost: a.io\r\n\r\n"},
+                {"browser",
+                 "GET http://example.com/static/js/app.4f2a91.js?v=1712345678 HTTP/1.1\r\n"
+                 "Host: example.com\r\n"
+                 "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:124.0) Gecko/20100101 Firefox/124.0\r\n"
+                 "Accept: */*\r\n"
+                 "Accept-Language: en-US,en;q=0.5\r\n"
+                 "Accept-Encoding: gzip, deflate, br\r\n"
+                 "Referer: http://example.com/index.html\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Sec-Fetch-Dest: script\r\n"
+                 "Sec-Fetch-Mode: no-cors\r\n"
+                 "Sec-Fetch-Site: same-origin\r\n"
+                 "Pragma: no-cache\r\n"
+                 "Cache-Control: no-cache\r\n"
+                 "\r\n"},
+                {"long_url", "GET http://search.example.com/results?q=" + std::string(1800, 'q') +
+                             "&page=3 HTTP/1.1\r\nHost: search.example.com\r\nAccept: */*\r\n\r\n"},
+                {"48_headers", manyHeaders("GET /assets/img/sprite.png HTTP/1.1", 48)},
+        };
+        return samples;
+    }
+
+    const std::vector<Sample> &urls() {
+        static const std::vector<Sample> samples = {
+                {"absolute", "http://example.com/index.html"},
+                {"host_only", "http://example.com"},
+                {"with_port", "http://api.internal.example.com:8080/v2/users/1234/orders?limit=50&offset=100"},
+                {"relative", "/static/css/main.8c1e2f.css"},
+                {"long_path", "http://cdn.example.com/" + std::string(1024, 'p') + "/file.bin"},
+        };
+        return samples;
+    }
+
+    const std::vector<Sample> &trimInputs() {
+        static const std::vector<Sample> samples = {
+                {"clean", "keep-alive"},
+                {"padded", "   gzip, deflate, br  \t"},
+                {"long_value", "  " + std::string(512, 'v') + "  "},
+        };
+        return samples;
+    }
+
+    const std::vector<Sample> &responses() {
+        static const std::vector<Sample> samples = {
+                {"ok",
+                 "HTTP/1.1 200 OK\r\n"
+                 "Date: Sat, 13 Apr 2024 10:00:00 GMT\r\n"
+                 "Server: nginx/1.24.0\r\n"
+                 "Content-Type: text/html; charset=utf-8\r\n"
+                 "Content-Length: 15320\r\n"
+                 "Connection: keep-alive\r\n"
+                 "Cache-Control: max-age=600\r\n"
+                 "ETag: \"5f3a-61b2c7d0\"\r\n"
+                 "Last-Modified: Fri, 12 Apr 2024 08:00:00 GMT\r\n"
+                 "Vary: Accept-Encoding\r\n"
+                 "\r\n"},
+                {"redirect",
+                 "HTTP/1.1 302 Found\r\n"
+                 "Date: Sat, 13 Apr 2024 10:00:00 GMT\r\n"
+                 "Server: nginx/1.24.0\r\n"
+                 "Location: http://www.example.com/landing/index.html?utm_source=proxy\r\n"
+                 "Content-Length: 0\r\n"
+                 "Connection: keep-alive\r\n"
+                 "\r\n"},
+                {"chunked_cookies",
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/json\r\n"
+                 "Transfer-Encoding: chunked\r\n"
+                 "Set-Cookie: session=8f14e45fceea167a5a36dedd4bea2543; Path=/; HttpOnly\r\n"
+                 "Set-Cookie: tracking=c9f0f895fb98ab9159f51fd0297e236d; Path=/; Max-Age=31536000\r\n"
+                 "Strict-Transport-Security: max-age=63072000; includeSubDomains\r\n"
+                 "X-Request-Id: 4b1e8c3a-7d2f-4e9a-b6c5-0f1a2b3c4d5e\r\n"
+                 "Cache-Control: private, no-store\r\n"
+                 "Connection: close\r\n"
+                 "\r\n"},
+                {"48_headers", manyHeaders("HTTP/1.1 200 OK\r\nContent-Length: 4096", 48)},
+        };
+        return samples;
+    }
+
+    // Счётчик выделений на итерацию; подменённый operator new общий для всех бенчмарков
+    class AllocCounter {
+    public:
+        explicit AllocCounter(benchmark::State &state) : state(state), before(allocations) {}
+        ~AllocCounter() {
+            state.counters["allocs/op"] = benchmark::Counter((double)(allocations - before),
+                                                             benchmark::Counter::kAvgIterations);
+        }
+    private:
+        benchmark::State &state;
+        size_t before;
+    };
+
+    void httpParserParse(benchmark::State &state, const Sample *sample) {
+        HttpParser parser;
+        AllocCounter counter(state);
+        for (auto _ : state) {
+            HttpRequest req;
+            bool ok = parser.parse(sample->data, req);
+            benchmark::DoNotOptimize(ok);
+        }
+        state.SetBytesProcessed((int64_t)(state.iterations() * sample->data.size()));
+    }
+
+    void requestParserParse(benchmark::State &state, const Sample *sample) {
+        RequestParser parser;
+        RequestView view;
+        parser.parse(sample->data.data(), sample->data.size(), view); // прогрев повторно используемых буферов
+        AllocCounter counter(state);
+        for (auto _ : state) {
+            parser.reset();
+            auto res = parser.parse(sample->data.data(), sample->data.size(), view);
+            benchmark::DoNotOptimize(res);
+        }
+        state.SetBytesProcessed((int64_t)(state.iterations() * sample->data.size()));
+    }
+
+    void parseUrl(benchmark::State &state, const Sample *sample) {
+        std::string scheme, host, path;
+        int port;
+        AllocCounter counter(state);
+        for (auto _ : state) {
+            bool ok = Utils::parseUrl(sample->data, scheme, host, port, path);
+            benchmark::DoNotOptimize(ok);
+        }
+    }
+
+    void trim(benchmark::State &state, const Sample *sample) {
+        AllocCounter counter(state);
+        for (auto _ : state) {
+            std::string trimmed = Utils::trim(sample->data);
+            benchmark::DoNotOptimize(trimmed.data());
+        }
+    }
+
+    // То же, что ConnectionHandler делает с заголовками каждого ответа сервера
+    void inspectResponse(benchmark::State &state, const Sample *sample, HeaderScan::Impl impl) {
+        if (!HeaderScan::use(impl)) {
+            state.SkipWithError("not supported by this CPU");
+            return;
+        }
+        std::vector<HeaderScan::Line> lines;
+        HeaderScan::scan(sample->data.data(), sample->data.size(), 0, lines);
+        AllocCounter counter(state);
+        for (auto _ : state) {
+            lines.clear();
+            HeaderScan::scan(sample->data.data(), sample->data.size(), 0, lines);
+            HeaderScan::ResponseHead head;
+            bool ok = HeaderScan::inspectResponse(sample->data.data(), lines, head);
+            benchmark::DoNotOptimize(ok);
+            benchmark::DoNotOptimize(head.status);
+        }
+        state.SetBytesProcessed((int64_t)(state.iterations() * sample->data.size()));
+    }
+}
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char **argv) {
+    for (const Sample &s : requests()) {
+        benchmark::RegisterBenchmark((std::string("HttpParser/") + s.name).c_str(), httpParserParse, &s);
+        benchmark::RegisterBenchmark((std::string("RequestParser/") + s.name).c_str(), requestParserParse, &s);
+    }
+    for (const Sample &s : urls()) {
+        benchmark::RegisterBenchmark((std::string("ParseUrl/") + s.name).c_str(), parseUrl, &s);
+    }
+    for (const Sample &s : trimInputs()) {
+        benchmark::RegisterBenchmark((std::string("Trim/") + s.name).c_str(), trim, &s);
+    }
+    const std::pair<HeaderScan::Impl, const char *> impls[] = {
+            {HeaderScan::Impl::Scalar, "scalar"}, {HeaderScan::Impl::SSE2, "sse2"}, {HeaderScan::Impl::AVX2, "avx2"}};
+    for (const Sample &s : responses()) {
+        for (auto &impl : impls) {
+            benchmark::RegisterBenchmark((std::string("InspectResponse/") + s.name + "/" + impl.second).c_str(),
+                                         inspectResponse, &s, impl.first);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
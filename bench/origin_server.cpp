@@ -0,0 +1,276 @@
+// Локальный сервер-источник для нагрузочных прогонов прокси без выхода в сеть.
+// Каждый поток - свой SO_REUSEPORT-сокет и цикл epoll, соединения keep-alive.
+//   /size/N           тело из N байт с Content-Length
+//   /chunked/N[/K]    N байт chunked-кусками по K байт (по умолчанию 16 КБ)
+//   /redirect/H/N     цепочка из H редиректов 302, в конце /size/N
+//   /cookie/N         N байт с Set-Cookie (ответ не делится между клиентами); запрос
+//                     с абсолютным URL вместо пути получает 400
+//   /vary/N           N байт, кешируемые на минуту, с Vary: Accept-Encoding; значение
+//                     Accept-Encoding запроса возвращается в X-Accept-Encoding
+// Использование: bench_origin [-p PORT] [-t THREADS]
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    constexpr size_t kRefill = 64 * 1024;
+    constexpr size_t kDefaultChunk = 16 * 1024;
+    constexpr size_t kMaxRequest = 64 * 1024;
+
+    std::atomic<bool> stopping{false};
+    std::string pattern(kRefill, 'x');
+
+    struct Connection {
+        int fd;
+        std::string in;
+        std::string out;
+        size_t outPos = 0;
+        uint64_t bodyLeft = 0;  // ещё не сгенерированные байты тела
+        size_t chunkSize = 0;   // 0 - тело с Content-Length
+        bool close = false;
+    };
+
+    int listenOn(int port) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+            perror("bench_origin: bind/listen");
+            exit(1);
+        }
+        return fd;
+    }
+
+    // Число из пути начиная с pos; pos сдвигается за него и за следующий '/'
+    uint64_t number(const std::string &path, size_t &pos) {
+        uint64_t value = 0;
+        while (pos < path.size() && path[pos] >= '0' && path[pos] <= '9') value = value * 10 + (path[pos++] - '0');
+        if (pos < path.size() && path[pos] == '/') pos++;
+        return value;
+    }
+
+    void respond(Connection &conn, const std::string &path, const std::string &host, bool absolute,
+                 const std::string &encoding) {
+        if (path.compare(0, 8, "/cookie/") == 0) {
+            // Прокси обязан передать серверу путь, а не URL целиком
+            if (absolute) {
+                conn.out += "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+                return;
+            }
+            size_t pos = 8;
+            conn.bodyLeft = number(path, pos);
+            conn.chunkSize = 0;
+            conn.out += "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nSet-Cookie: session=1\r\n"
+                        "Content-Length: " + std::to_string(conn.bodyLeft) + "\r\n\r\n";
+        } else if (path.compare(0, 6, "/size/") == 0) {
+            size_t pos = 6;
+            conn.bodyLeft = number(path, pos);
+            conn.chunkSize = 0;
+            conn.out += "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+                        std::to_string(conn.bodyLeft) + "\r\n\r\n";
+        } else if (path.compare(0, 6, "/vary/") == 0) {
+            size_t pos = 6;
+            conn.bodyLeft = number(path, pos);
+            conn.chunkSize = 0;
+            conn.out += "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nCache-Control: max-age=60\r\n"
+                        "Vary: Accept-Encoding\r\nX-Accept-Encoding: " + encoding + "\r\nContent-Length: " +
+                        std::to_string(conn.bodyLeft) + "\r\n\r\n";
+        } else if (path.compare(0, 9, "/chunked/") == 0) {
+            size_t pos = 9;
+            conn.bodyLeft = number(path, pos);
+            size_t chunk = (size_t)number(path, pos);
+            conn.chunkSize = chunk > 0 ? std::min(chunk, kRefill) : kDefaultChunk;
+            conn.out += "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nTransfer-Encoding: chunked\r\n\r\n";
+        } else if (path.compare(0, 10, "/redirect/") == 0) {
+            size_t pos = 10;
+            uint64_t hops = number(path, pos);
+            uint64_t size = number(path, pos);
+            std::string next = hops > 1 ? "/redirect/" + std::to_string(hops - 1) + "/" + std::to_string(size)
+                                        : "/size/" + std::to_string(size);
+            conn.out += "HTTP/1.1 302 Found\r\nLocation: http://" + host + next + "\r\nContent-Length: 0\r\n\r\n";
+        } else {
+            conn.out += "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        }
+    }
+
+    // Разбирает все полные запросы из conn.in; false - запрос некорректен
+    bool handleRequests(Connection &conn) {
+        while (conn.bodyLeft == 0) {
+            size_t end = conn.in.find("\r\n\r\n");
+            if (end == std::string::npos) return conn.in.size() <= kMaxRequest;
+            size_t sp1 = conn.in.find(' ');
+            size_t sp2 = conn.in.find(' ', sp1 + 1);
+            if (sp1 == std::string::npos || sp2 == std::string::npos || sp2 > end) return false;
+            std::string path = conn.in.substr(sp1 + 1, sp2 - sp1 - 1);
+            bool absolute = path.compare(0, 7, "http://") == 0;
+            if (absolute) {
+                size_t slash = path.find('/', 7);
+                path = slash == std::string::npos ? "/" : path.substr(slash);
+            }
+            std::string host = "127.0.0.1";
+            size_t h = conn.in.find("\r\nHost:");
+            if (h == std::string::npos) h = conn.in.find("\r\nhost:");
+            if (h != std::string::npos && h < end) {
+                size_t begin = conn.in.find_first_not_of(' ', h + 7);
+                host = conn.in.substr(begin, conn.in.find("\r\n", begin) - begin);
+            }
+            std::string head = conn.in.substr(0, end);
+            for (auto &c : head) c = (char)tolower(c);
+            if (head.find("connection: close") != std::string::npos) conn.close = true;
+            std::string encoding;
+            size_t e = head.find("\r\naccept-encoding:");
+            if (e != std::string::npos) {
+                size_t begin = head.find_first_not_of(' ', e + 18);
+                if (begin != std::string::npos) encoding = head.substr(begin, head.find("\r\n", begin) - begin);
+            }
+            conn.in.erase(0, end + 4);
+            respond(conn, path, host, absolute, encoding);
+            if (conn.close) return true;
+        }
+        return true;
+    }
+
+    // Досоздаёт тело по мере отправки, чтобы большие ответы не занимали память целиком
+    void refill(Connection &conn) {
+        if (conn.outPos > 0) {
+            conn.out.erase(0, conn.outPos);
+            conn.outPos = 0;
+        }
+        while (conn.out.size() < kRefill && conn.bodyLeft > 0) {
+            if (conn.chunkSize == 0) {
+                size_t n = (size_t)std::min<uint64_t>(conn.bodyLeft, kRefill - conn.out.size());
+                conn.out.append(pattern, 0, n);
+                conn.bodyLeft -= n;
+                continue;
+            }
+            size_t n = (size_t)std::min<uint64_t>(conn.bodyLeft, conn.chunkSize);
+            char line[32];
+            snprintf(line, sizeof(line), "%zx\r\n", n);
+            conn.out += line;
+            conn.out.append(pattern, 0, n);
+            conn.out += "\r\n";
+            conn.bodyLeft -= n;
+            if (conn.bodyLeft == 0) conn.out += "0\r\n\r\n";
+        }
+    }
+
+    // false - соединение пора закрыть
+    bool flush(Connection &conn) {
+        while (true) {
+            if (conn.outPos == conn.out.size()) {
+                refill(conn);
+                if (conn.out.empty()) {
+                    // Тело дописано: очередь за следующими запросами, пришедшими вместе с этим
+                    if (conn.close || conn.in.empty()) return !conn.close;
+                    if (!handleRequests(conn)) return false;
+                    if (conn.out.empty()) return true;
+                }
+            }
+            ssize_t n = send(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.outPos += (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        }
+    }
+
+    void serve(int port) {
+        int listenFd = listenOn(port);
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listenFd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, listenFd, &ev);
+        std::unordered_map<int, std::unique_ptr<Connection>> conns;
+        epoll_event events[256];
+        char buf[16384];
+
+        while (!stopping.load(std::memory_order_relaxed)) {
+            int n = epoll_wait(ep, events, 256, 200);
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    int client;
+                    while ((client = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                        int one = 1;
+                        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                        auto conn = std::make_unique<Connection>();
+                        conn->fd = client;
+                        epoll_event cev{};
+                        cev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                        cev.data.fd = client;
+                        epoll_ctl(ep, EPOLL_CTL_ADD, client, &cev);
+                        conns[client] = std::move(conn);
+                    }
+                    continue;
+                }
+                auto it = conns.find(fd);
+                if (it == conns.end()) continue;
+                Connection &conn = *it->second;
+                bool alive = true;
+                while (alive) {
+                    ssize_t r = recv(fd, buf, sizeof(buf), 0);
+                    if (r > 0) {
+                        conn.in.append(buf, (size_t)r);
+                        continue;
+                    }
+                    if (r < 0 && errno == EINTR) continue;
+                    alive = r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+                    break;
+                }
+                // Ответ на разобранные запросы дописываем, даже если клиент закрыл свою сторону
+                alive = handleRequests(conn) && flush(conn) && (alive || conn.bodyLeft > 0 || conn.outPos < conn.out.size());
+                if (!alive) {
+                    close(fd);
+                    conns.erase(it);
+                }
+            }
+        }
+        for (auto &entry : conns) close(entry.first);
+        close(ep);
+        close(listenFd);
+    }
+}
+
+int main(int argc, char **argv) {
+    int port = 9080;
+    int threads = 2;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:t:")) != -1) {
+        if (opt == 'p') port = atoi(optarg);
+        else if (opt == 't') threads = std::max(1, atoi(optarg));
+        else {
+            fprintf(stderr, "Usage: bench_origin [-p PORT] [-t THREADS]\n");
+            return 1;
+        }
+    }
+    signal(SIGINT, [](int) { stopping.store(true); });
+    signal(SIGTERM, [](int) { stopping.store(true); });
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) workers.emplace_back(serve, port);
+    fprintf(stderr, "bench_origin: listening on 127.0.0.1:%d with %d threads\n", port, threads);
+    for (auto &w : workers) w.join();
+    return 0;
+}
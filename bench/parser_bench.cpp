@@ -0,0 +1,104 @@
+// Сравнение HttpParser и RequestParser на типичном запросе браузера:
+// время и число выделений памяти на один разбор, для каждой реализации HeaderScan.
+#include "http_parser.hpp"
+#include "request_parser.hpp"
+#include "header_scan.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+    size_t allocations = 0;
+
+    const std::string kRequest =
+        "GET http://example.com/static/js/app.4f2a91.js?v=1712345678 HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:124.0) Gecko/20100101 Firefox/124.0\r\n"
+        "Accept: */*\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Referer: http://example.com/index.html\r\n"
+        "Connection: keep-alive\r\n"
+        "Sec-Fetch-Dest: script\r\n"
+        "Sec-Fetch-Mode: no-cors\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Pragma: no-cache\r\n"
+        "Cache-Control: no-cache\r\n"
+        "\r\n";
+
+    template <typename F>
+    void run(const char *name, size_t iterations, F &&parseOnce) {
+        parseOnce(); // прогрев: память под повторно используемые структуры
+        size_t allocsBefore = allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            if (!parseOnce()) {
+                std::fprintf(stderr, "%s: parse failed\n", name);
+                std::exit(1);
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-28s %10.1f ns/op %8.2f allocs/op %8.1f MB/s\n", name, ns / iterations,
+                    (double)(allocations - allocsBefore) / iterations,
+                    kRequest.size() * iterations / (ns / 1e9) / (1024 * 1024));
+    }
+}
+
+void *operator new(size_t size) {
+    allocations++;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char **argv) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    std::printf("request: %zu bytes, %zu iterations\n", kRequest.size(), iterations);
+
+    run("HttpParser", iterations, [] {
+        HttpRequest req;
+        HttpParser parser;
+        return parser.parse(kRequest, req);
+    });
+
+    RequestParser parser;
+    RequestView view;
+    // Каждая реализация разметки строк, которую поддерживает процессор; последней остаётся лучшая
+    for (HeaderScan::Impl impl : {HeaderScan::Impl::Scalar, HeaderScan::Impl::SSE2, HeaderScan::Impl::AVX2}) {
+        if (!HeaderScan::use(impl)) continue;
+        std::string name = std::string("RequestParser [") + HeaderScan::implName() + "]";
+        run(name.c_str(), iterations, [&] {
+            parser.reset();
+            return parser.parse(kRequest.data(), kRequest.size(), view) == RequestParser::Result::Done &&
+                   view.find("accept-encoding") != nullptr;
+        });
+    }
+
+    // Запрос приходит по частям: разбор продолжается с места остановки
+    run("RequestParser (16B reads)", iterations / 10, [&] {
+        parser.reset();
+        RequestParser::Result res = RequestParser::Result::NeedMore;
+        for (size_t len = 16; res == RequestParser::Result::NeedMore; len += 16) {
+            res = parser.parse(kRequest.data(), std::min(len, kRequest.size()), view);
+        }
+        return res == RequestParser::Result::Done;
+    });
+
+    HttpRequest req;
+    run("RequestParser + toRequest", iterations, [&] {
+        parser.reset();
+        if (parser.parse(kRequest.data(), kRequest.size(), view) != RequestParser::Result::Done) return false;
+        RequestParser::toRequest(view, req);
+        return true;
+    });
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Конкуренция за очередь задач: прежняя схема пула (одна std::queue под мьютексом
+// и condition_variable) против TaskScheduler с кражей работы, от 1 до 64 потоков.
+// Сценарии: задачи ставит один внешний поток (как поток accept) и задачи
+// порождают другие задачи внутри воркеров (этапы обработки соединения).
+#include "task_scheduler.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace {
+    // Пул в том виде, в каком он был до планировщика: общая очередь и notify_one на каждую задачу
+    class MutexPool {
+    public:
+        explicit MutexPool(size_t threads) {
+            for (size_t i = 0; i < threads; i++) {
+                workers.emplace_back([this] { workerFunc(); });
+            }
+        }
+
+        ~MutexPool() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (auto &w : workers) w.join();
+        }
+
+        void submit(std::function<void()> task) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                tasks.push(std::move(task));
+            }
+            cv.notify_one();
+        }
+
+    private:
+        void workerFunc() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (stopping && tasks.empty()) return;
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::queue<std::function<void()>> tasks;
+        bool stopping = false;
+        std::vector<std::thread> workers;
+    };
+
+    class StealingPool {
+    public:
+        explicit StealingPool(size_t threads) : scheduler(threads) {
+            for (size_t i = 0; i < threads; i++) {
+                workers.emplace_back([this, i] { scheduler.runWorker(i, stop); });
+            }
+        }
+
+        ~StealingPool() {
+            stop.store(true);
+            scheduler.wakeAll();
+            for (auto &w : workers) w.join();
+        }
+
+        void submit(std::function<void()> task) {
+            scheduler.submit(std::move(task));
+        }
+
+        TaskScheduler::Stats stats() const { return scheduler.stats(); }
+
+    private:
+        TaskScheduler scheduler;
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> workers;
+    };
+
+    // Немного работы на задачу, чтобы очередь не была единственным, что измеряется
+    void work(std::atomic<size_t> &done) {
+        volatile unsigned x = 0;
+        for (int i = 0; i < 64; i++) x = x + i;
+        done.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void waitFor(const std::atomic<size_t> &done, size_t expected) {
+        while (done.load(std::memory_order_relaxed) < expected) std::this_thread::yield();
+    }
+
+    // Один поток ставит все задачи
+    template <typename Pool>
+    double external(Pool &pool, size_t tasks) {
+        std::atomic<size_t> done{0};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < tasks; i++) {
+            pool.submit([&done] { work(done); });
+        }
+        waitFor(done, tasks);
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Корневые задачи порождают дочерние из потоков воркеров
+    template <typename Pool>
+    double fanOut(Pool &pool, size_t roots, size_t children) {
+        std::atomic<size_t> done{0};
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < roots; i++) {
+            pool.submit([&pool, &done, children] {
+                for (size_t j = 0; j < children; j++) {
+                    pool.submit([&done] { work(done); });
+                }
+                work(done);
+            });
+        }
+        waitFor(done, roots * (children + 1));
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t tasks = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    size_t maxThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 64;
+    size_t children = 63;
+    size_t roots = tasks / (children + 1);
+    std::printf("%zu tasks per run, fan-out %zu x %zu; Mtasks/s\n", tasks, roots, children + 1);
+    std::printf("%8s %14s %14s %14s %14s %10s\n", "threads", "mutex:extern", "steal:extern",
+                "mutex:fanout", "steal:fanout", "stolen%");
+
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        double mutexExternal, mutexFanOut, stealExternal, stealFanOut;
+        {
+            MutexPool pool(threads);
+            mutexExternal = external(pool, tasks);
+            mutexFanOut = fanOut(pool, roots, children);
+        }
+        TaskScheduler::Stats stats;
+        {
+            StealingPool pool(threads);
+            stealExternal = external(pool, tasks);
+            stealFanOut = fanOut(pool, roots, children);
+            stats = pool.stats();
+        }
+        double total = (double)(tasks + roots * (children + 1));
+        std::printf("%8zu %14.2f %14.2f %14.2f %14.2f %9.1f%%\n", threads,
+                    tasks / mutexExternal / 1e6, tasks / stealExternal / 1e6,
+                    roots * (children + 1) / mutexFanOut / 1e6, roots * (children + 1) / stealFanOut / 1e6,
+                    stats.executed ? 100.0 * stats.stolen / total : 0.0);
+    }
+    return 0;
+}
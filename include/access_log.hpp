@@ -0,0 +1,91 @@
+#ifndef ACCESS_LOG_HPP
+#define ACCESS_LOG_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Запись журнала доступа: один обработанный запрос, фиксированный размер, без текста.
+// Времена этапов - микросекунды от начала запроса (accept для первого запроса
+// соединения, первый байт запроса для следующих), kNotReached - этапа не было.
+struct AccessRecord {
+    static constexpr uint32_t kNotReached = UINT32_MAX;
+    enum Flags : uint8_t {
+        CacheHit = 1,      // ответ из кеша, без обращения к серверу
+        Coalesced = 2,     // ответ другого такого же запроса
+        ReusedConn = 4,    // соединение с сервером из пула
+        TimedOut = 8,      // истёк один из сроков обмена с сервером
+        Aborted = 16       // ответ оборван
+    };
+
+    uint64_t startUnixUs = 0;   // начало запроса, микросекунды Unix time
+    uint32_t parseUs = kNotReached;
+    uint32_t connectUs = kNotReached;
+    uint32_t firstByteUs = kNotReached; // первый байт ответа сервера
+    uint32_t lastByteUs = kNotReached;  // ответ клиенту отправлен целиком
+    uint64_t bytesIn = 0;       // байт запроса от клиента
+    uint64_t bytesOut = 0;      // байт ответа клиенту
+    uint16_t status = 0;        // код ответа клиенту, 0 - ответа не было
+    uint16_t port = 0;
+    uint8_t redirects = 0;
+    uint8_t flags = 0;
+    uint8_t reserved[2] = {0, 0};
+    char host[48] = {};         // сервер последнего обращения, обрезается, без завершающего нуля при 48 символах
+};
+static_assert(sizeof(AccessRecord) == 96, "AccessRecord is part of the file format");
+
+// Заголовок файла журнала; записи идут за ним подряд
+struct AccessLogHeader {
+    char magic[8] = {'H', 'P', 'X', 'A', 'L', 'O', 'G', '\0'};
+    uint32_t version = 1;
+    uint32_t recordSize = sizeof(AccessRecord);
+};
+static_assert(sizeof(AccessLogHeader) == 16, "AccessLogHeader is part of the file format");
+
+struct AccessRing; // кольцо записей одного потока, access_log.cpp
+
+// Двоичный журнал доступа. Воркеры кладут записи в собственные кольца без блокировок,
+// фоновый поток дописывает их в файл пачками. При переполнении кольца запись
+// отбрасывается и учитывается. Разбирает файлы утилита access_log_analyzer.
+class AccessLog {
+public:
+    static AccessLog &instance();
+    // Вызывается до запуска воркеров; пустой путь - журнал отключён
+    static void configure(const std::string &path);
+    static bool enabled() { return enabledFlag; }
+
+    bool start();
+    void shutdown();
+
+    void record(const AccessRecord &rec);
+
+    uint64_t writtenCount() const { return written.load(std::memory_order_relaxed); }
+    uint64_t droppedCount();
+
+private:
+    std::shared_ptr<AccessRing> registerRing();
+    void writerFunc();
+    void drain();
+
+    int fd = -1;
+    std::thread writer;
+    std::mutex wakeMtx;
+    std::condition_variable wakeCv;
+    bool stopping = false;
+
+    std::mutex ringsMtx;
+    std::vector<std::shared_ptr<AccessRing>> rings;
+    uint64_t droppedOrphaned = 0; // из колец завершившихся потоков
+    std::vector<AccessRecord> batch;
+    std::atomic<uint64_t> written{0};
+
+    static bool enabledFlag;
+    static std::string path;
+};
+
+#endif // ACCESS_LOG_HPP
@@ -0,0 +1,105 @@
+#ifndef ADMISSION_CONTROL_HPP
+#define ADMISSION_CONTROL_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Допуск принятых соединений к обслуживанию, общий для всех воркеров.
+// Соединения, принятые основным потоком, ждут в ограниченной очереди, пока циклы
+// не возьмут их; обслуживаемых одновременно - не больше maxConnections, остальные ждут.
+// Кто ждал дольше queueTimeout, сразу получает 503: клиент, скорее всего, уже не ждёт.
+// При перегрузке (очередь заполнена больше чем наполовину) с lifo первыми берутся
+// самые новые соединения. С одного IP клиента - не больше maxPerClient соединений,
+// считая ждущие в очереди. Отказ - короткий ответ 503 и закрытие сокета.
+class AdmissionControl {
+public:
+    struct Limits {
+        size_t maxQueued = 4096;                   // 0 - без ограничения
+        size_t maxConnections = 0;                 // 0 - без ограничения
+        std::chrono::milliseconds queueTimeout{0}; // 0 - ждать сколько угодно
+        bool lifoUnderOverload = false;
+        size_t maxPerClient = 0;                   // 0 - без ограничения
+    };
+
+    enum class Reason { QueueFull, ConnectionLimit, ClientLimit, Expired };
+
+    // Место соединения: в числе обслуживаемых и в счётчике его IP.
+    // Освобождается деструктором, то есть вместе с обработчиком соединения
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(Ticket &&other) noexcept;
+        Ticket &operator=(Ticket &&other) noexcept;
+        ~Ticket();
+
+    private:
+        friend class AdmissionControl;
+        void release();
+
+        std::string client; // адрес клиента, пусто - не учитывается
+        bool serving = false;
+    };
+
+    static AdmissionControl &instance();
+    // Вызывается до запуска воркеров
+    static void configure(const Limits &limits);
+    // Вызывается, когда освободилось место, а в очереди кто-то ждёт: владелец очереди
+    // ставит циклам задачу take(). Пустая функция - больше не будить (завершение)
+    void setWakeup(std::function<void()> wakeup);
+
+    // Соединение, принятое основным потоком, встаёт в очередь; false - отказ, сокет закрыт
+    bool enqueue(int fd);
+    // Следующее соединение для цикла; -1 - очередь пуста или свободных мест нет
+    int take(Ticket &ticket, std::chrono::steady_clock::time_point &acceptedAt);
+    // Соединение, принятое самим воркером (--listeners), обслуживается сразу или получает отказ
+    bool admit(int fd, Ticket &ticket);
+    // Отказывает ждущим дольше queueTimeout; основной поток вызывает между вызовами accept
+    void expire();
+    // Закрывает всё, что осталось в очереди при завершении
+    void clear();
+
+    size_t queued();
+    size_t serving() const { return servingCount.load(std::memory_order_relaxed); }
+    uint64_t rejectedCount(Reason reason) const {
+        return rejected[(size_t)reason].load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Waiting {
+        int fd;
+        std::chrono::steady_clock::time_point acceptedAt;
+        Ticket ticket;
+    };
+    struct ClientShard {
+        std::mutex mtx;
+        std::unordered_map<std::string, size_t> connections;
+    };
+    static constexpr size_t kClientShards = 16;
+    // Глубина, с которой очередь без ограничения считается перегруженной
+    static constexpr size_t kOverloadDepth = 1024;
+
+    bool acquireClient(int fd, Ticket &ticket);
+    void releaseClient(const std::string &client);
+    bool acquireServing();
+    void releaseServing();
+    void reject(int fd, Reason reason);
+
+    std::mutex queueMtx;
+    std::deque<Waiting> waiting;
+    std::atomic<size_t> waitingCount{0};
+    std::function<void()> wakeup;
+
+    std::atomic<size_t> servingCount{0};
+    ClientShard clients[kClientShards];
+    std::atomic<uint64_t> rejected[4] = {};
+
+    static Limits limits;
+};
+
+#endif // ADMISSION_CONTROL_HPP
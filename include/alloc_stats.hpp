@@ -0,0 +1,19 @@
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <cstdint>
+
+// Подсчёт выделений памяти в куче для сборки с -DALLOC_STATS=ON: глобальные operator new
+// считают выделения в счётчике своего потока. Без опции счётчик всегда 0.
+namespace AllocStats {
+#ifdef ALLOC_STATS
+    constexpr bool kEnabled = true;
+#else
+    constexpr bool kEnabled = false;
+#endif
+
+    // Выделений в текущем потоке с его запуска
+    uint64_t threadCount();
+}
+
+#endif // ALLOC_STATS_HPP
@@ -0,0 +1,71 @@
+#ifndef CIRCUIT_BREAKER_HPP
+#define CIRCUIT_BREAKER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Предохранитель на каждый host:port сервера, общий для всех воркеров.
+// После threshold неудач подряд (ошибка или таймаут подключения, таймаут ответа)
+// запросы к серверу сразу отклоняются на время cooldown; затем пропускается
+// один пробный запрос: его успех закрывает предохранитель, неудача - снова открывает.
+class CircuitBreaker {
+public:
+    static CircuitBreaker &instance();
+    // Вызывается до запуска воркеров. threshold = 0 отключает предохранитель
+    static void configure(int threshold, int cooldownSec);
+    static bool enabled() { return failureThreshold > 0; }
+
+    static std::string makeKey(const std::string &host, int port);
+
+    // false - сервер считается недоступным, обращаться к нему не нужно
+    bool allow(const std::string &key);
+    void success(const std::string &key);
+    void failure(const std::string &key);
+
+    uint64_t rejectedCount() const { return rejected.load(std::memory_order_relaxed); }
+    uint64_t trippedCount() const { return tripped.load(std::memory_order_relaxed); }
+    // Серверов в таблице и сколько записей вытеснено при её переполнении или устаревании
+    size_t trackedCount() const { return tracked.load(std::memory_order_relaxed); }
+    uint64_t evictedCount() const { return evicted.load(std::memory_order_relaxed); }
+
+private:
+    enum class State { Closed, Open, HalfOpen };
+    struct Entry {
+        State state = State::Closed;
+        int failures = 0;
+        // Open: до какого момента отклонять; HalfOpen: когда пробный запрос считать потерянным
+        std::chrono::steady_clock::time_point until;
+        std::chrono::steady_clock::time_point lastFailure;
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+    };
+    static constexpr size_t kShards = 16;
+    // Серверов на шард: запросы к множеству недоступных адресов не должны расти в памяти без предела
+    static constexpr size_t kMaxShardEntries = 1024;
+    // Открытая запись, к которой столько сроков cooldown после until никто не обращался, забывается
+    static constexpr int kStaleCooldowns = 6;
+
+    Shard &shardFor(const std::string &key);
+    bool stale(const Entry &entry, std::chrono::steady_clock::time_point now) const;
+    // Освобождает место в переполненном шарде; вызывается под его мьютексом
+    void evict(Shard &shard, std::chrono::steady_clock::time_point now);
+
+    Shard shards[kShards];
+    // Серверов в таблице: пока их нет, success() обходится без блокировки
+    std::atomic<size_t> tracked{0};
+    std::atomic<uint64_t> rejected{0};
+    std::atomic<uint64_t> tripped{0};
+    std::atomic<uint64_t> evicted{0};
+
+    static int failureThreshold;
+    static std::chrono::seconds cooldown;
+};
+
+#endif // CIRCUIT_BREAKER_HPP
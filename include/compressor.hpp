@@ -0,0 +1,88 @@
+#ifndef COMPRESSOR_HPP
+#define COMPRESSOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Потоковое сжатие тела ответа: куски тела подаются по мере чтения от сервера,
+// сжатые данные дописываются в выходную строку. Один объект - один ответ за раз,
+// после reset() годится для следующего.
+class Compressor {
+public:
+    enum class Encoding { None, Gzip, Brotli };
+
+    virtual ~Compressor() = default;
+    Encoding encoding() const { return kind; }
+    // Значение Content-Encoding
+    static const char *name(Encoding encoding);
+    // Есть ли поддержка в этой сборке
+    static bool available(Encoding encoding);
+    static std::unique_ptr<Compressor> create(Encoding encoding);
+
+    // flush - отдать всё, что накоплено внутри (сервер замолчал, клиент не должен ждать).
+    // false - ошибка библиотеки, ответ дальше сжимать нельзя
+    virtual bool write(const char *data, size_t len, bool flush, std::string &out) = 0;
+    // Конец тела: остаток и завершение потока
+    virtual bool finish(std::string &out) = 0;
+    virtual bool reset() = 0;
+
+protected:
+    explicit Compressor(Encoding kind) : kind(kind) {}
+
+private:
+    Encoding kind;
+};
+
+// Сжатие ответов для клиентов с Accept-Encoding: политика (кодировки, типы содержимого,
+// минимальный размер) и пул готовых компрессоров. Пул свой у каждого потока-воркера:
+// контекст zlib создаётся один раз и между ответами только сбрасывается.
+class CompressorPool {
+public:
+    struct Policy {
+        bool gzip = false;
+        bool brotli = false;
+        size_t minSize = 1024;          // ответы с Content-Length меньше не сжимаются
+        std::vector<std::string> types; // типы содержимого; "text/" - все подтипы
+    };
+    struct Stats {
+        std::atomic<uint64_t> responses{0};
+        std::atomic<uint64_t> bytesIn{0};
+        std::atomic<uint64_t> bytesOut{0};
+    };
+
+    static void configure(const Policy &policy);
+    static bool enabled() { return policy.gzip || policy.brotli; }
+    // Разбирает список для --compress ("gzip,br", "off"); false - неизвестная или недоступная кодировка
+    static bool parseEncodings(const std::string &list, Policy &out, std::string &error);
+    static std::vector<std::string> defaultTypes();
+    // Разбирает список для --compress-types
+    static std::vector<std::string> parseTypes(const std::string &list);
+
+    // Кодировка для ответа 200 по Accept-Encoding клиента и заголовкам ответа; None - пересылать как есть
+    static Compressor::Encoding choose(std::string_view acceptEncoding, const std::string &responseHeaders,
+                                       bool haveContentLength, uint64_t contentLength);
+
+    static CompressorPool &local();
+    std::unique_ptr<Compressor> acquire(Compressor::Encoding encoding);
+    void release(std::unique_ptr<Compressor> compressor);
+
+    static Stats &stats() { return counters; }
+
+private:
+    // Сколько простаивающих компрессоров каждой кодировки держит поток
+    static constexpr size_t kMaxIdle = 16;
+
+    static bool typeCompressible(std::string_view contentType);
+
+    std::vector<std::unique_ptr<Compressor>> idle[3];
+
+    static Policy policy;
+    static Stats counters;
+};
+
+#endif // COMPRESSOR_HPP
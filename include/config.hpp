@@ -1,9 +1,40 @@
 #ifndef CONFIG_HPP
 #define CONFIG_HPP
 
+#include <string>
+
 struct Config {
     int port = 8080;
-    int maxThreads = 4;
+    int maxThreads = 0; // 0 - по одному циклу событий на ядро
+    int listeners = 0;  // >0 - свой SO_REUSEPORT-сокет у каждого из N воркеров
+    bool pinCpus = false;
+    std::string ioEngine = "epoll"; // epoll или uring (io_uring, при отсутствии в ядре - epoll)
+    int maxQueued = 4096;          // принятых соединений, ждущих цикла, 0 - без ограничения
+    int maxConnections = 0;        // одновременно обслуживаемых соединений, 0 - без ограничения
+    int queueTimeoutMs = 0;        // дольше ждавшие в очереди получают 503, 0 - ждать сколько угодно
+    bool lifoOverload = false;     // при перегрузке первыми обслуживать самые новые соединения
+    int maxPerClient = 0;          // соединений с одного IP клиента, 0 - без ограничения
+    int upstreamMaxIdle = 8;       // простаивающих keep-alive соединений на host:port, 0 - без пула
+    int upstreamIdleTimeout = 30;  // секунд
+    int keepAliveTimeout = 15;     // секунд простоя клиентского keep-alive соединения
+    int cacheSizeMb = 64;          // бюджет кеша ответов, 0 - кеш отключён
+    int redirectCacheSize = 1024;  // постоянных редиректов (301, 308) в таблице, 0 - не запоминать
+    bool coalesce = true;          // схлопывать одновременные одинаковые GET-запросы
+    std::string compress = "off"; // кодировки сжатия ответов на лету: "gzip", "br", "gzip,br"; off - не сжимать
+    int compressMinSize = 1024;    // ответы с Content-Length меньше не сжимаются
+    std::string compressTypes;     // сжимаемые типы через запятую, пусто - текстовые по умолчанию
+    bool splice = true;            // пересылать тело ответа через splice(), без копирования
+    int dnsThreads = 2;            // потоков резолвера имён
+    std::string dnsServer;         // "ip[:port]" DNS-сервера, пусто - из /etc/resolv.conf
+    int connectTimeoutMs = 5000;   // подключение к серверу вместе с разрешением имени, 0 - без ограничения
+    int readTimeoutMs = 30000;     // простой сервера при чтении ответа
+    int writeTimeoutMs = 30000;    // простой при записи запроса серверу или ответа клиенту
+    int requestTimeoutMs = 0;      // весь обмен с сервером, 0 - без ограничения
+    int breakerThreshold = 5;      // неудач подряд, после которых сервер считается недоступным, 0 - не считать
+    int breakerCooldown = 10;      // секунд до пробного запроса к недоступному серверу
+    std::string logLevel = "info"; // debug, info, error, off
+    std::string accessLog;         // двоичный журнал доступа, пусто - не вести
+    int metricsPort = 0;           // служебный порт с /metrics, 0 - не открывать
 };
 
 #endif // CONFIG_HPP
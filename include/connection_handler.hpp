@@ -1,28 +1,263 @@
 #ifndef CONNECTION_HANDLER_HPP
 #define CONNECTION_HANDLER_HPP
 
+#include "event_loop.hpp"
 #include "http_parser.hpp"
+#include "response_cache.hpp"
+#include "request_coalescer.hpp"
+#include "read_buffer.hpp"
+#include "request_parser.hpp"
+#include "dns_resolver.hpp"
+#include "upstream_connector.hpp"
+#include "access_log.hpp"
+#include "request_arena.hpp"
+#include "coro.hpp"
+#include "admission_control.hpp"
+#include "redirect_handler.hpp"
+#include "compressor.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
-class ConnectionHandler {
+// Клиентское соединение как неблокирующий конечный автомат: чтение запроса,
+// подключение к серверу, отправка запроса, заголовки ответа, тело ответа.
+// Каждый шаг продвигается, пока не упрётся в EAGAIN, и продолжается
+// по следующему событию epoll. Подключение к серверу (разрешение имени и попытки
+// по адресам) идёт сопрограммой dialUpstream(), автомат ждёт её в Connecting.
+class ConnectionHandler : public EventHandler {
 public:
-    bool processRequest(const HttpRequest &req, int clientFd);
+    // acceptedAt - когда соединение принято: от него считается первый запрос в журнале доступа.
+    // ticket - место соединения в AdmissionControl, освобождается вместе с обработчиком
+    ConnectionHandler(EventLoop &loop, int clientFd, std::chrono::steady_clock::time_point acceptedAt,
+                      AdmissionControl::Ticket ticket = {});
+    ~ConnectionHandler() override;
+
+    // Вызывается до запуска воркеров
+    static void configure(int keepAliveTimeoutSec, bool splice);
+    // Сроки обмена с сервером в миллисекундах, 0 - без ограничения: подключение (вместе
+    // с разрешением имени), простой при чтении и при записи, весь запрос целиком
+    static void configureTimeouts(int connectMs, int readMs, int writeMs, int totalMs);
+    // Ответы сервера, пересланные всеми воркерами, и системные вызовы ввода-вывода на них
+    static void ioStats(uint64_t &responses, uint64_t &syscalls);
+
+    void start();
+    void onEvent(int fd, uint32_t events) override;
+    void onShutdown() override;
 
 private:
+    enum class State {
+        ReadRequest,
+        Connecting,     // выполняется dialUpstream()
+        SendRequest,
+        ReadHeaders,
+        SkipRedirectBody, // тело ответа 3xx, по которому идём дальше: дочитывается и отбрасывается
+        StreamBody,
+        ServeCached,    // ответ из кеша, без обращения к серверу
+        FollowInflight, // ответ, который сейчас получает другой такой же запрос
+        FinishResponse, // дописать ответ и ждать следующий запрос
+        Closing,
+        Done
+    };
+
+    // Результат одного шага автомата
+    enum class Step { Progress, Blocked };
+
+    void drive();
+    Step readRequest();
+    bool wantsKeepAlive(const HttpRequest &req) const;
+    void resetForNextRequest();
+    void armIdleTimer();
+    void cancelIdleTimer();
+    // Таймауты обмена с сервером: ближайший срок для текущего состояния и его проверка
+    std::chrono::steady_clock::time_point nextDeadline() const;
+    bool waitingForClient() const;
+    void armDeadlineTimer();
+    void cancelDeadlineTimer();
+    void checkDeadlines();
+    // Учёт запроса для журнала доступа и метрик: начало, отметка этапа (первая), цель и итог по окончании ответа
+    void beginAccess();
+    void markAccess(uint32_t &stage);
+    void setAccessTarget(const std::string &host, int port);
+    void setAccessStatus(const char *statusLine, size_t len);
+    void finishAccess(bool complete);
+    bool processRequest();
+    bool startUpstream();
+    // Схлопывание одинаковых запросов: false - запрос стал лидером и идёт к серверу сам
+    bool joinInflight(const std::string &key, const HttpRequest &req);
+    void leaveInflight();
+    void stopLeading(bool completed);
+    void publishBody(const char *data, size_t len);
+    Step followInflight();
     bool parseFinalUrl(const HttpRequest &req, std::string &host, int &port, std::string &path);
-    bool parseRedirectUrl(const std::string &location, std::string &host, int &port, std::string &path);
-    int connectToServer(const std::string &host, int port);
-    bool sendRequest(int serverFd, const HttpRequest &req);
-    bool readHeadersAndCheckRedirect(int serverFd, int clientFd, std::string &location);
-    bool streamResponse(int serverFd, int clientFd);
+    // Берёт соединение из пула или переводит автомат в Connecting; false - не удалось сразу
+    bool connectToServer(const std::string &host, int port, bool allowPooled = true);
+    // Разрешение имени и подключение; true - serverFd подключён
+    Coro::Task<bool> dialUpstream();
+    void connectFailed(bool timedOut = false);
+    Step finishConnect();
+    // Готовит запрос к серверу host:port: заново собираются только строка запроса,
+    // Host, условные заголовки и Connection, остальное - куски заголовков клиента
+    void sendRequest(const std::string &host, int port);
+    Step flushToServer();
+    Step readHeadersAndCheckRedirect();
+    // Клиент получает только последний ответ цепочки: тело 3xx отбрасывается,
+    // соединение с сервером уходит в пул и может достаться следующему шагу
+    Step skipRedirectBody();
+    bool followRedirect();
+    Step streamResponse();
+    void startServeCached(std::shared_ptr<const CachedResponse> entry);
+    Step serveCached();
+    void finishCapture();
+    Step flushToClient();
+    // Клиенту отправлено не всё: осталось в clientOut или в буфере отправки цикла (io_uring)
+    bool clientOutPending() const;
+    bool relayBody(const char *data, size_t len);
+    // Пересылка тела через splice(): сколько байт можно отправить каналом, 0 - только копированием
+    size_t spliceLimit();
+    bool openPipe();
+    void closePipe();
+    Step flushPipe();
+    void consumeSpliced(size_t len);
+    bool relayToClient(const char *data, size_t len);
+    std::string rewriteResponseHeaders(const std::string &headers);
+    // Сжатие тела для клиента: между чтением тела от сервера и записью клиенту.
+    // Сжатые куски уходят клиенту HTTP/1.1 чанками, HTTP/1.0 - до закрытия соединения
+    void startCompression(const std::string &headers, int status);
+    bool relayCompressed(const char *data, size_t len, bool flush);
+    bool finishCompression();
+    void stopCompression();
+    void fail(const std::string &response);
+    // Повторяет запрос через новое соединение, если соединение из пула оказалось мёртвым
+    bool retryFresh();
+    // Возвращает соединение с сервером в пул, если ответ позволяет его переиспользовать
+    void releaseServer();
+    void closeServer();
+
+    // Учёт границ тела ответа: сколько байт из data относится к текущему ответу
+    size_t consumeBody(const char *data, size_t len);
+    size_t consumeChunked(const char *data, size_t len);
+
+    EventLoop &loop;
+    int clientFd;
+    int serverFd = -1;
+    State state = State::ReadRequest;
+
+    // Разобранный запрос и его производные живут в арене, которая сбрасывается после ответа
+    RequestArena arena;
+    HttpRequest request{arena.get()};
+    int redirectCount = 0;
+    RedirectHandler::Target redirectTarget; // куда ведёт ответ 3xx, тело которого дочитывается
+    size_t redirectSkipped = 0;
+    bool keepClient = false;
+    bool clientEof = false;
+    bool stopping = false;
+    uint64_t requestsServed = 0;
+    uint64_t idleTimer = 0;
+    uint64_t deadlineTimer = 0;
+    std::chrono::steady_clock::time_point exchangeStart;
+    std::chrono::steady_clock::time_point connectStart;
+    std::chrono::steady_clock::time_point dialStart; // начало подключения по уже известным адресам
+    std::chrono::steady_clock::time_point lastActivity;
+    std::chrono::steady_clock::time_point acceptedAt;
+    AdmissionControl::Ticket admission;
+
+    // Времена и итоги текущего запроса для журнала доступа и метрик; accessPending - запрос начат и ещё не учтён
+    AccessRecord access;
+    std::chrono::steady_clock::time_point accessStart;
+    bool accessPending = false;
+    uint64_t accessAllocations = 0; // счётчик выделений потока в начале запроса (ALLOC_STATS)
+
+    static std::chrono::milliseconds keepAliveTimeout;
+    static bool useSplice;
+    static std::chrono::milliseconds connectTimeout;
+    static std::chrono::milliseconds readTimeout;
+    static std::chrono::milliseconds writeTimeout;
+    static std::chrono::milliseconds totalTimeout;
+    static std::chrono::milliseconds deadlineCheckInterval;
+    static std::atomic<uint64_t> totalResponses;
+    static std::atomic<uint64_t> totalSyscalls;
+
+    ReadBuffer clientIn;
+    RequestParser requestParser;
+    RequestView requestView;
+    std::string clientOut;
+    size_t clientOutPos = 0;
+    ReadBuffer serverIn;
+    // Заголовки запроса клиента: пересылаются серверу кусками, без разбора в строки
+    struct ForwardedField {
+        uint32_t begin;   // начало строки заголовка в requestHead
+        uint32_t nameLen;
+        uint32_t end;     // за "\r\n" строки
+    };
+    std::string requestHead;
+    std::vector<ForwardedField> requestFields;
+    // Запрос к серверу уходит одним sendmsg(): serverOutHead, куски requestHead, serverOutTail
+    std::string serverOutHead;
+    std::vector<std::pair<uint32_t, uint32_t>> serverOutSpans;
+    std::string serverOutTail;
+    size_t serverOutSize = 0;
+    size_t serverOutPos = 0;
+    UpstreamConnector connector;
+    Coro::Trigger connectorReady; // событие на сокете попытки или таймер connector
+    Coro::Task<bool> dial;        // уничтожается раньше connectorReady, которого может ждать
+    std::string upstreamHost;
+    int upstreamPort = 0;
+    // Сервер из запроса клиента: Cookie и Authorization уходят только ему, не на чужой адрес редиректа
+    std::string originHost;
+    int originPort = 0;
+    std::string breakerKey; // host:port для CircuitBreaker
+    bool serverReused = false;
+    bool upstreamKeepAlive = false;
+    bool clientHttp10 = false;
 
     bool chunked = false;
     bool haveContentLength = false;
     size_t contentLength = 0;
+    size_t bodyRemaining = 0;
+    bool bodyDone = false;
+    bool bodyError = false;
+    bool dechunk = false;
+    std::string dechunked;
+    std::unique_ptr<Compressor> compressor; // из CompressorPool потока, nullptr - тело идёт как есть
+    bool compressPending = false;           // компрессор получил данные после последнего flush
+    std::string compressOut;
+
+    // Канал для splice() и учёт байт тела текущего ответа: через канал и через копирование
+    int pipeFds[2] = {-1, -1};
+    size_t pipeCapacity = 0;
+    size_t pipeBytes = 0;
+    bool spliceFailed = false;
+    size_t splicedBytes = 0;
+    size_t copiedBytes = 0;
+    // recv/send/splice, потраченные на текущий обмен с сервером
+    uint64_t syscalls = 0;
+
+    // Кеш: ключ запроса, запись для отдачи или перепроверки, копия тела для сохранения
+    std::string cacheKey;
+    std::shared_ptr<const CachedResponse> cachedEntry;
+    size_t cachedPos = 0;
+    std::shared_ptr<CachedResponse> captureEntry;
+    std::string captureBody;
+    bool capturing = false;
+
+    // Схлопывание: поток ответа лидера, подписка ведомого и позиция чтения в нём
+    std::string coalesceKey;
+    std::shared_ptr<InflightResponse> inflight;
+    std::shared_ptr<InflightSubscription> subscription;
+    bool leading = false;
+    size_t followSegment = 0;
+    bool followHeadersSent = false;
+    bool followChunked = false;
 
-    bool streamChunkedResponse(int serverFd, int clientFd);
-    bool streamRawResponse(int serverFd, int clientFd);
-    bool streamWithContentLength(int serverFd, int clientFd, size_t length);
+    // Состояние разбора chunked-тела
+    enum class ChunkState { Size, Data, DataEnd, Trailer };
+    ChunkState chunkState = ChunkState::Size;
+    size_t chunkRemaining = 0;
+    std::string chunkLine;
 };
 
 #endif // CONNECTION_HANDLER_HPP
@@ -0,0 +1,148 @@
+#ifndef CORO_HPP
+#define CORO_HPP
+
+#include "event_loop.hpp"
+#include "dns_resolver.hpp"
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+// Сопрограммы C++20 поверх EventLoop: линейный код вместо состояний автомата там,
+// где шаги идут строго друг за другом. Всё выполняется в потоке цикла; сопрограмма
+// продолжается из обработчика события, таймера или ответа резолвера.
+namespace Coro {
+
+    // Ленивая сопрограмма с результатом T: начинает выполняться в start(). Task владеет
+    // кадром: уничтожение Task отменяет сопрограмму в точке ожидания, ожидания снимаются
+    // деструкторами своих awaiter-ов.
+    template <typename T>
+    class Task {
+    public:
+        struct promise_type {
+            std::optional<T> value;
+            std::function<void()> onDone; // продолжение, если сопрограмма завершилась не сразу
+
+            void return_value(T v) { value = std::move(v); }
+
+            Task get_return_object() { return Task(Handle::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    promise_type &p = h.promise();
+                    if (p.onDone) {
+                        // Обработчик может уничтожить Task вместе с кадром: вызываем копию
+                        auto callback = std::move(p.onDone);
+                        callback();
+                    }
+                    return std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { std::terminate(); }
+        };
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Task() = default;
+        Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+        Task &operator=(Task &&other) noexcept {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, {});
+            }
+            return *this;
+        }
+        ~Task() {
+            if (handle) handle.destroy();
+        }
+
+        bool valid() const { return (bool)handle; }
+        bool done() const { return handle && handle.done(); }
+
+        // Выполняет сопрограмму до первой точки ожидания; true - она уже завершилась
+        bool start() {
+            handle.resume();
+            return handle.done();
+        }
+        // Вызывается, когда сопрограмма, запущенная start(), завершится позже
+        void whenDone(std::function<void()> callback) { handle.promise().onDone = std::move(callback); }
+
+        T result() { return std::move(*handle.promise().value); }
+
+    private:
+        explicit Task(Handle handle) : handle(handle) {}
+        Handle handle;
+    };
+
+    // Точка ожидания, которую будит владелец: например, обработчик события сокета.
+    // Ждать может одна сопрограмма; fire() без ждущей ничего не делает.
+    class Trigger {
+    public:
+        Trigger() = default;
+        Trigger(const Trigger &) = delete;
+        Trigger &operator=(const Trigger &) = delete;
+
+        void fire() {
+            if (auto h = std::exchange(waiter, {})) h.resume();
+        }
+
+        auto operator co_await() noexcept {
+            struct Awaiter {
+                Trigger &trigger;
+                std::coroutine_handle<> self;
+                bool await_ready() noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> h) noexcept {
+                    self = h;
+                    trigger.waiter = h;
+                }
+                void await_resume() noexcept {}
+                // Сопрограмму уничтожили во время ожидания
+                ~Awaiter() {
+                    if (self && trigger.waiter == self) trigger.waiter = {};
+                }
+            };
+            return Awaiter{*this, {}};
+        }
+
+    private:
+        std::coroutine_handle<> waiter;
+    };
+
+    // co_await resolve(loop, host) - адреса из кеша DnsResolver или от его потоков
+    class Resolve {
+    public:
+        Resolve(EventLoop &loop, std::string host) : loop(loop), host(std::move(host)) {}
+        Resolve(const Resolve &) = delete;
+
+        bool await_ready() {
+            result = DnsResolver::instance().lookupCached(host);
+            return result != nullptr;
+        }
+        void await_suspend(std::coroutine_handle<> h) {
+            // Ответ, пришедший после уничтожения сопрограммы, отбрасывает сам DnsResolver
+            DnsResolver::instance().resolve(host, loop, alive, [this, h](std::shared_ptr<const DnsResult> r) {
+                result = std::move(r);
+                h.resume();
+            });
+        }
+        std::shared_ptr<const DnsResult> await_resume() { return std::move(result); }
+
+    private:
+        EventLoop &loop;
+        std::string host;
+        std::shared_ptr<void> alive = std::make_shared<int>(0);
+        std::shared_ptr<const DnsResult> result;
+    };
+
+    inline Resolve resolve(EventLoop &loop, std::string host) {
+        return Resolve(loop, std::move(host));
+    }
+}
+
+#endif // CORO_HPP
@@ -0,0 +1,105 @@
+#ifndef DNS_RESOLVER_HPP
+#define DNS_RESOLVER_HPP
+
+#include "event_loop.hpp"
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ResolvedAddress {
+    sockaddr_storage addr; // порт не заполнен
+    socklen_t len;
+};
+
+struct DnsResult {
+    bool ok = false;
+    std::vector<ResolvedAddress> addresses; // IPv6 и IPv4 в порядке ответа
+    std::string error;
+};
+
+// Разрешение имён вне циклов событий: запросы A/AAAA выполняют потоки резолвера,
+// результат доставляется в цикл запросившего соединения. Ответы кешируются
+// на время их TTL, отрицательные - на короткий срок; одновременные запросы
+// одного имени ждут одного разрешения. Размер кеша ограничен: при переполнении
+// шарда уходят просроченные записи, затем ближайшие к истечению.
+class DnsResolver {
+public:
+    using Callback = std::function<void(std::shared_ptr<const DnsResult>)>;
+
+    struct Stats {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> coalesced{0};
+        std::atomic<uint64_t> failures{0};
+        std::atomic<uint64_t> evicted{0};
+    };
+
+    static DnsResolver &instance();
+    // Вызывается до запуска воркеров. server - "ip" или "ip:port", пусто - из /etc/resolv.conf
+    static void configure(int threads, const std::string &server);
+
+    bool start();
+    void shutdown();
+
+    // Свежий результат из кеша или числовой адрес; nullptr - нужно вызвать resolve()
+    std::shared_ptr<const DnsResult> lookupCached(const std::string &host);
+    // Асинхронное разрешение: callback выполняется в потоке loop, если owner ещё жив
+    void resolve(const std::string &host, EventLoop &loop, std::weak_ptr<void> owner, Callback callback);
+
+    Stats &stats() { return counters; }
+
+private:
+    struct Waiter {
+        EventLoop *loop;
+        std::weak_ptr<void> owner;
+        Callback callback;
+    };
+    struct Entry {
+        std::shared_ptr<const DnsResult> result;
+        std::chrono::steady_clock::time_point expires;
+        bool pending = false;
+        std::vector<Waiter> waiters;
+    };
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> entries;
+    };
+    static constexpr size_t kShards = 16;
+    // Имён в кеше на шард: случайные имена от клиентов не должны расти в памяти без предела
+    static constexpr size_t kMaxShardEntries = 1024;
+
+    Shard &shardFor(const std::string &host);
+    // Освобождает место в переполненном шарде; вызывается под его мьютексом
+    void evict(Shard &shard);
+    void workerFunc();
+    // Выполняется в потоке резолвера; ttl - сколько держать результат в кеше
+    std::shared_ptr<const DnsResult> lookup(void *state, const std::string &host, std::chrono::seconds &ttl);
+    void complete(const std::string &host, std::shared_ptr<const DnsResult> result, std::chrono::seconds ttl);
+    void loadHosts();
+
+    Shard shards[kShards];
+    Stats counters;
+    // Статические записи из /etc/hosts, имя в нижнем регистре
+    std::unordered_map<std::string, std::vector<ResolvedAddress>> hosts;
+
+    std::mutex queueMtx;
+    std::condition_variable queueCv;
+    std::deque<std::string> queue;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    static int numThreads;
+    static std::string serverAddr;
+};
+
+#endif // DNS_RESOLVER_HPP
@@ -0,0 +1,163 @@
+#ifndef EVENT_LOOP_HPP
+#define EVENT_LOOP_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Uring;
+struct io_uring_cqe;
+
+// Обработчик событий на файловых дескрипторах, зарегистрированных в EventLoop.
+class EventHandler {
+public:
+    virtual ~EventHandler() = default;
+    virtual void onEvent(int fd, uint32_t events) = 0;
+    // Готовый сокет клиента от EventLoop::acceptMultishot()
+    virtual void onAccepted(int listenFd, int clientFd) { (void)listenFd; (void)clientFd; }
+    // Цикл начал завершение: простаивающим соединениям пора закрыться
+    virtual void onShutdown() {}
+};
+
+// Работа цикла помимо событий epoll (задачи планировщика пула).
+class IdleWork {
+public:
+    virtual ~IdleWork() = default;
+    // Выполнить накопившуюся работу; true - что-то было выполнено
+    virtual bool runPending() = 0;
+    // Цикл собирается заснуть в epoll_wait; false - работа появилась, спать нельзя
+    virtual bool prepareToPark() = 0;
+    virtual void unparked() = 0;
+};
+
+// Реактор (edge-triggered) на epoll или io_uring. Один экземпляр на поток-воркер:
+// все методы, кроме post() и stop(), вызываются только из потока цикла.
+// С io_uring готовность сокетов приходит от многоразовых poll-заявок, а регистрация,
+// снятие, отправка данных через send() и ожидание событий уходят в ядро одним
+// io_uring_enter() на проход цикла.
+class EventLoop {
+public:
+    enum class Engine { Epoll, Uring };
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    // Движок для циклов, создаваемых после вызова. Uring без поддержки в ядре
+    // заменяется на epoll; возвращает выбранный движок
+    static Engine configure(Engine engine);
+    static bool parseEngine(const std::string &name, Engine &engine);
+
+    bool init();
+    void run();
+    // Цикл, который крутится в текущем потоке, или nullptr
+    static EventLoop *current();
+    // Просит цикл завершиться после того, как закроются все активные соединения
+    void stop();
+
+    bool add(int fd, uint32_t events, EventHandler *handler);
+    bool modify(int fd, uint32_t events, EventHandler *handler);
+    void remove(int fd);
+    // Приём соединений ядром: готовые сокеты приходят в handler->onAccepted().
+    // false - движок epoll, слушающий сокет регистрируется через add()
+    bool acceptMultishot(int listenFd, EventHandler *handler);
+
+    // Отправка заявками io_uring SEND (только движок io_uring, см. asyncSend()): данные
+    // копируются в буфер цикла и уходят в ядро вместе с остальными заявками прохода.
+    // Когда всё отправлено, обработчик получает EPOLLOUT, при ошибке - EPOLLERR.
+    // false - отправка на этом fd уже завершилась ошибкой
+    bool asyncSend() const { return ring != nullptr; }
+    bool send(int fd, const char *data, size_t len);
+    // Есть данные, которые ещё не отправлены
+    bool sendPending(int fd) const;
+    bool sendFailed(int fd) const;
+
+    // Передаёт задачу на выполнение в поток цикла (потокобезопасно)
+    void post(std::function<void()> task);
+    // Прерывает epoll_wait (потокобезопасно)
+    void wakeup();
+    // Вызывается до run(); между пачками событий цикл выполняет work,
+    // а прежде чем заснуть, недолго перепроверяет её
+    void setIdleWork(IdleWork *work) { idleWork = work; }
+
+    // Однократный таймер; id = 0 никогда не выдаётся и может означать "нет таймера"
+    uint64_t addTimer(std::chrono::milliseconds delay, std::function<void()> callback);
+    void cancelTimer(uint64_t id);
+
+    // Цикл владеет обработчиками соединений; retire() откладывает удаление
+    // до конца текущей пачки событий epoll.
+    void adopt(std::unique_ptr<EventHandler> handler);
+    void retire(EventHandler *handler);
+    size_t activeCount() const { return owned.size(); }
+
+private:
+    struct Watch {
+        EventHandler *handler = nullptr;
+        uint32_t events = 0;
+        uint32_t generation = 0; // завершения заявок прежней регистрации fd отбрасываются
+        bool accepting = false;
+
+        // Отправка через io_uring: out уходит заявкой sendTag и до её завершения не меняется,
+        // дописанное за это время копится в outNext
+        std::string out;
+        size_t outPos = 0;
+        std::string outNext;
+        uint64_t sendTag = 0; // 0 - заявки отправки нет
+        bool sendQueued = false; // fd в sendReady
+        bool sendFailed = false;
+    };
+
+    bool waitEpoll(int timeout);
+    bool waitUring(int timeout);
+    void onCompletion(const io_uring_cqe &cqe);
+    void onSendCompletion(const io_uring_cqe &cqe);
+    bool arm(int fd);
+    void cancel(int fd);
+    void cancelRequest(uint64_t tag);
+    void scheduleSend(int fd);
+    void submitSends();
+    bool submitSend(int fd);
+    Watch &watch(int fd);
+    void drainWakeup();
+    void runPosted();
+    int waitTimeoutMs();
+    int nextTimeoutMs();
+    void runTimers();
+    void beginShutdown();
+
+    int epfd = -1;
+    std::unique_ptr<Uring> ring; // есть - работаем на io_uring, иначе на epoll
+    int wakeFd = -1;
+    bool stopRequested = false;
+    IdleWork *idleWork = nullptr;
+    bool idleWorkBusy = false;
+
+    std::vector<Watch> watches; // индекс - номер fd
+    std::vector<int> sendReady; // fd с данными для отправки, заявки ставятся перед io_uring_enter
+    // Буферы заявок отправки снятых fd: ядро читает их, пока заявка не завершится
+    std::unordered_map<uint64_t, std::string> orphanSends;
+    std::unordered_map<EventHandler*, std::unique_ptr<EventHandler>> owned;
+    std::vector<std::unique_ptr<EventHandler>> retired;
+
+    using Clock = std::chrono::steady_clock;
+    struct TimerEntry {
+        Clock::time_point deadline;
+        uint64_t id;
+        bool operator>(const TimerEntry &other) const { return deadline > other.deadline; }
+    };
+    std::priority_queue<TimerEntry, std::vector<TimerEntry>, std::greater<TimerEntry>> timerQueue;
+    std::unordered_map<uint64_t, std::function<void()>> timers; // отменённые удаляются отсюда
+    uint64_t nextTimerId = 1;
+
+    std::mutex postMtx;
+    std::vector<std::function<void()>> posted;
+};
+
+#endif // EVENT_LOOP_HPP
@@ -0,0 +1,57 @@
+#ifndef HEADER_SCAN_HPP
+#define HEADER_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Разметка блока заголовков за один проход: концы строк и первое двоеточие
+// в каждой строке ищутся SIMD-сравнением по 16 (SSE2) или 32 (AVX2) байта.
+// Реализация выбирается при запуске по возможностям процессора.
+namespace HeaderScan {
+    constexpr uint32_t kNoColon = UINT32_MAX;
+
+    // Смещения от начала буфера; end - без "\r\n"
+    struct Line {
+        uint32_t begin;
+        uint32_t end;
+        uint32_t colon; // первое ':' в строке или kNoColon
+    };
+
+    struct Result {
+        size_t consumed; // смещение за последней полной строкой
+        bool complete;   // встретилась пустая строка (она входит в consumed, но не в lines)
+    };
+
+    // Дописывает в lines полные непустые строки из data[from, len) до первой пустой строки
+    Result scan(const char *data, size_t len, size_t from, std::vector<Line> &lines);
+
+    // Строка статуса и заголовки ответа сервера, от которых зависит пересылка тела.
+    // Значения указывают в разобранный буфер, без пробелов по краям.
+    struct ResponseHead {
+        int status = 0;
+        bool http11 = false;
+        bool haveLocation = false;
+        bool haveContentLength = false;
+        std::string_view location;
+        std::string_view connection;
+        std::string_view transferEncoding;
+        std::string_view contentLength;
+    };
+
+    // Разбирает ответ по строкам, размеченным scan(); false - строк нет
+    bool inspectResponse(const char *data, const std::vector<Line> &lines, ResponseHead &head);
+
+    enum class Impl { Scalar, SSE2, AVX2 };
+    // Принудительный выбор реализации (для бенчмарков); false, если процессор её не поддерживает
+    bool use(Impl impl);
+    const char *implName();
+
+    // Шестнадцатеричное число (размер чанка) до пробела, ';' или конца строки
+    bool parseHex(const char *s, size_t len, uint64_t &value);
+    // Десятичное число без знака (Content-Length), вся строка должна быть цифрами
+    bool parseDecimal(const char *s, size_t len, uint64_t &value);
+}
+
+#endif // HEADER_SCAN_HPP
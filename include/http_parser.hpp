@@ -1,14 +1,34 @@
 #ifndef HTTP_PARSER_HPP
 #define HTTP_PARSER_HPP
 
+#include <functional>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
+// Хеш имени заголовка для поиска по string_view без построения строки-ключа
+struct HeaderNameHash {
+    using is_transparent = void;
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+};
+
+// Строки и заголовки запроса живут в переданном ресурсе памяти, по умолчанию - в куче.
+// ConnectionHandler размещает запрос в своей арене (RequestArena).
 struct HttpRequest {
-    std::string method;
-    std::string path;
-    std::string version;
-    std::unordered_map<std::string, std::string> headers;
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    using HeaderMap = std::pmr::unordered_map<std::pmr::string, std::pmr::string, HeaderNameHash, std::equal_to<>>;
+
+    explicit HttpRequest(allocator_type alloc = {})
+        : method(alloc), path(alloc), version(alloc), headers(alloc) {}
+
+    std::pmr::string method;
+    std::pmr::string path;
+    std::pmr::string version;
+    HeaderMap headers;
+
+    // Значение заголовка по имени в нижнем регистре, nullptr - заголовка нет
+    const std::pmr::string *header(std::string_view lowerName) const;
 };
 
 class HttpParser {
@@ -1,17 +1,32 @@
 #ifndef LISTENER_HPP
 #define LISTENER_HPP
 
+#include <atomic>
+#include <cstdint>
+
 class Listener {
 public:
     Listener() = default;
     ~Listener();
-    bool startListening(int port);
+    // reusePort - SO_REUSEPORT: несколько слушающих сокетов на одном порту,
+    // ядро само распределяет между ними входящие соединения
+    bool startListening(int port, bool reusePort = false);
     int getSocketFd() const;
+    // Возвращает неблокирующий сокет клиента или -1, если очередь accept пуста.
+    // При исчерпании дескрипторов (EMFILE, ENFILE) ожидающие соединения закрываются,
+    // а не остаются в очереди: сработавший по фронту цикл иначе больше о них не узнает
     int acceptClient();
+    // Сокет клиента принят в обход acceptClient() (многоразовым accept io_uring)
+    void countAccepted() { accepted.fetch_add(1, std::memory_order_relaxed); }
+    uint64_t acceptedCount() const { return accepted.load(std::memory_order_relaxed); }
 
 private:
     int sockfd = -1;
+    // Запасной дескриптор: освобождается, чтобы принять и закрыть соединение при EMFILE
+    int spareFd = -1;
+    std::atomic<uint64_t> accepted{0};
     bool setNonBlocking(int fd);
+    bool shedOne();
 };
 
 #endif // LISTENER_HPP
@@ -1,12 +1,52 @@
 #ifndef LOGGER_HPP
 #define LOGGER_HPP
 
+#include <atomic>
+#include <cstdint>
 #include <string>
 
+enum class LogLevel : int { Debug = 0, Info = 1, Error = 2, Off = 3 };
+
+// Сообщения ниже этого уровня не попадают в сборку (опция CMake LOG_LEVEL)
+#ifndef LOG_COMPILED_LEVEL
+#define LOG_COMPILED_LEVEL 0
+#endif
+
+// Асинхронный журнал. Каждый поток пишет записи в собственный кольцевой буфер
+// без блокировок, фоновый поток забирает их пачками и выводит одним write()
+// на поток вывода: INFO и DEBUG - в stdout, ERROR - в stderr. Если буфер потока
+// переполнен, запись отбрасывается и учитывается в счётчике потерь.
+// До start() и после stop() записи выводятся сразу, в вызывающем потоке.
 class Logger {
 public:
-    static void info(const std::string &msg);
-    static void error(const std::string &msg);
+    static void debug(const std::string &msg) { write(LogLevel::Debug, msg); }
+    static void info(const std::string &msg) { write(LogLevel::Info, msg); }
+    static void error(const std::string &msg) { write(LogLevel::Error, msg); }
+    static void write(LogLevel level, const std::string &msg);
+
+    static bool enabled(LogLevel level) {
+        return (int)level >= LOG_COMPILED_LEVEL && (int)level >= minLevel.load(std::memory_order_relaxed);
+    }
+    static void setLevel(LogLevel level) { minLevel.store((int)level, std::memory_order_relaxed); }
+    // "debug", "info", "error" или "off"
+    static bool parseLevel(const std::string &name, LogLevel &level);
+
+    static void start();
+    // Дописывает накопленное и останавливает фоновый поток
+    static void stop();
+    static uint64_t droppedCount();
+
+private:
+    static std::atomic<int> minLevel;
 };
 
+// Строка сообщения собирается, только если уровень включён
+#define LOG_AT(level, msg) \
+    do { \
+        if (Logger::enabled(level)) Logger::write(level, msg); \
+    } while (0)
+#define LOG_DEBUG(msg) LOG_AT(LogLevel::Debug, msg)
+#define LOG_INFO(msg) LOG_AT(LogLevel::Info, msg)
+#define LOG_ERROR(msg) LOG_AT(LogLevel::Error, msg)
+
 #endif // LOGGER_HPP
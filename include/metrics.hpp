@@ -0,0 +1,83 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "access_log.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Этапы обработки запроса, для которых собираются гистограммы задержек
+enum class LatencyStage { Parse, Dns, Connect, FirstByte, Total };
+
+// Гистограмма в духе HDR: до 16 мкс значения точные, дальше каждая степень двойки
+// делится на 8 корзин (погрешность не больше 12.5%), всего до ~12 суток.
+// Пишет только поток-владелец, читают при сборе метрик.
+class LatencyHistogram {
+public:
+    static constexpr size_t kLinear = 16;
+    static constexpr size_t kSubBuckets = 8;
+    static constexpr size_t kBuckets = kLinear + (40 - 4) * kSubBuckets;
+
+    void record(uint64_t us);
+    // Прибавляет содержимое к counts и sumUs
+    void addTo(std::array<uint64_t, kBuckets> &counts, uint64_t &sumUs) const;
+
+    static size_t bucketOf(uint64_t us);
+    // Наибольшее значение, попадающее в корзину
+    static uint64_t upperBound(size_t bucket);
+
+private:
+    std::atomic<uint64_t> counts[kBuckets] = {};
+    std::atomic<uint64_t> sumUs{0};
+};
+
+// Метрики в формате Prometheus. Запросы считают воркеры, каждый в своём наборе
+// счётчиков без блокировок; суммирование по потокам - только при сборе (render()).
+// Значения, которые уже считают другие компоненты, подключаются через addCounter/addGauge.
+class Metrics {
+public:
+    static Metrics &instance();
+
+    // Итоги завершённого запроса: коды ответа, трафик, признаки и задержки этапов из записи
+    static void requestFinished(const AccessRecord &rec);
+    static void observe(LatencyStage stage, std::chrono::steady_clock::duration elapsed);
+    static void connectionOpened();
+    static void connectionClosed();
+    // Простаивающих соединений в UpstreamPool текущего потока
+    static void setUpstreamIdle(size_t count);
+    // Выделений памяти за время запроса (сборка с ALLOC_STATS)
+    static void requestAllocations(uint64_t count);
+
+    // Значение читается при каждом сборе; регистрировать до запуска MetricsServer
+    void addCounter(const std::string &name, const std::string &help, std::function<double()> read);
+    void addGauge(const std::string &name, const std::string &help, std::function<double()> read);
+
+    std::string render();
+    // Суммы по всем потокам для итогового отчёта: выделений памяти и учтённых в них запросов
+    void allocationTotals(uint64_t &allocations, uint64_t &requests);
+
+private:
+    struct Shard;
+    struct External {
+        std::string name;
+        std::string help;
+        const char *type;
+        std::function<double()> read;
+    };
+
+    static Shard &local();
+    std::shared_ptr<Shard> registerShard();
+
+    std::mutex mtx;
+    std::vector<std::shared_ptr<Shard>> shards; // наборы завершившихся потоков остаются: счётчики не убывают
+    std::vector<External> external;
+};
+
+#endif // METRICS_HPP
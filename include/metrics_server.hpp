@@ -0,0 +1,30 @@
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include "listener.hpp"
+#include <atomic>
+#include <thread>
+
+// Служебный порт: GET /metrics отдаёт Metrics::render() в текстовом формате Prometheus.
+// Свой поток с блокирующей обработкой по одному запросу: сборщики метрик приходят
+// редко, а циклы событий воркеров не должны тратить на них время.
+class MetricsServer {
+public:
+    MetricsServer() = default;
+    ~MetricsServer();
+    MetricsServer(const MetricsServer &) = delete;
+    MetricsServer &operator=(const MetricsServer &) = delete;
+
+    bool start(int port);
+    void stop();
+
+private:
+    void serve();
+    void handleClient(int fd);
+
+    Listener listener;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+};
+
+#endif // METRICS_SERVER_HPP
@@ -0,0 +1,89 @@
+#ifndef MPMC_QUEUE_HPP
+#define MPMC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Ограниченная очередь для многих писателей и читателей без блокировок
+// (алгоритм Д. Вьюкова): у каждой ячейки свой номер поколения, писатели
+// и читатели занимают ячейки одним CAS по своему счётчику.
+template <typename T, size_t Capacity>
+class MpmcQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    MpmcQueue() {
+        for (size_t i = 0; i < Capacity; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    // false - очередь заполнена
+    bool push(T value) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & kMask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(T &value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & kMask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Приблизительно: писатель мог занять ячейку, но ещё не заполнить её
+    bool empty() const {
+        return head.load(std::memory_order_acquire) >= tail.load(std::memory_order_acquire);
+    }
+
+    // Приблизительно, для наблюдения за очередью
+    size_t size() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+private:
+    static constexpr size_t kMask = Capacity - 1;
+
+    struct alignas(64) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    Cell cells[Capacity];
+};
+
+#endif // MPMC_QUEUE_HPP
@@ -4,6 +4,10 @@
 #include "config.hpp"
 #include "listener.hpp"
 #include "thread_pool.hpp"
+#include "metrics_server.hpp"
+#include <chrono>
+#include <cstdint>
+#include <vector>
 
 class ProxyApp {
 public:
@@ -15,10 +19,19 @@ public:
     bool showHelp() const { return helpFlag; }
     void printHelp();
 private:
+    void runSharded();
+    void reportAcceptRate(const std::vector<uint64_t> &counts);
+    // Счётчики компонентов, которые отдаёт /metrics помимо собранных воркерами
+    void registerMetrics();
+
     Config config;
     bool helpFlag = false;
     Listener listener;
     ThreadPool pool;
+    MetricsServer metricsServer;
+
+    std::chrono::steady_clock::time_point lastRateReport = std::chrono::steady_clock::now();
+    std::vector<uint64_t> lastAcceptCounts;
 };
 
 #endif // PROXY_APP_HPP
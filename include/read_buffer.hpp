@@ -0,0 +1,40 @@
+#ifndef READ_BUFFER_HPP
+#define READ_BUFFER_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Буфер чтения из сокета: читает крупными блоками, отдаёт непрочитанные байты
+// следующему этапу без копирования и продолжает поиск конца заголовков
+// с места, где остановилась прошлая проверка.
+class ReadBuffer {
+public:
+    enum class Status { Ok, WouldBlock, Eof, Error };
+
+    explicit ReadBuffer(size_t blockSize = 16 * 1024) : blockSize(blockSize) {}
+
+    // Один recv() в свободное место буфера
+    Status fill(int fd);
+
+    const char *data() const { return buf.data() + start; }
+    size_t size() const { return end - start; }
+    bool empty() const { return start == end; }
+
+    void consume(size_t n);
+    void clear();
+    // Смещение сразу за "\r\n\r\n" от начала data() или npos
+    size_t findHeaderEnd();
+
+private:
+    // Освобождает место под очередной блок: сдвигает данные в начало или растит буфер
+    void reserveBlock();
+
+    std::vector<char> buf;
+    size_t start = 0;
+    size_t end = 0;
+    size_t scanPos = 0; // до этой позиции "\r\n\r\n" уже искали
+    size_t blockSize;
+};
+
+#endif // READ_BUFFER_HPP
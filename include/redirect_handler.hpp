@@ -1,3 +1,75 @@
-//
-// Created by denis on 20.12.24.
-//
+#ifndef REDIRECT_HANDLER_HPP
+#define REDIRECT_HANDLER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+// Редиректы, по которым прокси идёт сам: разбор Location и таблица постоянных
+// редиректов (301, 308), общая для всех воркеров. Запрос к URL из таблицы сразу
+// уходит по адресу назначения, без обращения к серверу за тем же редиректом.
+// Ключ - нормализованный URL, как у ResponseCache; вытеснение LRU в пределах шарда.
+class RedirectHandler {
+public:
+    struct Target {
+        std::string host;
+        int port = 80;
+        std::string path;
+    };
+
+    struct Stats {
+        std::atomic<uint64_t> followed{0}; // переходов по ответам серверов
+        std::atomic<uint64_t> hits{0};     // переходов по таблице, без запроса к серверу
+        std::atomic<uint64_t> stores{0};
+    };
+
+    static RedirectHandler &instance();
+    // Вызывается до запуска воркеров. maxEntries = 0 отключает таблицу
+    static void configure(size_t maxEntries);
+    static bool enabled() { return maxEntries > 0; }
+
+    // Статусы, по которым прокси идёт по Location сам
+    static bool followable(int status) {
+        return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+    }
+    static bool permanent(int status) { return status == 301 || status == 308; }
+    // Цель Location относительно URL, который её вернул; false - не http или не разбирается
+    static bool resolveLocation(std::string_view location, const Target &base, Target &target);
+
+    // Запоминает постоянный редирект; headers - заголовки ответа, от них зависит срок хранения
+    void remember(const std::string &key, const Target &target, const std::string &headers);
+    bool lookup(const std::string &key, Target &target);
+
+    Stats &stats() { return counters; }
+
+private:
+    struct Entry {
+        Target target;
+        std::chrono::steady_clock::time_point expires;
+    };
+    struct Shard {
+        std::mutex mtx;
+        // Начало списка - недавно использованные записи
+        std::list<std::pair<std::string, Entry>> lru;
+        std::unordered_map<std::string, decltype(lru)::iterator> index;
+    };
+    static constexpr size_t kShards = 16;
+    // Срок хранения редиректа, для которого сервер не указал свой
+    static constexpr std::chrono::hours kDefaultLifetime{1};
+
+    Shard &shardFor(const std::string &key);
+
+    Shard shards[kShards];
+    Stats counters;
+
+    static size_t maxEntries;
+};
+
+#endif // REDIRECT_HANDLER_HPP
@@ -0,0 +1,27 @@
+#ifndef REQUEST_ARENA_HPP
+#define REQUEST_ARENA_HPP
+
+#include <cstddef>
+#include <memory_resource>
+
+// Память одного запроса: выделения идут подряд из буфера внутри обработчика соединения,
+// освобождать по одному не нужно - reset() по окончании запроса возвращает буфер целиком.
+// Что не поместилось, берётся из кучи блоками и отдаётся при том же reset().
+class RequestArena {
+public:
+    static constexpr size_t kInlineSize = 4096;
+
+    RequestArena() : resource(inlineBuffer, sizeof(inlineBuffer), std::pmr::new_delete_resource()) {}
+    RequestArena(const RequestArena &) = delete;
+    RequestArena &operator=(const RequestArena &) = delete;
+
+    std::pmr::memory_resource *get() { return &resource; }
+    // Всё, что размещено в арене, к этому моменту должно быть уничтожено или отвязано от неё
+    void reset() { resource.release(); }
+
+private:
+    alignas(std::max_align_t) std::byte inlineBuffer[kInlineSize];
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+#endif // REQUEST_ARENA_HPP
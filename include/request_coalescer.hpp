@@ -0,0 +1,109 @@
+#ifndef REQUEST_COALESCER_HPP
+#define REQUEST_COALESCER_HPP
+
+#include "event_loop.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Подписка ведомого запроса на поток ответа лидера. active и notify
+// трогаются только из потока loop, pending - из любого, consumed и detached -
+// под мьютексом InflightResponse.
+struct InflightSubscription {
+    EventLoop *loop = nullptr;
+    std::function<void()> notify;
+    bool active = true;
+    std::atomic<bool> pending{false};
+    size_t consumed = 0;   // сегменты до этого номера ведомый уже отправил клиенту
+    bool detached = false; // отстал больше чем на kMaxBuffered и отцеплен от потока
+};
+
+// Ответ, который сейчас получает запрос-лидер. Ведомые запросы читают из него
+// те же байты по мере поступления: заголовки без hop-by-hop и тело без chunked-разметки.
+// Сегменты, прочитанные всеми ведомыми, освобождаются; после этого новые подписки не
+// принимаются. Ведомый, отставший больше чем на kMaxBuffered, отцепляется и видит failed.
+class InflightResponse {
+public:
+    // Сколько тела держим для ведомых сверх прочитанного самым медленным из них
+    static constexpr size_t kMaxBuffered = 4 * 1024 * 1024;
+
+    struct Snapshot {
+        bool headersReady = false;
+        bool shareable = false;
+        bool complete = false;
+        bool failed = false;
+        bool haveContentLength = false;
+        std::shared_ptr<const std::string> headers; // без завершающей пустой строки
+        std::vector<std::shared_ptr<const std::string>> segments; // начиная с запрошенного
+    };
+
+    // shareable = false: ответ нельзя отдавать другим клиентам, ведомые идут к серверу сами.
+    // haveContentLength: длина тела известна из заголовков (или тела нет вовсе)
+    void publishHeaders(std::string headerPart, bool shareable, bool haveContentLength);
+    void publishBody(const char *data, size_t len);
+    void complete();
+    void fail();
+
+    bool subscribe(const std::shared_ptr<InflightSubscription> &sub);
+    void unsubscribe(const std::shared_ptr<InflightSubscription> &sub);
+    bool hasSubscribers();
+    size_t bufferedBytes();
+    // Сегменты с номера fromSegment; всё до него ведомый sub уже отправил, и это можно освободить
+    Snapshot read(const std::shared_ptr<InflightSubscription> &sub, size_t fromSegment);
+
+private:
+    void notifyAll();
+    static void notify(const std::shared_ptr<InflightSubscription> &sub);
+    // Освобождает сегменты, прочитанные всеми ведомыми (под mtx)
+    void trim();
+    // Байты от сегмента index до конца потока (под mtx)
+    uint64_t bytesFrom(size_t index) const;
+
+    std::mutex mtx;
+    bool headersReady = false;
+    bool shareable = false;
+    bool completed = false;
+    bool failed = false;
+    bool haveContentLength = false;
+    std::shared_ptr<const std::string> headers;
+    std::deque<std::shared_ptr<const std::string>> segments;
+    std::deque<uint64_t> segmentOffsets; // смещение начала сегмента в теле
+    size_t dropped = 0;                  // номер первого сегмента в segments
+    uint64_t published = 0;              // байт тела опубликовано всего
+    size_t buffered = 0;                 // байт в segments
+    std::vector<std::shared_ptr<InflightSubscription>> subscribers;
+};
+
+// Схлопывание одновременных запросов одного URL: первый становится лидером
+// и идёт к серверу, остальные подписываются на его ответ.
+class RequestCoalescer {
+public:
+    static RequestCoalescer &instance();
+    // Вызывается до запуска воркеров
+    static void configure(bool enabled);
+    static bool enabled() { return enabledFlag; }
+
+    // Возвращает поток ответа; leader = true, если запрос должен сходить к серверу сам
+    std::shared_ptr<InflightResponse> join(const std::string &key,
+                                           const std::shared_ptr<InflightSubscription> &sub,
+                                           bool &leader);
+    // Лидер закончил (или передумал делиться ответом): новые запросы пойдут мимо него
+    void finish(const std::string &key, const std::shared_ptr<InflightResponse> &stream);
+
+    uint64_t collapsedCount() const { return collapsed.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mtx;
+    std::unordered_map<std::string, std::shared_ptr<InflightResponse>> inflight;
+    std::atomic<uint64_t> collapsed{0};
+
+    static bool enabledFlag;
+};
+
+#endif // REQUEST_COALESCER_HPP
@@ -0,0 +1,53 @@
+#ifndef REQUEST_PARSER_HPP
+#define REQUEST_PARSER_HPP
+
+#include "http_parser.hpp"
+#include "header_scan.hpp"
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+struct HeaderField {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Разобранный запрос: все строки указывают в буфер, из которого он разобран,
+// и действительны, пока буфер не изменился.
+struct RequestView {
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;
+    std::vector<HeaderField> headers;
+
+    // Поиск заголовка без учёта регистра имени, nullptr - заголовка нет
+    const HeaderField *find(std::string_view name) const;
+};
+
+// Инкрементальный разбор заголовков запроса без выделения памяти на каждый запрос.
+// Буфер можно дописывать между вызовами: разбор продолжается с той строки,
+// на которой остановился. Смещения хранятся относительно начала буфера,
+// поэтому буфер может переехать в памяти.
+class RequestParser {
+public:
+    enum class Result { Done, NeedMore, Error };
+
+    // eof = true: данных больше не будет, недописанная строка считается последней
+    Result parse(const char *data, size_t len, RequestView &req, bool eof = false);
+    // Длина разобранного запроса в буфере после Result::Done
+    size_t consumed() const { return pos; }
+    // Подготовка к следующему запросу; память под заголовки сохраняется
+    void reset();
+
+    // Копия запроса с именами заголовков в нижнем регистре
+    static void toRequest(const RequestView &view, HttpRequest &req);
+
+private:
+    Result finish(const char *data, RequestView &req);
+
+    size_t pos = 0;
+    // Полные строки заголовков, найденные на предыдущих вызовах; первая - стартовая
+    std::vector<HeaderScan::Line> lines;
+};
+
+#endif // REQUEST_PARSER_HPP
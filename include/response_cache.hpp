@@ -0,0 +1,100 @@
+#ifndef RESPONSE_CACHE_HPP
+#define RESPONSE_CACHE_HPP
+
+#include "http_parser.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Закешированный ответ. Заголовки и тело лежат в одном неизменяемом буфере
+// с подсчётом ссылок: отдача клиенту идёт прямо из него, без копирования.
+struct CachedResponse {
+    std::shared_ptr<const std::string> data; // заголовки без завершающей пустой строки + тело
+    size_t headerSize = 0;
+    std::chrono::steady_clock::time_point storedAt;
+    std::chrono::steady_clock::time_point expires;
+    std::string etag;
+    std::string lastModified;
+    // Заголовки запроса из Vary (имя в нижнем регистре) и их значения у сохранившего запроса
+    std::vector<std::pair<std::string, std::string>> vary;
+
+    bool fresh(std::chrono::steady_clock::time_point now) const { return now < expires; }
+    bool hasValidators() const { return !etag.empty() || !lastModified.empty(); }
+    // Совпадают ли заголовки запроса из Vary с сохранёнными
+    bool matches(const HttpRequest &req) const;
+    size_t bodySize() const { return data->size() - headerSize; }
+    const char *body() const { return data->data() + headerSize; }
+    size_t cost() const;
+};
+
+// Разделяемый между воркерами кеш ответов на GET. Ключ - нормализованный URL
+// (host:port/path), под ним до kMaxVariants вариантов с разными значениями заголовков
+// из Vary; вытеснение LRU в пределах бюджета байт своего шарда.
+class ResponseCache {
+public:
+    struct Stats {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> revalidated{0};
+        std::atomic<uint64_t> stores{0};
+        std::atomic<uint64_t> evictions{0};
+    };
+
+    static ResponseCache &instance();
+    // Вызывается до запуска воркеров. maxBytes = 0 отключает кеш.
+    static void configure(size_t maxBytes);
+    static bool enabled() { return maxBytes > 0; }
+    static size_t maxObjectSize() { return maxObjectBytes; }
+
+    static std::string makeKey(const std::string &host, int port, const std::string &path);
+    // Можно ли отвечать на запрос из кеша и сохранять ответ на него
+    static bool requestCacheable(const HttpRequest &req);
+    static bool requestForcesRevalidation(const HttpRequest &req);
+
+    // Срок свежести ответа по Cache-Control, Pragma и Expires; storable = false - хранить нельзя
+    static std::chrono::seconds freshnessLifetime(const std::string &headers, bool &storable);
+    // Готовит запись по заголовкам ответа (без тела); nullptr - ответ кешировать нельзя
+    static std::shared_ptr<CachedResponse> prepare(const std::string &headers, int status, const HttpRequest &req);
+    // Дописывает тело и кладёт запись в кеш
+    void store(const std::string &key, std::shared_ptr<CachedResponse> entry, std::string &&body);
+    // Ответ 304 на условный запрос: продлевает срок жизни, тело остаётся прежним
+    std::shared_ptr<const CachedResponse> refresh(const std::string &key,
+                                                  const std::shared_ptr<const CachedResponse> &old,
+                                                  const std::string &headers);
+
+    // Запись (свежая или устаревшая) того варианта, у которого совпадают заголовки из Vary
+    std::shared_ptr<const CachedResponse> lookup(const std::string &key, const HttpRequest &req);
+
+    Stats &stats() { return counters; }
+
+private:
+    struct Shard {
+        std::mutex mtx;
+        // Начало списка - недавно использованные записи
+        std::list<std::pair<std::string, std::shared_ptr<const CachedResponse>>> lru;
+        // Варианты одного URL, недавно использованный - первым
+        std::unordered_map<std::string, std::vector<decltype(lru)::iterator>> index;
+        size_t bytes = 0;
+    };
+    static constexpr size_t kShards = 16;
+    static constexpr size_t kMaxVariants = 4;
+
+    Shard &shardFor(const std::string &key);
+    void insert(const std::string &key, std::shared_ptr<const CachedResponse> entry);
+
+    Shard shards[kShards];
+    Stats counters;
+
+    static size_t maxBytes;
+    static size_t maxObjectBytes;
+};
+
+#endif // RESPONSE_CACHE_HPP
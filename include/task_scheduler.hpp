@@ -0,0 +1,101 @@
+#ifndef TASK_SCHEDULER_HPP
+#define TASK_SCHEDULER_HPP
+
+#include "work_stealing_deque.hpp"
+#include "mpmc_queue.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Планировщик задач с кражей работы. У каждого воркера свой ограниченный дек
+// Chase-Lev: задачи, поставленные из потока воркера, ложатся в его дек без
+// блокировок, из других потоков - в общую очередь без блокировок. Воркер без
+// своих задач берёт из общей очереди, затем крадёт у соседей; не найдя работы,
+// недолго крутится и засыпает. Как спать и как будить, решает владелец потока:
+// ThreadPool засыпает в epoll_wait и будит через eventfd, runWorker() - на condvar.
+class TaskScheduler {
+public:
+    using Task = std::function<void()>;
+
+    struct Stats {
+        uint64_t executed = 0;
+        uint64_t stolen = 0;
+        uint64_t injected = 0; // поставлено из потоков вне планировщика
+        uint64_t wakeups = 0;
+    };
+
+    explicit TaskScheduler(size_t workers);
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Потокобезопасно
+    void submit(Task task);
+
+    // Текущий поток становится воркером index
+    void bindCurrentThread(size_t index);
+    // Как разбудить заснувшего воркера; по умолчанию - condvar для runWorker()
+    void setWaker(size_t index, std::function<void()> wake);
+
+    // Выполняет до budget задач: свои, из общей очереди, украденные. Возвращает число выполненных
+    size_t runPending(size_t index, size_t budget);
+    // Воркер собирается заснуть; false - работа уже появилась, спать нельзя
+    bool prepareToPark(size_t index);
+    // Воркер проснулся (по задаче или по своим причинам)
+    void unparked(size_t index);
+
+    // Цикл воркера без EventLoop: задачи, ожидание с прокруткой, сон до submit() или stop
+    void runWorker(size_t index, const std::atomic<bool> &stop);
+    // Будит всех спящих воркеров, например чтобы они увидели флаг остановки
+    void wakeAll();
+
+    Stats stats() const;
+    // Задачи, ждущие выполнения во всех очередях; приблизительно, для метрик
+    size_t queuedCount() const;
+
+private:
+    static constexpr size_t kDequeCapacity = 1024;
+    static constexpr size_t kInjectCapacity = 4096;
+
+    struct alignas(64) Worker {
+        WorkStealingDeque<Task*, kDequeCapacity> deque;
+        alignas(64) std::atomic<bool> parked{false};
+        std::function<void()> wake;
+        // Сон runWorker()
+        std::mutex parkMtx;
+        std::condition_variable parkCv;
+        bool notified = false;
+        // Счётчики пишет только сам воркер
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        uint64_t stealSeed;
+    };
+
+    Task *take(size_t index, bool &stolen);
+    bool hasWork(size_t index) const;
+    void wakeOne();
+    bool unpark(size_t index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    MpmcQueue<Task*, kInjectCapacity> injected;
+    // Запасной путь, если общая очередь переполнена
+    std::mutex overflowMtx;
+    std::deque<Task*> overflow;
+    std::atomic<size_t> overflowSize{0};
+
+    std::atomic<size_t> nextWake{0};
+    // Воркеры runWorker(), которые сейчас крутятся в поисках работы
+    std::atomic<int> spinning{0};
+    std::atomic<uint64_t> injectedCount{0};
+    std::atomic<uint64_t> wakeupCount{0};
+};
+
+#endif // TASK_SCHEDULER_HPP
@@ -1,28 +1,54 @@
 #ifndef THREAD_POOL_HPP
 #define THREAD_POOL_HPP
 
+#include "event_loop.hpp"
+#include "task_scheduler.hpp"
+#include "admission_control.hpp"
+#include <functional>
 #include <vector>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
+#include <memory>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 
+// Пул потоков-воркеров: каждый поток крутит собственный EventLoop.
+// Между пачками событий циклы выполняют задачи общего TaskScheduler:
+// принятое соединение ждёт в очереди AdmissionControl и достаётся циклу,
+// который первым освободился.
 class ThreadPool {
 public:
-    ThreadPool() = default;
+    ThreadPool();
     ~ThreadPool();
-    bool init(int numThreads);
+    // pinCpus - закрепить i-й воркер за i-м ядром (по модулю числа ядер)
+    bool init(int numThreads, bool pinCpus = false);
     void submitTask(int clientFd);
+    // Произвольная задача; выполняется в потоке одного из циклов, EventLoop::current() - его цикл
+    void submit(std::function<void()> task);
+    TaskScheduler::Stats taskStats() const;
+    // Принятые соединения и другие задачи, которые ещё не взял ни один цикл
+    size_t queuedTasks() const;
+    // Режим шардирования accept: у каждого воркера свой SO_REUSEPORT-сокет,
+    // принятые соединения обслуживаются тем же циклом без общей очереди.
+    bool startListeners(int port);
+    std::vector<uint64_t> listenerAcceptCounts() const;
     void shutdown();
 
 private:
-    void workerFunc();
+    class ShardAcceptor;
+    class WorkerTasks;
+
+    void workerFunc(size_t index);
+    // Задача цикла: взять из очереди допуска следующее соединение, если для него есть место
+    static void serveQueued();
+    static void startConnection(EventLoop &loop, int clientFd, std::chrono::steady_clock::time_point acceptedAt,
+                                AdmissionControl::Ticket ticket);
+
+    std::vector<std::unique_ptr<EventLoop>> loops;
     std::vector<std::thread> workers;
-    std::queue<int> tasks;
-    std::mutex mtx;
-    std::condition_variable cv;
-    std::atomic<bool> stop{false};
+    std::vector<std::unique_ptr<ShardAcceptor>> acceptors;
+    std::unique_ptr<TaskScheduler> scheduler;
+    std::vector<std::unique_ptr<WorkerTasks>> workerTasks;
 };
 
 #endif // THREAD_POOL_HPP
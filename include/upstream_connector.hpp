@@ -0,0 +1,58 @@
+#ifndef UPSTREAM_CONNECTOR_HPP
+#define UPSTREAM_CONNECTOR_HPP
+
+#include "event_loop.hpp"
+#include "dns_resolver.hpp"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Неблокирующее подключение к серверу по всем его адресам (Happy Eyeballs, RFC 8305):
+// адреса IPv6 и IPv4 чередуются, следующая попытка стартует, если предыдущая
+// не ответила за kAttemptDelay или сразу после её ошибки. Побеждает первое
+// установленное соединение, остальные закрываются.
+// Сокеты попыток регистрируются в цикле за обработчиком-владельцем: он передаёт
+// их события в onEvent() и забирает результат через poll().
+class UpstreamConnector {
+public:
+    enum class Status { Pending, Connected, Failed };
+
+    // wake вызывается из таймера цикла, когда попытки кончились без события на сокете
+    UpstreamConnector(EventLoop &loop, EventHandler *owner, std::function<void()> wake);
+    ~UpstreamConnector();
+    UpstreamConnector(const UpstreamConnector &) = delete;
+    UpstreamConnector &operator=(const UpstreamConnector &) = delete;
+
+    // false - ни одну попытку начать не удалось
+    bool start(const DnsResult &result, int port);
+    // Событие epoll; false - fd не принадлежит ни одной попытке
+    bool onEvent(int fd);
+    // Connected: fd - сокет победителя, он остаётся зарегистрированным в цикле
+    Status poll(int &fd);
+    // Закрывает незавершённые попытки
+    void reset();
+
+    // Сколько адресов было опробовано в последнем подключении
+    size_t attemptsMade() const { return next; }
+
+private:
+    struct Attempt {
+        int fd;
+        bool ready;
+    };
+
+    bool launchNext();
+    void armDelay();
+    void cancelDelay();
+    void closeAttempt(size_t index);
+
+    EventLoop &loop;
+    EventHandler *owner;
+    std::function<void()> wake;
+    std::vector<ResolvedAddress> candidates;
+    size_t next = 0;
+    std::vector<Attempt> attempts;
+    uint64_t delayTimer = 0;
+};
+
+#endif // UPSTREAM_CONNECTOR_HPP
@@ -0,0 +1,49 @@
+#ifndef UPSTREAM_POOL_HPP
+#define UPSTREAM_POOL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+// Пул простаивающих keep-alive соединений с серверами, ключ - host:port.
+// Экземпляр свой у каждого потока-воркера (local()), поэтому блокировок нет.
+class UpstreamPool {
+public:
+    UpstreamPool() = default;
+    ~UpstreamPool();
+    UpstreamPool(const UpstreamPool &) = delete;
+    UpstreamPool &operator=(const UpstreamPool &) = delete;
+
+    static UpstreamPool &local();
+    // Вызывается до запуска воркеров. maxIdlePerHost = 0 отключает пул.
+    static void configure(size_t maxIdlePerHost, int idleTimeoutSec);
+    static bool enabled() { return maxIdlePerHost > 0; }
+
+    // Возвращает живое соединение из пула или -1
+    int acquire(const std::string &host, int port);
+    // Отдаёт соединение в пул (или закрывает, если для хоста уже достаточно простаивающих)
+    void release(const std::string &host, int port, int fd);
+
+private:
+    struct IdleConnection {
+        int fd;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    static std::string key(const std::string &host, int port);
+    static bool isAlive(int fd);
+    void pruneExpired(std::chrono::steady_clock::time_point now);
+    // Учёт простаивающих соединений для метрик
+    void countIdle(long delta);
+
+    std::unordered_map<std::string, std::deque<IdleConnection>> idle;
+    std::chrono::steady_clock::time_point lastPrune = std::chrono::steady_clock::now();
+    size_t idleCount = 0;
+
+    static size_t maxIdlePerHost;
+    static std::chrono::seconds idleTimeout;
+};
+
+#endif // UPSTREAM_POOL_HPP
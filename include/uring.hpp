@@ -0,0 +1,69 @@
+#ifndef URING_HPP
+#define URING_HPP
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+// Кольца io_uring одного потока поверх системных вызовов, без liburing.
+// Заявки копятся в очереди отправки и уходят в ядро одним io_uring_enter()
+// вместе с ожиданием завершений.
+class Uring {
+public:
+    Uring() = default;
+    ~Uring();
+    Uring(const Uring &) = delete;
+    Uring &operator=(const Uring &) = delete;
+
+    // Есть ли в ядре всё, что нужно циклу событий: ожидание с таймаутом,
+    // многоразовый poll (проверяется на eventfd), отмена и отправка заявок
+    static bool supported();
+
+    bool init(unsigned entries);
+    // Свободная заявка, заполненная нулями; если очередь полна, накопленное отправляется сразу.
+    // nullptr - ядро не приняло заявки и места нет
+    io_uring_sqe *sqe();
+    // Отправляет накопленные заявки и ждёт хотя бы одного завершения не дольше timeoutMs
+    // (-1 - без ограничения, 0 - не ждать). false - ошибка io_uring_enter
+    bool submitAndWait(int timeoutMs);
+
+    // Разбирает готовые завершения; f может добавлять новые заявки
+    template <typename F>
+    unsigned forEachCompletion(F &&f) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        while (head != tail) {
+            io_uring_cqe cqe = cqes[head & cqMask];
+            // Освобождаем место до вызова f: обработчик может породить новые завершения
+            head++;
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            f(cqe);
+            count++;
+        }
+        return count;
+    }
+
+private:
+    bool enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize);
+
+    int ringFd = -1;
+    void *ringMem = nullptr;
+    size_t ringSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned *sqHead = nullptr;
+    unsigned *sqTail = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned sqEntries = 0;
+    unsigned sqeTail = 0; // заявки до этой позиции заполнены, ядру видны после submitAndWait()
+
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe *cqes = nullptr;
+};
+
+#endif // URING_HPP
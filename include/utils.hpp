@@ -2,11 +2,27 @@
 #define UTILS_HPP
 
 #include <string>
+#include <string_view>
+#include <ctime>
+#include <initializer_list>
 
 namespace Utils {
     std::string trim(const std::string &s);
 
-    bool parseUrl(const std::string &url, std::string &scheme, std::string &host, int &port, std::string &path);
+    bool parseUrl(std::string_view url, std::string &scheme, std::string &host, int &port, std::string &path);
+
+    // Hop-by-hop заголовки относятся к одному соединению и не пересылаются дальше; имя без учёта регистра
+    bool isHopByHopHeader(std::string_view name);
+
+    // Копирует блок заголовков ответа без hop-by-hop заголовков и без перечисленных
+    // в drop (имена в нижнем регистре). Завершающая пустая строка не добавляется.
+    std::string stripHeaders(const std::string &headers, std::initializer_list<const char*> drop);
+
+    // Ищет заголовок в блоке заголовков ответа (имя без учёта регистра), значение без пробелов по краям
+    bool findHeader(const std::string &headers, const std::string &name, std::string &value);
+
+    // Разбирает дату в формате RFC 7231 (IMF-fixdate), например "Sun, 06 Nov 1994 08:49:37 GMT"
+    bool parseHttpDate(const std::string &s, std::time_t &out);
 }
 
 #endif // UTILS_HPP
@@ -0,0 +1,78 @@
+#ifndef WORK_STEALING_DEQUE_HPP
+#define WORK_STEALING_DEQUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// Ограниченный дек Chase-Lev (вариант с моделью памяти C11, Lê и др., 2013).
+// push() и pop() вызывает только поток-владелец и работает с нижним концом,
+// steal() - любые потоки, забирают с верхнего. T - тривиально копируемый тип
+// (указатель на задачу): элемент читается до того, как кража подтверждена.
+template <typename T, size_t Capacity>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // false - дек заполнен
+    bool push(T value) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= (int64_t)Capacity) return false;
+        slots[b & kMask].store(value, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool pop(T &value) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = slots[b & kMask].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Последний элемент: соревнуемся с ворами за верхний индекс
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(T &value) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return false;
+        value = slots[t & kMask].load(std::memory_order_relaxed);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    // Приблизительно: для решения, стоит ли засыпать или красть
+    bool empty() const {
+        return bottom.load(std::memory_order_acquire) <= top.load(std::memory_order_acquire);
+    }
+
+    // Приблизительно, для наблюдения за очередью
+    size_t size() const {
+        int64_t b = bottom.load(std::memory_order_acquire);
+        int64_t t = top.load(std::memory_order_acquire);
+        return b > t ? (size_t)(b - t) : 0;
+    }
+
+private:
+    static constexpr int64_t kMask = (int64_t)Capacity - 1;
+
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::atomic<T> slots[Capacity];
+};
+
+#endif // WORK_STEALING_DEQUE_HPP
@@ -0,0 +1,168 @@
+#include "access_log.hpp"
+#include "logger.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+bool AccessLog::enabledFlag = false;
+std::string AccessLog::path;
+
+namespace {
+    constexpr size_t kRingRecords = 4096; // на поток, степень двойки
+    constexpr auto kFlushInterval = std::chrono::milliseconds(10);
+
+    bool writeAll(int fd, const void *data, size_t len) {
+        const char *p = static_cast<const char*>(data);
+        while (len > 0) {
+            ssize_t n = ::write(fd, p, len);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            p += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+}
+
+// Пишет поток-владелец, читает фоновый поток
+struct AccessRing {
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    alignas(64) std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> orphaned{false}; // поток-владелец завершился
+    AccessRecord records[kRingRecords];
+};
+
+namespace {
+    // Кольцо текущего потока; при выходе потока оставшиеся записи допишет фоновый поток
+    struct ThreadRing {
+        std::shared_ptr<AccessRing> ring;
+        ~ThreadRing() {
+            if (ring) ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+    thread_local ThreadRing threadRing;
+}
+
+AccessLog &AccessLog::instance() {
+    static AccessLog log;
+    return log;
+}
+
+void AccessLog::configure(const std::string &logPath) {
+    path = logPath;
+    enabledFlag = !logPath.empty();
+}
+
+bool AccessLog::start() {
+    if (!enabledFlag) return true;
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("AccessLog: cannot open " + path + ": " + strerror(errno));
+        return false;
+    }
+    struct stat st;
+    AccessLogHeader header;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) {
+        if (!writeAll(fd, &header, sizeof(header))) {
+            LOG_ERROR("AccessLog: cannot write header to " + path);
+            return false;
+        }
+    } else {
+        // Дописываем только в журнал того же формата
+        AccessLogHeader existing;
+        int rfd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        bool ok = rfd >= 0 && read(rfd, &existing, sizeof(existing)) == (ssize_t)sizeof(existing) &&
+                  std::memcmp(&existing, &header, sizeof(header)) == 0 &&
+                  (st.st_size - (off_t)sizeof(header)) % (off_t)sizeof(AccessRecord) == 0;
+        if (rfd >= 0) close(rfd);
+        if (!ok) {
+            LOG_ERROR("AccessLog: " + path + " is not an access log of this version");
+            return false;
+        }
+    }
+    batch.reserve(kRingRecords);
+    writer = std::thread(&AccessLog::writerFunc, this);
+    LOG_INFO("AccessLog: writing to " + path);
+    return true;
+}
+
+void AccessLog::shutdown() {
+    if (!writer.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(wakeMtx);
+        stopping = true;
+    }
+    wakeCv.notify_one();
+    writer.join();
+    close(fd);
+    fd = -1;
+}
+
+std::shared_ptr<AccessRing> AccessLog::registerRing() {
+    auto ring = std::make_shared<AccessRing>();
+    std::lock_guard<std::mutex> lock(ringsMtx);
+    rings.push_back(ring);
+    return ring;
+}
+
+void AccessLog::record(const AccessRecord &rec) {
+    if (fd < 0) return;
+    if (!threadRing.ring) threadRing.ring = registerRing();
+    AccessRing *ring = threadRing.ring.get();
+    uint64_t h = ring->head.load(std::memory_order_relaxed);
+    if (h - ring->tail.load(std::memory_order_acquire) >= kRingRecords) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    ring->records[h & (kRingRecords - 1)] = rec;
+    ring->head.store(h + 1, std::memory_order_release);
+}
+
+uint64_t AccessLog::droppedCount() {
+    std::lock_guard<std::mutex> lock(ringsMtx);
+    uint64_t sum = droppedOrphaned;
+    for (auto &ring : rings) sum += ring->dropped.load(std::memory_order_relaxed);
+    return sum;
+}
+
+void AccessLog::writerFunc() {
+    std::unique_lock<std::mutex> lock(wakeMtx);
+    while (!stopping) {
+        wakeCv.wait_for(lock, kFlushInterval);
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+    lock.unlock();
+    drain();
+}
+
+void AccessLog::drain() {
+    std::lock_guard<std::mutex> lock(ringsMtx);
+    batch.clear();
+    for (auto it = rings.begin(); it != rings.end();) {
+        AccessRing &ring = **it;
+        bool orphaned = ring.orphaned.load(std::memory_order_acquire);
+        uint64_t t = ring.tail.load(std::memory_order_relaxed);
+        uint64_t h = ring.head.load(std::memory_order_acquire);
+        for (; t < h; t++) batch.push_back(ring.records[t & (kRingRecords - 1)]);
+        ring.tail.store(t, std::memory_order_release);
+        if (orphaned) {
+            droppedOrphaned += ring.dropped.load(std::memory_order_relaxed);
+            it = rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (batch.empty()) return;
+    // Одна пачка - один write(): записи не перемежаются с чужими даже при O_APPEND из нескольких процессов
+    if (!writeAll(fd, batch.data(), batch.size() * sizeof(AccessRecord))) {
+        LOG_ERROR("AccessLog: write to " + path + " failed: " + strerror(errno));
+        return;
+    }
+    written.fetch_add(batch.size(), std::memory_order_relaxed);
+}
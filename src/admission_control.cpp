@@ -0,0 +1,231 @@
+#include "admission_control.hpp"
+#include "logger.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+AdmissionControl::Limits AdmissionControl::limits;
+
+AdmissionControl::Ticket::Ticket(Ticket &&other) noexcept
+        : client(std::move(other.client)), serving(std::exchange(other.serving, false)) {
+    other.client.clear();
+}
+
+AdmissionControl::Ticket &AdmissionControl::Ticket::operator=(Ticket &&other) noexcept {
+    if (this != &other) {
+        release();
+        client = std::move(other.client);
+        other.client.clear();
+        serving = std::exchange(other.serving, false);
+    }
+    return *this;
+}
+
+AdmissionControl::Ticket::~Ticket() {
+    release();
+}
+
+void AdmissionControl::Ticket::release() {
+    if (serving) {
+        serving = false;
+        AdmissionControl::instance().releaseServing();
+    }
+    if (!client.empty()) {
+        AdmissionControl::instance().releaseClient(client);
+        client.clear();
+    }
+}
+
+AdmissionControl &AdmissionControl::instance() {
+    static AdmissionControl control;
+    return control;
+}
+
+void AdmissionControl::configure(const Limits &newLimits) {
+    limits = newLimits;
+}
+
+void AdmissionControl::setWakeup(std::function<void()> newWakeup) {
+    std::lock_guard<std::mutex> lock(queueMtx);
+    wakeup = std::move(newWakeup);
+}
+
+bool AdmissionControl::enqueue(int fd) {
+    Ticket ticket;
+    if (!acquireClient(fd, ticket)) {
+        reject(fd, Reason::ClientLimit);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        if (limits.maxQueued == 0 || waiting.size() < limits.maxQueued) {
+            waiting.push_back({fd, std::chrono::steady_clock::now(), std::move(ticket)});
+            waitingCount.store(waiting.size());
+            return true;
+        }
+    }
+    reject(fd, Reason::QueueFull);
+    return false;
+}
+
+int AdmissionControl::take(Ticket &ticket, std::chrono::steady_clock::time_point &acceptedAt) {
+    std::vector<Waiting> expired;
+    int fd = -1;
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        if (limits.queueTimeout.count() > 0) {
+            // В начале очереди самые старые соединения
+            auto deadline = std::chrono::steady_clock::now() - limits.queueTimeout;
+            while (!waiting.empty() && waiting.front().acceptedAt < deadline) {
+                expired.push_back(std::move(waiting.front()));
+                waiting.pop_front();
+            }
+        }
+        if (!waiting.empty() && acquireServing()) {
+            size_t overloadDepth = limits.maxQueued > 0 ? limits.maxQueued / 2 : kOverloadDepth;
+            // Под перегрузкой старые соединения всё равно, скорее всего, не дождутся ответа:
+            // новые обслуживаются, пока их клиенты ещё ждут
+            bool newest = limits.lifoUnderOverload && waiting.size() > overloadDepth;
+            Waiting &next = newest ? waiting.back() : waiting.front();
+            fd = next.fd;
+            acceptedAt = next.acceptedAt;
+            ticket = std::move(next.ticket);
+            ticket.serving = true;
+            if (newest) {
+                waiting.pop_back();
+            } else {
+                waiting.pop_front();
+            }
+        }
+        waitingCount.store(waiting.size());
+    }
+    for (Waiting &entry : expired) {
+        reject(entry.fd, Reason::Expired);
+    }
+    return fd;
+}
+
+bool AdmissionControl::admit(int fd, Ticket &ticket) {
+    if (!acquireClient(fd, ticket)) {
+        reject(fd, Reason::ClientLimit);
+        return false;
+    }
+    if (!acquireServing()) {
+        ticket = Ticket();
+        reject(fd, Reason::ConnectionLimit);
+        return false;
+    }
+    ticket.serving = true;
+    return true;
+}
+
+void AdmissionControl::expire() {
+    if (limits.queueTimeout.count() <= 0 || waitingCount.load(std::memory_order_relaxed) == 0) return;
+    std::vector<Waiting> expired;
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        auto deadline = std::chrono::steady_clock::now() - limits.queueTimeout;
+        while (!waiting.empty() && waiting.front().acceptedAt < deadline) {
+            expired.push_back(std::move(waiting.front()));
+            waiting.pop_front();
+        }
+        waitingCount.store(waiting.size());
+    }
+    for (Waiting &entry : expired) {
+        reject(entry.fd, Reason::Expired);
+    }
+}
+
+void AdmissionControl::clear() {
+    std::deque<Waiting> left;
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        left.swap(waiting);
+        waitingCount.store(0, std::memory_order_relaxed);
+    }
+    for (Waiting &entry : left) {
+        close(entry.fd);
+    }
+}
+
+size_t AdmissionControl::queued() {
+    return waitingCount.load(std::memory_order_relaxed);
+}
+
+bool AdmissionControl::acquireClient(int fd, Ticket &ticket) {
+    if (limits.maxPerClient == 0) return true;
+    sockaddr_storage addr{};
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, (sockaddr *)&addr, &len) < 0) return true;
+    // Ключ - байты адреса без порта: все соединения одного хоста считаются вместе
+    std::string client;
+    if (addr.ss_family == AF_INET) {
+        auto *in = (sockaddr_in *)&addr;
+        client.assign((const char *)&in->sin_addr, sizeof(in->sin_addr));
+    } else if (addr.ss_family == AF_INET6) {
+        auto *in6 = (sockaddr_in6 *)&addr;
+        client.assign((const char *)&in6->sin6_addr, sizeof(in6->sin6_addr));
+    } else {
+        return true;
+    }
+
+    ClientShard &shard = clients[std::hash<std::string>()(client) % kClientShards];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    size_t &count = shard.connections[client];
+    if (count >= limits.maxPerClient) return false;
+    count++;
+    ticket.client = std::move(client);
+    return true;
+}
+
+void AdmissionControl::releaseClient(const std::string &client) {
+    ClientShard &shard = clients[std::hash<std::string>()(client) % kClientShards];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.connections.find(client);
+    if (it == shard.connections.end()) return;
+    // Клиентов без соединений в таблице не держим
+    if (--it->second == 0) shard.connections.erase(it);
+}
+
+bool AdmissionControl::acquireServing() {
+    size_t current = servingCount.load();
+    do {
+        if (limits.maxConnections > 0 && current >= limits.maxConnections) return false;
+    } while (!servingCount.compare_exchange_weak(current, current + 1));
+    return true;
+}
+
+void AdmissionControl::releaseServing() {
+    servingCount.fetch_sub(1);
+    // Освободилось место: ждущее соединение может забрать любой цикл.
+    // take() не удаляет соединение из очереди, пока не получил место, поэтому
+    // пробуждение не теряется
+    if (limits.maxConnections == 0 || waitingCount.load() == 0) return;
+    std::lock_guard<std::mutex> lock(queueMtx);
+    if (!waiting.empty() && wakeup) wakeup();
+}
+
+void AdmissionControl::reject(int fd, Reason reason) {
+    rejected[(size_t)reason].fetch_add(1, std::memory_order_relaxed);
+    static const char kResponse[] =
+            "HTTP/1.0 503 Service Unavailable\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Length: 20\r\n"
+            "Connection: close\r\n"
+            "Retry-After: 1\r\n"
+            "\r\n"
+            "Server overloaded.\r\n";
+    // Сокет неблокирующий, а ответ умещается в буфер отправки: не ждём ни клиента, ни запроса
+    ssize_t sent = send(fd, kResponse, sizeof(kResponse) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    (void)sent;
+    // Непрочитанный запрос при close() превратился бы в RST, и клиент мог не увидеть ответ
+    shutdown(fd, SHUT_WR);
+    char drain[4096];
+    while (recv(fd, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+    }
+    close(fd);
+    LOG_DEBUG("AdmissionControl: rejected fd=" + std::to_string(fd));
+}
@@ -0,0 +1,46 @@
+#include "alloc_stats.hpp"
+
+#ifdef ALLOC_STATS
+#include <cstdlib>
+#include <new>
+
+namespace {
+    // Без динамической инициализации: operator new вызывается и до main, и при завершении потоков
+    thread_local uint64_t allocations = 0;
+
+    void *allocate(size_t size) {
+        allocations++;
+        if (void *p = std::malloc(size ? size : 1)) return p;
+        throw std::bad_alloc();
+    }
+
+    void *allocateAligned(size_t size, std::align_val_t align) {
+        allocations++;
+        size_t alignment = (size_t)align;
+        size = (size + alignment - 1) / alignment * alignment;
+        if (void *p = std::aligned_alloc(alignment, size ? size : alignment)) return p;
+        throw std::bad_alloc();
+    }
+}
+
+void *operator new(size_t size) { return allocate(size); }
+void *operator new[](size_t size) { return allocate(size); }
+void *operator new(size_t size, std::align_val_t align) { return allocateAligned(size, align); }
+void *operator new[](size_t size, std::align_val_t align) { return allocateAligned(size, align); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+
+uint64_t AllocStats::threadCount() {
+    return allocations;
+}
+#else
+uint64_t AllocStats::threadCount() {
+    return 0;
+}
+#endif
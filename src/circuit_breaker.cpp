@@ -0,0 +1,116 @@
+#include "circuit_breaker.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <functional>
+#include <tuple>
+
+int CircuitBreaker::failureThreshold = 5;
+std::chrono::seconds CircuitBreaker::cooldown{10};
+
+CircuitBreaker &CircuitBreaker::instance() {
+    static CircuitBreaker breaker;
+    return breaker;
+}
+
+void CircuitBreaker::configure(int threshold, int cooldownSec) {
+    failureThreshold = threshold;
+    cooldown = std::chrono::seconds(cooldownSec);
+}
+
+std::string CircuitBreaker::makeKey(const std::string &host, int port) {
+    std::string key = host;
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+    return key + ":" + std::to_string(port);
+}
+
+CircuitBreaker::Shard &CircuitBreaker::shardFor(const std::string &key) {
+    return shards[std::hash<std::string>()(key) % kShards];
+}
+
+bool CircuitBreaker::allow(const std::string &key) {
+    if (!enabled()) return true;
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end() || it->second.state == State::Closed) return true;
+
+    Entry &entry = it->second;
+    auto now = std::chrono::steady_clock::now();
+    if (stale(entry, now)) {
+        // Сервер давно не спрашивали: прежние неудачи ничего о нём не говорят
+        shard.entries.erase(it);
+        tracked.fetch_sub(1, std::memory_order_relaxed);
+        evicted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (now < entry.until) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Срок истёк: пропускаем один пробный запрос (или новый, если прежний пропал без ответа)
+    entry.state = State::HalfOpen;
+    entry.until = now + cooldown;
+    return true;
+}
+
+void CircuitBreaker::success(const std::string &key) {
+    if (!enabled() || tracked.load(std::memory_order_relaxed) == 0) return;
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) return;
+    if (it->second.state != State::Closed) {
+        LOG_INFO("CircuitBreaker: " + key + " is available again");
+    }
+    // Здоровые серверы в таблице не держим
+    shard.entries.erase(it);
+    tracked.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void CircuitBreaker::failure(const std::string &key) {
+    if (!enabled()) return;
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto now = std::chrono::steady_clock::now();
+    if (shard.entries.size() >= kMaxShardEntries && !shard.entries.count(key)) evict(shard, now);
+    auto inserted = shard.entries.emplace(key, Entry());
+    if (inserted.second) tracked.fetch_add(1, std::memory_order_relaxed);
+    Entry &entry = inserted.first->second;
+    entry.failures++;
+    entry.lastFailure = now;
+    if (entry.state == State::HalfOpen || (entry.state == State::Closed && entry.failures >= failureThreshold)) {
+        LOG_ERROR("CircuitBreaker: " + key + " failed " + std::to_string(entry.failures) +
+                      " times in a row, rejecting requests for " + std::to_string(cooldown.count()) + "s");
+        entry.state = State::Open;
+        entry.until = now + cooldown;
+        tripped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool CircuitBreaker::stale(const Entry &entry, std::chrono::steady_clock::time_point now) const {
+    return entry.state != State::Closed && now >= entry.until + kStaleCooldowns * cooldown;
+}
+
+void CircuitBreaker::evict(Shard &shard, std::chrono::steady_clock::time_point now) {
+    size_t before = shard.entries.size();
+    std::erase_if(shard.entries, [this, now](const auto &item) { return stale(item.second, now); });
+    // Места всё ещё нет: первыми уходят закрытые записи (серия неудач не дошла до порога),
+    // затем давнее всех отказавшие серверы - восьмая часть шарда за раз
+    size_t target = kMaxShardEntries - kMaxShardEntries / 8;
+    if (shard.entries.size() > target) {
+        std::vector<std::tuple<bool, std::chrono::steady_clock::time_point, const std::string *>> order;
+        order.reserve(shard.entries.size());
+        for (const auto &item : shard.entries) {
+            order.emplace_back(item.second.state != State::Closed, item.second.lastFailure, &item.first);
+        }
+        size_t drop = shard.entries.size() - target;
+        std::nth_element(order.begin(), order.begin() + drop, order.end());
+        std::vector<std::string> victims;
+        victims.reserve(drop);
+        for (size_t i = 0; i < drop; i++) victims.push_back(*std::get<2>(order[i]));
+        for (const std::string &key : victims) shard.entries.erase(key);
+    }
+    size_t removed = before - shard.entries.size();
+    tracked.fetch_sub(removed, std::memory_order_relaxed);
+    evicted.fetch_add(removed, std::memory_order_relaxed);
+}
@@ -0,0 +1,281 @@
+#include "compressor.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <string.h>
+#include <strings.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+CompressorPool::Policy CompressorPool::policy;
+CompressorPool::Stats CompressorPool::counters;
+
+namespace {
+    // Уровни для сжатия на лету: почти весь выигрыш в размере за малую долю времени старших уровней
+    constexpr int kGzipLevel = 5;
+    constexpr int kBrotliQuality = 4;
+    constexpr int kBrotliWindow = 20;
+    // Шаг, на который растёт выходная строка, пока библиотеке есть что отдать
+    constexpr size_t kOutputStep = 16 * 1024;
+
+    std::string_view trimView(std::string_view s) {
+        while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+        while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+        return s;
+    }
+
+#ifdef HAVE_ZLIB
+    class GzipCompressor : public Compressor {
+    public:
+        GzipCompressor() : Compressor(Encoding::Gzip) {
+            // 16 + 15: окно 32 КБ и обёртка gzip вместо zlib
+            ok = deflateInit2(&stream, kGzipLevel, Z_DEFLATED, 16 + 15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+        ~GzipCompressor() override {
+            if (ok) deflateEnd(&stream);
+        }
+
+        bool write(const char *data, size_t len, bool flush, std::string &out) override {
+            return run(data, len, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH, out);
+        }
+        bool finish(std::string &out) override { return run(nullptr, 0, Z_FINISH, out); }
+        bool reset() override { return ok && deflateReset(&stream) == Z_OK; }
+
+    private:
+        bool run(const char *data, size_t len, int mode, std::string &out) {
+            if (!ok) return false;
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            stream.avail_in = (uInt)len;
+            while (true) {
+                size_t used = out.size();
+                out.resize(used + kOutputStep);
+                stream.next_out = reinterpret_cast<Bytef *>(&out[used]);
+                stream.avail_out = (uInt)kOutputStep;
+                int rc = deflate(&stream, mode);
+                out.resize(out.size() - stream.avail_out);
+                if (rc == Z_STREAM_ERROR) return false;
+                if (mode == Z_FINISH ? rc == Z_STREAM_END : stream.avail_out != 0 && stream.avail_in == 0) {
+                    return true;
+                }
+            }
+        }
+
+        z_stream stream{};
+        bool ok = false;
+    };
+#endif
+
+#ifdef HAVE_BROTLI
+    class BrotliCompressor : public Compressor {
+    public:
+        BrotliCompressor() : Compressor(Encoding::Brotli) { create(); }
+        ~BrotliCompressor() override {
+            if (state) BrotliEncoderDestroyInstance(state);
+        }
+
+        bool write(const char *data, size_t len, bool flush, std::string &out) override {
+            return run(data, len, flush ? BROTLI_OPERATION_FLUSH : BROTLI_OPERATION_PROCESS, out);
+        }
+        bool finish(std::string &out) override { return run(nullptr, 0, BROTLI_OPERATION_FINISH, out); }
+        // Сбросить кодер brotli нельзя: состояние создаётся заново
+        bool reset() override {
+            if (state) BrotliEncoderDestroyInstance(state);
+            return create();
+        }
+
+    private:
+        bool create() {
+            state = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+            if (!state) return false;
+            BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, kBrotliQuality);
+            BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN, kBrotliWindow);
+            return true;
+        }
+
+        bool run(const char *data, size_t len, BrotliEncoderOperation op, std::string &out) {
+            if (!state) return false;
+            const uint8_t *in = reinterpret_cast<const uint8_t *>(data);
+            size_t availIn = len;
+            while (true) {
+                size_t used = out.size();
+                out.resize(used + kOutputStep);
+                uint8_t *next = reinterpret_cast<uint8_t *>(&out[used]);
+                size_t availOut = kOutputStep;
+                bool rc = BrotliEncoderCompressStream(state, op, &availIn, &in, &availOut, &next, nullptr);
+                out.resize(out.size() - availOut);
+                if (!rc) return false;
+                if (availIn == 0 && !BrotliEncoderHasMoreOutput(state)) {
+                    if (op != BROTLI_OPERATION_FINISH || BrotliEncoderIsFinished(state)) return true;
+                }
+            }
+        }
+
+        BrotliEncoderState *state = nullptr;
+    };
+#endif
+}
+
+const char *Compressor::name(Encoding encoding) {
+    switch (encoding) {
+        case Encoding::Gzip: return "gzip";
+        case Encoding::Brotli: return "br";
+        default: return "identity";
+    }
+}
+
+bool Compressor::available(Encoding encoding) {
+    switch (encoding) {
+#ifdef HAVE_ZLIB
+        case Encoding::Gzip: return true;
+#endif
+#ifdef HAVE_BROTLI
+        case Encoding::Brotli: return true;
+#endif
+        default: return false;
+    }
+}
+
+std::unique_ptr<Compressor> Compressor::create(Encoding encoding) {
+    switch (encoding) {
+#ifdef HAVE_ZLIB
+        case Encoding::Gzip: return std::make_unique<GzipCompressor>();
+#endif
+#ifdef HAVE_BROTLI
+        case Encoding::Brotli: return std::make_unique<BrotliCompressor>();
+#endif
+        default: return nullptr;
+    }
+}
+
+void CompressorPool::configure(const Policy &newPolicy) {
+    policy = newPolicy;
+    for (std::string &type : policy.types) {
+        std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    }
+}
+
+bool CompressorPool::parseEncodings(const std::string &list, Policy &out, std::string &error) {
+    out.gzip = out.brotli = false;
+    if (list == "off") return true;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = std::min(list.find(',', pos), list.size());
+        std::string_view name = trimView(std::string_view(list).substr(pos, comma - pos));
+        pos = comma + 1;
+        if (name.empty()) continue;
+        Compressor::Encoding encoding;
+        if (name == "gzip") {
+            encoding = Compressor::Encoding::Gzip;
+            out.gzip = true;
+        } else if (name == "br") {
+            encoding = Compressor::Encoding::Brotli;
+            out.brotli = true;
+        } else {
+            error = "unknown encoding " + std::string(name);
+            return false;
+        }
+        if (!Compressor::available(encoding)) {
+            error = std::string(name) + " support is not built in";
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> CompressorPool::defaultTypes() {
+    return {"text/", "application/json", "application/javascript", "application/xml", "application/xhtml+xml",
+            "application/rss+xml", "application/manifest+json", "image/svg+xml"};
+}
+
+std::vector<std::string> CompressorPool::parseTypes(const std::string &list) {
+    std::vector<std::string> types;
+    size_t pos = 0;
+    while (pos <= list.size()) {
+        size_t comma = std::min(list.find(',', pos), list.size());
+        std::string_view type = trimView(std::string_view(list).substr(pos, comma - pos));
+        pos = comma + 1;
+        if (!type.empty()) types.emplace_back(type);
+    }
+    return types;
+}
+
+bool CompressorPool::typeCompressible(std::string_view contentType) {
+    contentType = trimView(contentType.substr(0, contentType.find(';')));
+    for (const std::string &type : policy.types) {
+        bool prefix = !type.empty() && type.back() == '/';
+        if (prefix ? contentType.size() > type.size() && strncasecmp(contentType.data(), type.data(), type.size()) == 0
+                   : contentType.size() == type.size() && strncasecmp(contentType.data(), type.data(), type.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Compressor::Encoding CompressorPool::choose(std::string_view acceptEncoding, const std::string &responseHeaders,
+                                            bool haveContentLength, uint64_t contentLength) {
+    using Encoding = Compressor::Encoding;
+    if (!enabled() || (haveContentLength && contentLength < policy.minSize)) return Encoding::None;
+
+    // Вес кодировки в Accept-Encoding: -1 - не упомянута, 0 - запрещена
+    double gzipQ = -1, brQ = -1, anyQ = -1;
+    size_t pos = 0;
+    while (pos <= acceptEncoding.size()) {
+        size_t comma = std::min(acceptEncoding.find(',', pos), acceptEncoding.size());
+        std::string_view item = acceptEncoding.substr(pos, comma - pos);
+        pos = comma + 1;
+        size_t semi = item.find(';');
+        std::string_view name = trimView(item.substr(0, semi));
+        double q = 1;
+        if (semi != std::string_view::npos) {
+            std::string_view param = trimView(item.substr(semi + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+                q = std::atof(std::string(param.substr(2)).c_str());
+            }
+        }
+        if (name.size() == 4 && strncasecmp(name.data(), "gzip", 4) == 0) gzipQ = q;
+        else if (name.size() == 2 && strncasecmp(name.data(), "br", 2) == 0) brQ = q;
+        else if (name == "*") anyQ = q;
+    }
+    if (gzipQ < 0) gzipQ = anyQ;
+    if (brQ < 0) brQ = anyQ;
+    bool br = policy.brotli && brQ > 0;
+    bool gzip = policy.gzip && gzipQ > 0;
+    if (!br && !gzip) return Encoding::None;
+
+    // Уже сжатое, непонятного типа или запрещённое к изменению тело пересылается как есть
+    std::string value;
+    if (Utils::findHeader(responseHeaders, "content-encoding", value) && strcasecmp(value.c_str(), "identity") != 0) {
+        return Encoding::None;
+    }
+    if (!Utils::findHeader(responseHeaders, "content-type", value) || !typeCompressible(value)) return Encoding::None;
+    if (Utils::findHeader(responseHeaders, "cache-control", value) && strcasestr(value.c_str(), "no-transform")) {
+        return Encoding::None;
+    }
+    return br && (!gzip || brQ >= gzipQ) ? Encoding::Brotli : Encoding::Gzip;
+}
+
+CompressorPool &CompressorPool::local() {
+    thread_local CompressorPool pool;
+    return pool;
+}
+
+std::unique_ptr<Compressor> CompressorPool::acquire(Compressor::Encoding encoding) {
+    auto &list = idle[(size_t)encoding];
+    if (!list.empty()) {
+        auto compressor = std::move(list.back());
+        list.pop_back();
+        return compressor;
+    }
+    return Compressor::create(encoding);
+}
+
+void CompressorPool::release(std::unique_ptr<Compressor> compressor) {
+    if (!compressor) return;
+    auto &list = idle[(size_t)compressor->encoding()];
+    // Сжатие, прерванное на середине, сбрасывается так же, как законченное
+    if (list.size() < kMaxIdle && compressor->reset()) list.push_back(std::move(compressor));
+}
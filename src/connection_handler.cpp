@@ -1,364 +1,1606 @@
 #include "connection_handler.hpp"
 #include "logger.hpp"
 #include "utils.hpp"
+#include "upstream_pool.hpp"
+#include "response_cache.hpp"
+#include "request_coalescer.hpp"
+#include "header_scan.hpp"
+#include "dns_resolver.hpp"
+#include "circuit_breaker.hpp"
+#include "access_log.hpp"
+#include "metrics.hpp"
+#include "alloc_stats.hpp"
+#include "compressor.hpp"
 #include <sys/socket.h>
-#include <netdb.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
 #include <unistd.h>
-#include <sstream>
 #include <string.h>
+#include <strings.h>
+#include <string_view>
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 
-bool ConnectionHandler::processRequest(const HttpRequest &req, int clientFd) {
-    Logger::info("ConnectionHandler: processing request: " + req.method + " " + req.path);
+namespace {
+    constexpr uint32_t kWatchEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    constexpr size_t kMaxRequestHeaderSize = 64 * 1024;
+    constexpr size_t kMaxResponseHeaderSize = 64 * 1024;
+    constexpr size_t kRelayBufferSize = 64 * 1024;
+    // Ёмкость канала для splice(); ядро может выдать меньше
+    constexpr int kPipeSize = 256 * 1024;
+    // Меньшие куски тела дешевле скопировать, чем гонять через канал
+    constexpr size_t kMinSpliceSize = 16 * 1024;
+    constexpr int kMaxRedirects = 5;
+    // Тело ответа 3xx длиннее этого не дочитываем: дешевле закрыть соединение
+    constexpr size_t kMaxRedirectBody = 64 * 1024;
+
+    bool wouldBlock() {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    std::string_view trimView(const char *data, size_t begin, size_t end) {
+        auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+        while (begin < end && space(data[begin])) begin++;
+        while (end > begin && space(data[end - 1])) end--;
+        return std::string_view(data + begin, end - begin);
+    }
+
+    bool headerIs(std::string_view name, std::string_view expected) {
+        return name.size() == expected.size() && strncasecmp(name.data(), expected.data(), expected.size()) == 0;
+    }
+
+    // Есть ли в значении заголовка подстрока token (без учёта регистра)
+    bool containsToken(std::string_view value, std::string_view token) {
+        for (size_t i = 0; i + token.size() <= value.size(); i++) {
+            if (strncasecmp(value.data() + i, token.data(), token.size()) == 0) return true;
+        }
+        return false;
+    }
+
+    // Можно ли отдать ответ сервера другим клиентам, приславшим тот же запрос
+    bool responseShareable(const std::string &headers) {
+        std::string value;
+        if (Utils::findHeader(headers, "set-cookie", value)) return false;
+        if (Utils::findHeader(headers, "cache-control", value)) {
+            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+            if (value.find("no-store") != std::string::npos || value.find("private") != std::string::npos) return false;
+        }
+        if (Utils::findHeader(headers, "vary", value)) {
+            // Ключ схлопывания учитывает только Accept-Encoding
+            std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+            size_t pos = 0;
+            while (pos <= value.size()) {
+                size_t comma = value.find(',', pos);
+                if (comma == std::string::npos) comma = value.size();
+                std::string name = Utils::trim(value.substr(pos, comma - pos));
+                if (!name.empty() && name != "accept-encoding") return false;
+                pos = comma + 1;
+            }
+        }
+        return true;
+    }
+
+    // Код ответа из строки статуса "HTTP/1.x NNN ..."
+    int statusCode(const char *line, size_t len) {
+        const char *sp = static_cast<const char*>(memchr(line, ' ', len));
+        if (!sp || line + len - sp < 4) return 0;
+        return std::atoi(sp + 1);
+    }
+}
+
+std::chrono::milliseconds ConnectionHandler::keepAliveTimeout{15000};
+bool ConnectionHandler::useSplice = true;
+std::chrono::milliseconds ConnectionHandler::connectTimeout{5000};
+std::chrono::milliseconds ConnectionHandler::readTimeout{30000};
+std::chrono::milliseconds ConnectionHandler::writeTimeout{30000};
+std::chrono::milliseconds ConnectionHandler::totalTimeout{0};
+std::chrono::milliseconds ConnectionHandler::deadlineCheckInterval{30000};
+std::atomic<uint64_t> ConnectionHandler::totalResponses{0};
+std::atomic<uint64_t> ConnectionHandler::totalSyscalls{0};
+
+ConnectionHandler::ConnectionHandler(EventLoop &loop, int clientFd, std::chrono::steady_clock::time_point acceptedAt,
+                                     AdmissionControl::Ticket ticket)
+        : loop(loop), clientFd(clientFd), acceptedAt(acceptedAt), admission(std::move(ticket)), connector(loop, this, [this] { connectorReady.fire(); }) {
+    Metrics::connectionOpened();
+}
+
+ConnectionHandler::~ConnectionHandler() {
+    Metrics::connectionClosed();
+    cancelIdleTimer();
+    cancelDeadlineTimer();
+    leaveInflight();
+    stopLeading(false);
+    stopCompression();
+    closeServer();
+    closePipe();
+    if (clientFd >= 0) {
+        loop.remove(clientFd);
+        close(clientFd);
+    }
+}
+
+void ConnectionHandler::start() {
+    // Сокет клиента уже неблокирующий: Listener принимает его через accept4(SOCK_NONBLOCK).
+    // Заголовки и тело ответа уходят отдельными send(): без TCP_NODELAY на keep-alive
+    // соединении второй кусок ждал бы отложенного ACK клиента (~40 мс)
+    int one = 1;
+    setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (!loop.add(clientFd, kWatchEvents, this)) {
+        LOG_ERROR("ConnectionHandler: cannot register client fd=" + std::to_string(clientFd));
+        loop.retire(this);
+        return;
+    }
+    drive();
+}
+
+void ConnectionHandler::configure(int keepAliveTimeoutSec, bool splice) {
+    keepAliveTimeout = std::chrono::seconds(keepAliveTimeoutSec);
+    useSplice = splice;
+}
+
+void ConnectionHandler::configureTimeouts(int connectMs, int readMs, int writeMs, int totalMs) {
+    connectTimeout = std::chrono::milliseconds(connectMs);
+    readTimeout = std::chrono::milliseconds(readMs);
+    writeTimeout = std::chrono::milliseconds(writeMs);
+    totalTimeout = std::chrono::milliseconds(totalMs);
+    // Срок чтения или записи может оказаться ближе взведённого таймера, когда сменяется
+    // фаза обмена; таймер проверяет сроки не реже самого короткого из них
+    deadlineCheckInterval = std::chrono::milliseconds::max();
+    for (auto timeout : {readTimeout, writeTimeout}) {
+        if (timeout.count() > 0) deadlineCheckInterval = std::min(deadlineCheckInterval, timeout);
+    }
+}
+
+void ConnectionHandler::ioStats(uint64_t &responses, uint64_t &syscallCount) {
+    responses = totalResponses.load(std::memory_order_relaxed);
+    syscallCount = totalSyscalls.load(std::memory_order_relaxed);
+}
+
+void ConnectionHandler::onShutdown() {
+    stopping = true;
+    keepClient = false;
+    // Соединение между запросами просто закрываем, текущий ответ дописываем до конца
+    if (state == State::ReadRequest) {
+        state = State::Done;
+        drive();
+    }
+}
+
+void ConnectionHandler::onEvent(int fd, uint32_t events) {
+    lastActivity = std::chrono::steady_clock::now();
+    if (state == State::Connecting) {
+        // Подключение ведёт dialUpstream(); автомат продолжится, когда она завершится
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            connector.onEvent(fd);
+            connectorReady.fire();
+        }
+        return;
+    }
+    drive();
+}
+
+void ConnectionHandler::drive() {
+    Step step = Step::Progress;
+    while (step == Step::Progress && state != State::Done) {
+        switch (state) {
+            case State::ReadRequest: step = readRequest(); break;
+            case State::Connecting: step = finishConnect(); break;
+            case State::SendRequest: step = flushToServer(); break;
+            case State::ReadHeaders: step = readHeadersAndCheckRedirect(); break;
+            case State::SkipRedirectBody: step = skipRedirectBody(); break;
+            case State::StreamBody: step = streamResponse(); break;
+            case State::ServeCached: step = serveCached(); break;
+            case State::FollowInflight: step = followInflight(); break;
+            case State::FinishResponse:
+                step = flushToClient();
+                if (step == Step::Progress && state != State::Done) {
+                    finishAccess(true);
+                    resetForNextRequest();
+                    state = State::ReadRequest;
+                }
+                break;
+            case State::Closing:
+                step = flushToClient();
+                if (step == Step::Progress) {
+                    if (state != State::Done) finishAccess(true);
+                    state = State::Done;
+                }
+                break;
+            case State::Done: break;
+        }
+    }
+    if (state == State::Done) {
+        finishAccess(false); // ответ оборван, если запрос ещё не записан
+        LOG_DEBUG("ConnectionHandler: Finished handling client fd=" + std::to_string(clientFd));
+        loop.retire(this);
+    }
+}
+
+ConnectionHandler::Step ConnectionHandler::readRequest() {
+    if (clientEof && clientIn.empty()) {
+        state = State::Done;
+        return Step::Progress;
+    }
+    // В буфере уже может лежать следующий запрос (pipelining)
+    if (!clientIn.empty()) beginAccess();
+    RequestParser::Result res = requestParser.parse(clientIn.data(), clientIn.size(), requestView, clientEof);
+    while (res == RequestParser::Result::NeedMore) {
+        if (clientIn.size() > kMaxRequestHeaderSize) {
+            fail("HTTP/1.0 400 Bad Request\r\n\r\nBad Request\r\n");
+            return Step::Progress;
+        }
+        ReadBuffer::Status st = clientIn.fill(clientFd);
+        if (st == ReadBuffer::Status::WouldBlock) {
+            armIdleTimer();
+            return Step::Blocked;
+        }
+        if (st == ReadBuffer::Status::Error) {
+            LOG_ERROR("ConnectionHandler: client read error");
+            state = State::Done;
+            return Step::Progress;
+        }
+        if (st == ReadBuffer::Status::Eof) {
+            clientEof = true;
+            if (clientIn.empty()) {
+                if (requestsServed == 0) {
+                    LOG_ERROR("ConnectionHandler: client closed connection or read error");
+                }
+                state = State::Done;
+                return Step::Progress;
+            }
+            // Клиент закрыл соединение, не дописав заголовки: разбираем то, что есть
+        }
+        beginAccess();
+        res = requestParser.parse(clientIn.data(), clientIn.size(), requestView, clientEof);
+    }
+    cancelIdleTimer();
+    markAccess(access.parseUs);
+    access.bytesIn = res == RequestParser::Result::Error ? clientIn.size() : requestParser.consumed();
+
+    if (res == RequestParser::Result::Error) {
+        LOG_ERROR("ConnectionHandler: Failed to parse HTTP request");
+        fail("HTTP/1.0 400 Bad Request\r\n\r\nBad Request\r\n");
+        return Step::Progress;
+    }
+
+    if (requestView.method != "GET") {
+        LOG_DEBUG("ConnectionHandler: Request method not implemented: " + std::string(requestView.method));
+        fail("HTTP/1.0 501 Not Implemented\r\n\r\nMethod Not Implemented\r\n");
+        return Step::Progress;
+    }
+
+    RequestParser::toRequest(requestView, request);
+    // Байты заголовков сохраняются для пересылки серверу, память буферов переиспользуется между запросами
+    requestHead.assign(clientIn.data(), requestParser.consumed());
+    requestFields.clear();
+    for (const HeaderField &field : requestView.headers) {
+        size_t begin = (size_t)(field.name.data() - clientIn.data());
+        size_t valueEnd = (size_t)(field.value.data() + field.value.size() - clientIn.data());
+        size_t nl = requestHead.find('\n', valueEnd);
+        // Строка без перевода строки бывает только у оборванного запроса: её не пересылаем
+        if (nl == std::string::npos) continue;
+        requestFields.push_back({(uint32_t)begin, (uint32_t)field.name.size(), (uint32_t)(nl + 1)});
+    }
+    clientIn.consume(requestParser.consumed());
+    requestParser.reset();
+
+    LOG_DEBUG("ConnectionHandler: Parsed request: " + std::string(request.method) + " " + std::string(request.path) +
+                  " " + std::string(request.version));
+    keepClient = !stopping && wantsKeepAlive(request);
+    if (const std::pmr::string *h = request.header("host")) {
+        LOG_DEBUG("ConnectionHandler: Host: " + std::string(*h));
+    }
+
+    processRequest();
+    return Step::Progress;
+}
+
+void ConnectionHandler::beginAccess() {
+    if (accessPending) return;
+    accessPending = true;
+    access = AccessRecord();
+    // Первый запрос соединения считается от accept, следующие - от их первого байта
+    accessStart = requestsServed == 0 ? acceptedAt : std::chrono::steady_clock::now();
+    if (AllocStats::kEnabled) accessAllocations = AllocStats::threadCount();
+}
+
+void ConnectionHandler::markAccess(uint32_t &stage) {
+    if (!accessPending || stage != AccessRecord::kNotReached) return;
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - accessStart).count();
+    stage = (uint32_t)std::min<int64_t>(us, AccessRecord::kNotReached - 1);
+}
+
+void ConnectionHandler::setAccessTarget(const std::string &host, int port) {
+    if (!accessPending) return;
+    size_t len = std::min(host.size(), sizeof(access.host));
+    memcpy(access.host, host.data(), len);
+    memset(access.host + len, 0, sizeof(access.host) - len);
+    access.port = (uint16_t)port;
+}
+
+void ConnectionHandler::setAccessStatus(const char *statusLine, size_t len) {
+    if (access.status == 0) access.status = (uint16_t)statusCode(statusLine, len);
+}
+
+void ConnectionHandler::finishAccess(bool complete) {
+    if (!accessPending) return;
+    markAccess(access.lastByteUs);
+    accessPending = false;
+    access.redirects = (uint8_t)std::min(redirectCount, 255);
+    if (!complete || bodyError) access.flags |= AccessRecord::Aborted;
+    Metrics::requestFinished(access);
+    if (AllocStats::kEnabled) Metrics::requestAllocations(AllocStats::threadCount() - accessAllocations);
+    if (!AccessLog::enabled()) return;
+    auto elapsed = std::chrono::steady_clock::now() - accessStart;
+    access.startUnixUs = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            (std::chrono::system_clock::now() - elapsed).time_since_epoch()).count();
+    AccessLog::instance().record(access);
+}
+
+bool ConnectionHandler::processRequest() {
+    LOG_DEBUG("ConnectionHandler: processing request: " + std::string(request.method) + " " + std::string(request.path));
 
     std::string host;
     int port;
     std::string path;
-    if (!parseFinalUrl(req, host, port, path)) {
-        Logger::error("ConnectionHandler: Could not parse final URL from request");
-        std::string err = "HTTP/1.0 400 Bad Request\r\n\r\nInvalid URL.\r\n";
-        send(clientFd, err.data(), err.size(), MSG_NOSIGNAL);
+    if (!parseFinalUrl(request, host, port, path)) {
+        LOG_ERROR("ConnectionHandler: Could not parse final URL from request");
+        fail("HTTP/1.0 400 Bad Request\r\n\r\nInvalid URL.\r\n");
         return false;
     }
+    originHost = host;
+    originPort = port;
 
-    HttpRequest actualReq = req;
-    actualReq.path = path;
-    actualReq.headers["host"] = (port != 80) ? (host + ":" + std::to_string(port)) : host;
+    // Постоянные редиректы из таблицы проходим сразу, без запросов к серверу
+    RedirectHandler::Target target;
+    while (RedirectHandler::enabled() && redirectCount < kMaxRedirects &&
+           RedirectHandler::instance().lookup(ResponseCache::makeKey(host, port, path), target)) {
+        LOG_DEBUG("ConnectionHandler: permanent redirect to " + target.host + ":" + std::to_string(target.port) + target.path);
+        host = std::move(target.host);
+        port = target.port;
+        path = std::move(target.path);
+        redirectCount++;
+    }
 
-    int serverFd = connectToServer(host, port);
-    if (serverFd < 0) {
-        Logger::error("ConnectionHandler: Could not connect to " + host + ":" + std::to_string(port));
-        std::string err = "HTTP/1.0 502 Bad Gateway\r\n\r\nCould not connect to upstream server.\r\n";
-        send(clientFd, err.data(), err.size(), MSG_NOSIGNAL);
-        return false;
+    setAccessTarget(host, port);
+    clientHttp10 = (request.version == "HTTP/1.0");
+
+    bool cacheable = ResponseCache::requestCacheable(request);
+    if (ResponseCache::enabled() && cacheable) {
+        ResponseCache &cache = ResponseCache::instance();
+        cacheKey = ResponseCache::makeKey(host, port, path);
+        auto entry = cache.lookup(cacheKey, request);
+        if (entry && entry->fresh(std::chrono::steady_clock::now()) &&
+            !ResponseCache::requestForcesRevalidation(request)) {
+            cache.stats().hits.fetch_add(1, std::memory_order_relaxed);
+            LOG_DEBUG("ConnectionHandler: cache hit for " + cacheKey);
+            access.flags |= AccessRecord::CacheHit;
+            startServeCached(std::move(entry));
+            return true;
+        }
+        cache.stats().misses.fetch_add(1, std::memory_order_relaxed);
+        if (entry && entry->hasValidators()) {
+            // Устаревшую запись перепроверяем условным запросом
+            cachedEntry = std::move(entry);
+        }
     }
 
-    if (!sendRequest(serverFd, actualReq)) {
-        Logger::error("ConnectionHandler: Failed to send request to server");
-        close(serverFd);
-        std::string err = "HTTP/1.0 502 Bad Gateway\r\n\r\nFailed to send request.\r\n";
-        send(clientFd, err.data(), err.size(), MSG_NOSIGNAL);
+    // Адрес нужен и ведомому: если ответ лидера не подойдёт, он пойдёт к серверу сам
+    request.path = path;
+    upstreamHost = host;
+    upstreamPort = port;
+
+    // Перепроверяемую запись не схлопываем: ответ на условный запрос нужен только нам
+    if (RequestCoalescer::enabled() && cacheable && !cachedEntry && !request.header("cookie") &&
+        joinInflight(ResponseCache::makeKey(upstreamHost, upstreamPort, path), request)) {
+        return true;
+    }
+    return startUpstream();
+}
+
+bool ConnectionHandler::startUpstream() {
+    breakerKey = CircuitBreaker::makeKey(upstreamHost, upstreamPort);
+    if (!CircuitBreaker::instance().allow(breakerKey)) {
+        LOG_ERROR("ConnectionHandler: " + breakerKey + " is unavailable, rejecting request");
+        fail("HTTP/1.0 503 Service Unavailable\r\n\r\nUpstream server is temporarily unavailable.\r\n");
+        return false;
+    }
+    exchangeStart = std::chrono::steady_clock::now();
+    sendRequest(upstreamHost, upstreamPort);
+    if (!connectToServer(upstreamHost, upstreamPort)) {
+        LOG_ERROR("ConnectionHandler: Could not connect to " + upstreamHost + ":" + std::to_string(upstreamPort));
+        fail("HTTP/1.0 502 Bad Gateway\r\n\r\nCould not connect to upstream server.\r\n");
         return false;
     }
+    return true;
+}
 
-    std::string location;
-    int redirectCount = 0;
-    bool done = false;
+bool ConnectionHandler::joinInflight(const std::string &key, const HttpRequest &req) {
+    coalesceKey = key;
+    coalesceKey += '|';
+    if (const std::pmr::string *enc = req.header("accept-encoding")) coalesceKey += *enc;
+    subscription = std::make_shared<InflightSubscription>();
+    subscription->loop = &loop;
+    subscription->notify = [this] { drive(); };
 
-    while (!done) {
-        chunked = false;
-        haveContentLength = false;
-        contentLength = 0;
+    bool leader = false;
+    inflight = RequestCoalescer::instance().join(coalesceKey, subscription, leader);
+    if (leader) {
+        // Лидер сам идёт к серверу и публикует ответ для тех, кто придёт следом
+        subscription.reset();
+        leading = true;
+        return false;
+    }
+    LOG_DEBUG("ConnectionHandler: request collapsed into in-flight " + coalesceKey);
+    access.flags |= AccessRecord::Coalesced;
+    followSegment = 0;
+    followHeadersSent = false;
+    followChunked = false;
+    state = State::FollowInflight;
+    return true;
+}
 
-        if (!readHeadersAndCheckRedirect(serverFd, clientFd, location)) {
-            close(serverFd);
-            return false;
-        }
+void ConnectionHandler::leaveInflight() {
+    if (!subscription) return;
+    subscription->active = false;
+    inflight->unsubscribe(subscription);
+    subscription.reset();
+    inflight.reset();
+}
 
-        if (!location.empty()) {
-            close(serverFd);
-            redirectCount++;
-            if (redirectCount > 5) {
-                Logger::error("ConnectionHandler: too many redirects");
-                return true; // заголовки редиректа уже отправлены клиенту
-            }
+void ConnectionHandler::stopLeading(bool completed) {
+    if (!leading) return;
+    if (completed) {
+        inflight->complete();
+    } else {
+        inflight->fail();
+    }
+    RequestCoalescer::instance().finish(coalesceKey, inflight);
+    inflight.reset();
+    leading = false;
+}
 
-            std::string newHost;
-            int newPort;
-            std::string newPath;
-            if (!parseRedirectUrl(location, newHost, newPort, newPath)) {
-                Logger::error("ConnectionHandler: invalid redirect location: " + location);
-                return true;
-            }
+void ConnectionHandler::publishBody(const char *data, size_t len) {
+    if (!leading) return;
+    inflight->publishBody(data, len);
+    if (inflight->bufferedBytes() <= InflightResponse::kMaxBuffered) return;
+    // Большой ответ без ведомых не копим: убираем его из реестра, чтобы никто не успел подписаться
+    RequestCoalescer::instance().finish(coalesceKey, inflight);
+    if (!inflight->hasSubscribers()) {
+        inflight->fail();
+        inflight.reset();
+        leading = false;
+    }
+}
 
-            serverFd = connectToServer(newHost, newPort);
-            if (serverFd < 0) {
-                Logger::error("ConnectionHandler: Could not connect to redirect location: " + newHost + ":" + std::to_string(newPort));
-                return true;
-            }
+ConnectionHandler::Step ConnectionHandler::followInflight() {
+    if (clientOutPending()) {
+        if (flushToClient() == Step::Blocked) return Step::Blocked;
+        if (state == State::Done) return Step::Progress;
+    }
 
-            HttpRequest newReq = req;
-            newReq.path = newPath;
-            newReq.headers["host"] = (newPort != 80) ? (newHost + ":" + std::to_string(newPort)) : newHost;
+    auto snap = inflight->read(subscription, followSegment);
+    if (snap.failed || (snap.headersReady && !snap.shareable)) {
+        leaveInflight();
+        if (followHeadersSent) {
+            // Клиент уже получил часть ответа: остаётся только оборвать соединение
+            LOG_ERROR("ConnectionHandler: in-flight response aborted");
+            state = State::Done;
+            return Step::Progress;
+        }
+        LOG_DEBUG("ConnectionHandler: in-flight response unusable, fetching " + coalesceKey + " directly");
+        startUpstream();
+        return Step::Progress;
+    }
+    if (!snap.headersReady) return Step::Blocked;
 
-            if (!sendRequest(serverFd, newReq)) {
-                Logger::error("ConnectionHandler: Failed to send request after redirect");
-                close(serverFd);
-                return true;
-            }
+    if (!followHeadersSent) {
+        // Тело приходит без разметки: без Content-Length клиенту HTTP/1.1 размечаем его
+        // chunked, клиенту HTTP/1.0 отдаём до закрытия соединения
+        followChunked = !snap.haveContentLength && !clientHttp10;
+        if (!snap.haveContentLength && clientHttp10) keepClient = false;
+        setAccessStatus(snap.headers->data(), snap.headers->size());
+        std::string head = *snap.headers;
+        if (followChunked) head += "Transfer-Encoding: chunked\r\n";
+        head += keepClient ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+        followHeadersSent = true;
+        if (!relayToClient(head.data(), head.size())) {
+            state = State::Done;
+            return Step::Progress;
+        }
+    }
 
-            location.clear();
+    for (const auto &segment : snap.segments) {
+        bool ok = true;
+        if (followChunked) {
+            char sizeLine[32];
+            int n = snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", segment->size());
+            ok = relayToClient(sizeLine, (size_t)n) &&
+                 relayToClient(segment->data(), segment->size()) &&
+                 relayToClient("\r\n", 2);
         } else {
-            // Не редирект, читаем тело ответа
-            if (!streamResponse(serverFd, clientFd)) {
-                Logger::error("ConnectionHandler: Error streaming response body");
-            }
-            close(serverFd);
-            done = true;
+            ok = relayToClient(segment->data(), segment->size());
+        }
+        if (!ok) {
+            state = State::Done;
+            return Step::Progress;
         }
+        followSegment++;
+        // Клиент не успевает: остальное дочитаем после EPOLLOUT
+        if (clientOutPending()) return Step::Blocked;
     }
 
-    return true;
+    if (!snap.complete) return Step::Blocked;
+    if (followChunked && !relayToClient("0\r\n\r\n", 5)) {
+        state = State::Done;
+        return Step::Progress;
+    }
+    leaveInflight();
+    state = keepClient ? State::FinishResponse : State::Closing;
+    return Step::Progress;
 }
 
 bool ConnectionHandler::parseFinalUrl(const HttpRequest &req, std::string &host, int &port, std::string &path) {
+    std::string scheme;
     if (req.path.find("http://") == 0 || req.path.find("https://") == 0) {
-        std::string scheme;
         return Utils::parseUrl(req.path, scheme, host, port, path);
     } else {
-        auto it = req.headers.find("host");
-        if (it == req.headers.end()) return false;
-        std::string fullUrl = "http://" + Utils::trim(it->second) + req.path;
-        std::string scheme;
+        const std::pmr::string *hostHeader = req.header("host");
+        if (!hostHeader) return false;
+        // Полный URL собирается в арене запроса
+        std::pmr::string fullUrl("http://", arena.get());
+        fullUrl += trimView(hostHeader->data(), 0, hostHeader->size());
+        fullUrl += req.path;
         return Utils::parseUrl(fullUrl, scheme, host, port, path);
     }
 }
 
-bool ConnectionHandler::parseRedirectUrl(const std::string &location, std::string &host, int &port, std::string &path) {
-    std::string scheme;
-    return Utils::parseUrl(location, scheme, host, port, path);
-}
-
-int ConnectionHandler::connectToServer(const std::string &host, int port) {
-    Logger::info("ConnectionHandler: connecting to " + host + ":" + std::to_string(port));
-    struct addrinfo hints, *res;
-    ::memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    std::string portStr = std::to_string(port);
-    if (getaddrinfo(host.c_str(), portStr.c_str(), &hints, &res) != 0) {
-        Logger::error("ConnectionHandler: getaddrinfo failed for " + host);
-        return -1;
-    }
-    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (fd < 0) {
-        freeaddrinfo(res);
-        Logger::error("ConnectionHandler: socket creation failed for " + host);
-        return -1;
-    }
-    if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
-        Logger::error("ConnectionHandler: connect failed for " + host);
-        close(fd);
-        freeaddrinfo(res);
-        return -1;
-    }
-    freeaddrinfo(res);
-    return fd;
-}
-
-bool ConnectionHandler::sendRequest(int serverFd, const HttpRequest &req) {
-    Logger::info("ConnectionHandler: sending request to server: " + req.method + " " + req.path);
-    std::ostringstream oss;
-    oss << req.method << " " << req.path << " HTTP/1.0\r\n";
-    for (auto &h : req.headers) {
-        oss << h.first << ": " << h.second << "\r\n";
-    }
-    oss << "\r\n";
-
-    std::string out = oss.str();
-    ssize_t written = send(serverFd, out.data(), out.size(), MSG_NOSIGNAL);
-    if (written != (ssize_t)out.size()) {
-        Logger::error("ConnectionHandler: sendRequest incomplete");
-        return false;
+bool ConnectionHandler::connectToServer(const std::string &host, int port, bool allowPooled) {
+    upstreamHost = host;
+    upstreamPort = port;
+    setAccessTarget(host, port);
+    serverReused = false;
+    connectStart = lastActivity = std::chrono::steady_clock::now();
+
+    int pooledFd = allowPooled ? UpstreamPool::local().acquire(host, port) : -1;
+    if (pooledFd >= 0) {
+        if (!loop.add(pooledFd, kWatchEvents, this)) {
+            close(pooledFd);
+            return false;
+        }
+        LOG_DEBUG("ConnectionHandler: reusing pooled connection to " + host + ":" + std::to_string(port));
+        serverFd = pooledFd;
+        serverReused = true;
+        markAccess(access.connectUs);
+        access.flags |= AccessRecord::ReusedConn;
+        state = State::SendRequest;
+        armDeadlineTimer();
+        return true;
     }
+
+    state = State::Connecting;
+    dial = dialUpstream();
+    // Адрес из кеша и отказ сразу на всех адресах завершают сопрограмму без ожидания:
+    // результат заберёт finishConnect() в этом же проходе автомата
+    if (!dial.start()) dial.whenDone([this] { drive(); });
+    armDeadlineTimer();
     return true;
 }
 
-bool ConnectionHandler::readHeadersAndCheckRedirect(int serverFd, int clientFd, std::string &location) {
-    location.clear();
-    std::string headers;
-    char c;
-    bool headersDone = false;
+Coro::Task<bool> ConnectionHandler::dialUpstream() {
+    auto resolved = DnsResolver::instance().lookupCached(upstreamHost);
+    if (!resolved) {
+        // Имя разрешают потоки резолвера, цикл событий тем временем обслуживает других
+        LOG_DEBUG("ConnectionHandler: resolving " + upstreamHost);
+        resolved = co_await Coro::resolve(loop, upstreamHost);
+        Metrics::observe(LatencyStage::Dns, std::chrono::steady_clock::now() - connectStart);
+    }
+    if (!resolved->ok) {
+        LOG_ERROR("ConnectionHandler: cannot resolve " + upstreamHost + ": " + resolved->error);
+        co_return false;
+    }
 
-    while (!headersDone) {
-        ssize_t r = recv(serverFd, &c, 1, 0);
-        if (r <= 0) {
-            std::string err = "HTTP/1.0 502 Bad Gateway\r\n\r\nEmpty or invalid response\r\n";
-            send(clientFd, err.data(), err.size(), MSG_NOSIGNAL);
-            return false;
+    LOG_DEBUG("ConnectionHandler: connecting to " + upstreamHost + ":" + std::to_string(upstreamPort) +
+                 " (" + std::to_string(resolved->addresses.size()) + " addresses)");
+    dialStart = std::chrono::steady_clock::now();
+    if (!connector.start(*resolved, upstreamPort)) {
+        CircuitBreaker::instance().failure(breakerKey);
+        co_return false;
+    }
+    int fd = -1;
+    UpstreamConnector::Status status;
+    while ((status = connector.poll(fd)) == UpstreamConnector::Status::Pending) {
+        co_await connectorReady;
+    }
+    if (status == UpstreamConnector::Status::Failed) {
+        LOG_ERROR("ConnectionHandler: no address of " + upstreamHost + ":" + std::to_string(upstreamPort) +
+                      " accepted the connection (" + std::to_string(connector.attemptsMade()) + " tried)");
+        CircuitBreaker::instance().failure(breakerKey);
+        co_return false;
+    }
+    serverFd = fd;
+    markAccess(access.connectUs);
+    Metrics::observe(LatencyStage::Connect, std::chrono::steady_clock::now() - dialStart);
+    co_return true;
+}
+
+void ConnectionHandler::connectFailed(bool timedOut) {
+    dial = {};
+    connector.reset();
+    closeServer();
+    if (timedOut) {
+        access.flags |= AccessRecord::TimedOut;
+        fail("HTTP/1.0 504 Gateway Timeout\r\n\r\nUpstream server did not respond in time.\r\n");
+    } else {
+        fail("HTTP/1.0 502 Bad Gateway\r\n\r\nCould not connect to upstream server.\r\n");
+    }
+}
+
+ConnectionHandler::Step ConnectionHandler::finishConnect() {
+    if (!dial.done()) return Step::Blocked;
+    bool connected = dial.result();
+    dial = {};
+    if (!connected) {
+        connectFailed();
+        return Step::Progress;
+    }
+    state = State::SendRequest;
+    // Дальше действуют таймауты записи и чтения, а не подключения
+    armDeadlineTimer();
+    return Step::Progress;
+}
+
+void ConnectionHandler::sendRequest(const std::string &host, int port) {
+    LOG_DEBUG("ConnectionHandler: sending request to server: " + std::string(request.method) + " " + std::string(request.path));
+    serverOutHead.assign(request.method);
+    serverOutHead += ' ';
+    serverOutHead += request.path;
+    serverOutHead += " HTTP/1.1\r\nhost: ";
+    serverOutHead += host;
+    if (port != 80) {
+        serverOutHead += ':';
+        serverOutHead += std::to_string(port);
+    }
+    serverOutHead += "\r\n";
+
+    // Подряд идущие пересылаемые заголовки сливаются в один кусок
+    serverOutSpans.clear();
+    size_t size = serverOutHead.size();
+    bool crossOrigin = host != originHost || port != originPort;
+    for (const ForwardedField &field : requestFields) {
+        std::string_view name(requestHead.data() + field.begin, field.nameLen);
+        if (Utils::isHopByHopHeader(name) || headerIs(name, "host")) continue;
+        // Учётные данные клиента не уходят серверу, на который перевёл редирект
+        if (crossOrigin && (headerIs(name, "cookie") || headerIs(name, "authorization"))) continue;
+        // Условные заголовки перепроверки записи кеша заменяют присланные клиентом
+        if (cachedEntry && (headerIs(name, "if-none-match") || headerIs(name, "if-modified-since"))) continue;
+        if (!serverOutSpans.empty() && serverOutSpans.back().second == field.begin) {
+            serverOutSpans.back().second = field.end;
+        } else {
+            serverOutSpans.emplace_back(field.begin, field.end);
         }
-        headers.push_back(c);
-        int len = (int)headers.size();
-        if (len >= 4 && headers.substr(len-4) == "\r\n\r\n") {
-            headersDone = true;
+        size += field.end - field.begin;
+    }
+
+    serverOutTail.clear();
+    if (cachedEntry) {
+        if (!cachedEntry->etag.empty()) serverOutTail += "if-none-match: " + cachedEntry->etag + "\r\n";
+        if (!cachedEntry->lastModified.empty()) serverOutTail += "if-modified-since: " + cachedEntry->lastModified + "\r\n";
+    }
+    serverOutTail += UpstreamPool::enabled() ? "connection: keep-alive\r\n\r\n" : "connection: close\r\n\r\n";
+
+    serverOutSize = size + serverOutTail.size();
+    serverOutPos = 0;
+    syscalls = 0;
+}
+
+ConnectionHandler::Step ConnectionHandler::flushToServer() {
+    constexpr size_t kMaxIov = 64;
+    while (serverOutPos < serverOutSize) {
+        // Вектор собирается с места, на котором остановилась предыдущая частичная запись
+        iovec iov[kMaxIov];
+        size_t count = 0;
+        size_t skip = serverOutPos;
+        auto add = [&](const char *data, size_t len) {
+            if (skip >= len) {
+                skip -= len;
+                return;
+            }
+            if (count == kMaxIov) return;
+            iov[count].iov_base = const_cast<char*>(data + skip);
+            iov[count].iov_len = len - skip;
+            count++;
+            skip = 0;
+        };
+        add(serverOutHead.data(), serverOutHead.size());
+        for (const auto &span : serverOutSpans) add(requestHead.data() + span.first, span.second - span.first);
+        add(serverOutTail.data(), serverOutTail.size());
+
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        syscalls++;
+        ssize_t s = sendmsg(serverFd, &msg, MSG_NOSIGNAL);
+        if (s > 0) {
+            serverOutPos += (size_t)s;
+            continue;
         }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && wouldBlock()) return Step::Blocked;
+
+        if (retryFresh()) return Step::Progress;
+        LOG_ERROR("ConnectionHandler: Failed to send request to server");
+        fail("HTTP/1.0 502 Bad Gateway\r\n\r\nFailed to send request.\r\n");
+        return Step::Progress;
     }
 
-    if (headers.empty()) {
-        std::string err = "HTTP/1.0 502 Bad Gateway\r\n\r\nEmpty response\r\n";
-        send(clientFd, err.data(), err.size(), MSG_NOSIGNAL);
-        return false;
+    serverOutSize = 0;
+    serverOutPos = 0;
+    serverIn.clear();
+    chunked = false;
+    dechunk = false;
+    haveContentLength = false;
+    contentLength = 0;
+    bodyDone = false;
+    bodyError = false;
+    splicedBytes = 0;
+    copiedBytes = 0;
+    upstreamKeepAlive = false;
+    state = State::ReadHeaders;
+    return Step::Progress;
+}
+
+ConnectionHandler::Step ConnectionHandler::readHeadersAndCheckRedirect() {
+    size_t headerEnd = serverIn.findHeaderEnd();
+    while (headerEnd == std::string::npos) {
+        if (serverIn.size() > kMaxResponseHeaderSize) {
+            fail("HTTP/1.0 502 Bad Gateway\r\n\r\nEmpty or invalid response\r\n");
+            return Step::Progress;
+        }
+        syscalls++;
+        ReadBuffer::Status st = serverIn.fill(serverFd);
+        if (st == ReadBuffer::Status::WouldBlock) return Step::Blocked;
+        if (st != ReadBuffer::Status::Ok) {
+            // Сервер мог закрыть соединение из пула, пока оно простаивало
+            if (serverIn.empty() && retryFresh()) return Step::Progress;
+            fail("HTTP/1.0 502 Bad Gateway\r\n\r\nEmpty or invalid response\r\n");
+            return Step::Progress;
+        }
+        markAccess(access.firstByteUs);
+        headerEnd = serverIn.findHeaderEnd();
     }
 
-    // Проверяем редирект
-    {
-        auto pos = headers.find("\r\n");
-        if (pos != std::string::npos) {
-            std::string startLine = headers.substr(0, pos);
-            if (startLine.find(" 3") != std::string::npos) {
-                auto locPos = headers.find("\r\nLocation:");
-                if (locPos == std::string::npos) {
-                    locPos = headers.find("\r\nlocation:");
-                }
-                if (locPos != std::string::npos) {
-                    locPos += 2;
-                    auto endPos = headers.find("\r\n", locPos);
-                    if (endPos != std::string::npos) {
-                        std::string locLine = headers.substr(locPos, endPos - locPos);
-                        auto colonPos = locLine.find(':');
-                        if (colonPos != std::string::npos) {
-                            location = Utils::trim(locLine.substr(colonPos+1));
-                            send(clientFd, headers.data(), headers.size(), MSG_NOSIGNAL);
-                            return true;
-                        }
-                    }
-                }
+    // Байты после заголовков остаются в serverIn и уходят этапу пересылки тела
+    std::string headers(serverIn.data(), headerEnd);
+    serverIn.consume(headerEnd);
+
+    // Разметка строк и поиск нужных заголовков за один проход, без копии в нижнем регистре
+    static thread_local std::vector<HeaderScan::Line> lines;
+    lines.clear();
+    HeaderScan::scan(headers.data(), headers.size(), 0, lines);
+    HeaderScan::ResponseHead head;
+    if (!HeaderScan::inspectResponse(headers.data(), lines, head)) {
+        fail("HTTP/1.0 502 Bad Gateway\r\n\r\nEmpty or invalid response\r\n");
+        return Step::Progress;
+    }
+    int status = head.status;
+
+    // Сервер ответил: неудачи подключения к нему больше не идут подряд
+    CircuitBreaker::instance().success(breakerKey);
+
+    if (head.http11) {
+        upstreamKeepAlive = !containsToken(head.connection, "close");
+    } else {
+        upstreamKeepAlive = containsToken(head.connection, "keep-alive");
+    }
+    if (containsToken(head.transferEncoding, "chunked")) {
+        chunked = true;
+        // Клиент HTTP/1.0 не понимает chunked: отдаём ему тело без разметки до закрытия соединения
+        dechunk = clientHttp10;
+        chunkState = ChunkState::Size;
+        chunkLine.clear();
+    } else if (head.haveContentLength) {
+        uint64_t length;
+        haveContentLength = HeaderScan::parseDecimal(head.contentLength.data(), head.contentLength.size(), length);
+        if (haveContentLength) contentLength = length;
+    }
+
+    // Ответы 1xx, 204 и 304 не имеют тела
+    bodyRemaining = contentLength;
+    if ((status >= 100 && status < 200) || status == 204 || status == 304 ||
+        (haveContentLength && contentLength == 0)) {
+        bodyDone = true;
+    }
+
+    if (RedirectHandler::followable(status) && head.haveLocation) {
+        RedirectHandler::Target base{upstreamHost, upstreamPort, std::string(request.path)};
+        if (redirectCount >= kMaxRedirects) {
+            // Дальше не идём: клиент получает последний редирект как обычный ответ
+            LOG_ERROR("ConnectionHandler: too many redirects from " + breakerKey);
+        } else if (RedirectHandler::resolveLocation(head.location, base, redirectTarget)) {
+            if (RedirectHandler::permanent(status)) {
+                RedirectHandler::instance().remember(ResponseCache::makeKey(base.host, base.port, base.path),
+                                                     redirectTarget, headers);
             }
+            redirectSkipped = 0;
+            state = State::SkipRedirectBody;
+            return Step::Progress;
         }
     }
+    access.status = (uint16_t)status;
 
-    {
-        std::string lowerHeaders = headers;
-        std::transform(lowerHeaders.begin(), lowerHeaders.end(), lowerHeaders.begin(), ::tolower);
-        if (lowerHeaders.find("transfer-encoding: chunked") != std::string::npos) {
-            chunked = true;
+    if (cachedEntry && status == 304) {
+        // Запись в кеше подтверждена сервером: тела у 304 нет, соединение свободно
+        ResponseCache &cache = ResponseCache::instance();
+        cache.stats().revalidated.fetch_add(1, std::memory_order_relaxed);
+        LOG_DEBUG("ConnectionHandler: cache entry revalidated for " + cacheKey);
+        auto refreshed = cache.refresh(cacheKey, cachedEntry, headers);
+        if (!serverIn.empty()) upstreamKeepAlive = false;
+        releaseServer();
+        startServeCached(std::move(refreshed));
+        return Step::Progress;
+    }
+
+    // Без Content-Length и chunked тело ограничено закрытием соединения
+    if (!chunked && !haveContentLength && !bodyDone) {
+        upstreamKeepAlive = false;
+        keepClient = false;
+    }
+    startCompression(headers, status);
+    // Клиент получает тело без разметки: конец ответа он определит только по закрытию соединения
+    if (dechunk || (compressor && clientHttp10)) {
+        keepClient = false;
+    }
+
+    if (!cacheKey.empty() && (chunked || haveContentLength) &&
+        (!haveContentLength || contentLength <= ResponseCache::maxObjectSize())) {
+        captureEntry = ResponseCache::prepare(headers, status, request);
+        capturing = captureEntry != nullptr;
+    }
+
+    if (leading) {
+        bool shareable = status != 304 && responseShareable(headers);
+        inflight->publishHeaders(Utils::stripHeaders(headers, {"transfer-encoding"}), shareable,
+                                 haveContentLength || bodyDone);
+        if (!shareable) stopLeading(false);
+    }
+
+    std::string clientHeaders = rewriteResponseHeaders(headers);
+    if (!relayToClient(clientHeaders.data(), clientHeaders.size())) {
+        state = State::Done;
+        return Step::Progress;
+    }
+    state = State::StreamBody;
+
+    if (!serverIn.empty()) {
+        bool ok = relayBody(serverIn.data(), serverIn.size());
+        serverIn.clear();
+        if (!ok) state = State::Done;
+    }
+    return Step::Progress;
+}
+
+ConnectionHandler::Step ConnectionHandler::skipRedirectBody() {
+    static thread_local char buf[kRelayBufferSize];
+    auto skip = [this](const char *data, size_t len) {
+        size_t used = consumeBody(data, len);
+        // После конца ответа пришли лишние байты: соединение нельзя переиспользовать
+        if (used < len) upstreamKeepAlive = false;
+        redirectSkipped += used;
+        dechunked.clear();
+    };
+    if (!serverIn.empty()) {
+        skip(serverIn.data(), serverIn.size());
+        serverIn.clear();
+    }
+    while (!bodyDone) {
+        // Тело до закрытия соединения или слишком длинное не ждём: соединение всё равно закрывается
+        if ((!chunked && !haveContentLength) || (haveContentLength && contentLength > kMaxRedirectBody) ||
+            redirectSkipped > kMaxRedirectBody) {
+            upstreamKeepAlive = false;
+            break;
+        }
+        syscalls++;
+        ssize_t n = recv(serverFd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            skip(buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && wouldBlock()) return Step::Blocked;
+        upstreamKeepAlive = false;
+        break;
+    }
+    releaseServer();
+    followRedirect();
+    return Step::Progress;
+}
+
+bool ConnectionHandler::followRedirect() {
+    redirectCount++;
+    RedirectHandler::instance().stats().followed.fetch_add(1, std::memory_order_relaxed);
+    if (cachedEntry) {
+        // На условный запрос пришёл редирект: перепроверка не состоялась
+        cachedEntry.reset();
+    }
+
+    const RedirectHandler::Target &target = redirectTarget;
+    LOG_DEBUG("ConnectionHandler: following redirect to " + target.host + ":" + std::to_string(target.port) + target.path);
+    breakerKey = CircuitBreaker::makeKey(target.host, target.port);
+    if (!CircuitBreaker::instance().allow(breakerKey)) {
+        LOG_ERROR("ConnectionHandler: redirect target " + breakerKey + " is unavailable");
+        fail("HTTP/1.0 503 Service Unavailable\r\n\r\nUpstream server is temporarily unavailable.\r\n");
+        return false;
+    }
+
+    // Ответ последнего шага - ответ на его URL: под этим ключом он и попадёт в кеш
+    if (!cacheKey.empty()) cacheKey = ResponseCache::makeKey(target.host, target.port, target.path);
+    request.path = target.path;
+    sendRequest(target.host, target.port);
+    // Тот же сервер - скорее всего, то же соединение, только что возвращённое в пул
+    if (!connectToServer(target.host, target.port)) {
+        LOG_ERROR("ConnectionHandler: Could not connect to redirect location: " + target.host + ":" + std::to_string(target.port));
+        fail("HTTP/1.0 502 Bad Gateway\r\n\r\nCould not connect to upstream server.\r\n");
+        return false;
+    }
+    return true;
+}
+
+ConnectionHandler::Step ConnectionHandler::streamResponse() {
+    static thread_local char buf[kRelayBufferSize];
+    while (true) {
+        if (clientOutPending()) {
+            if (flushToClient() == Step::Blocked) return Step::Blocked;
+            if (state == State::Done) return Step::Progress;
+        }
+        if (pipeBytes > 0) {
+            if (flushPipe() == Step::Blocked) return Step::Blocked;
+            if (state == State::Done) return Step::Progress;
+        }
+        if (bodyDone) {
+            LOG_DEBUG("ConnectionHandler: response relayed, syscalls=" + std::to_string(syscalls) +
+                         " spliced=" + std::to_string(splicedBytes) + " copied=" + std::to_string(copiedBytes));
+            totalResponses.fetch_add(1, std::memory_order_relaxed);
+            totalSyscalls.fetch_add(syscalls, std::memory_order_relaxed);
+            finishCapture();
+            stopLeading(!bodyError);
+            releaseServer();
+            if (compressor && !finishCompression()) {
+                state = State::Done;
+                return Step::Progress;
+            }
+            state = keepClient ? State::FinishResponse : State::Closing;
+            return Step::Progress;
+        }
+
+        size_t spliceLen = spliceLimit();
+        ssize_t n;
+        syscalls++;
+        if (spliceLen > 0) {
+            // Тело идёт сокет сервера -> канал -> сокет клиента, минуя user space
+            n = splice(serverFd, nullptr, pipeFds[1], nullptr, std::min(spliceLen, pipeCapacity),
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                pipeBytes = (size_t)n;
+                splicedBytes += (size_t)n;
+                consumeSpliced((size_t)n);
+                continue;
+            }
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                // Сокеты не поддерживают splice: дальше копируем через буфер
+                LOG_INFO("ConnectionHandler: splice unsupported, falling back to copy");
+                spliceFailed = true;
+                continue;
+            }
         } else {
-            // Если не chunked, попробуем найти Content-Length
-            auto clPos = lowerHeaders.find("content-length:");
-            if (clPos != std::string::npos) {
-                clPos += strlen("content-length:");
-                size_t endLinePos = lowerHeaders.find("\r\n", clPos);
-                if (endLinePos == std::string::npos) endLinePos = lowerHeaders.size();
-                std::string lengthStr = Utils::trim(lowerHeaders.substr(clPos, endLinePos - clPos));
-                try {
-                    contentLength = std::stoul(lengthStr);
-                    haveContentLength = true;
-                } catch (...) {
-                    haveContentLength = false;
-                }
+            n = recv(serverFd, buf, sizeof(buf), 0);
+        }
+        if (n > 0) {
+            if (!relayBody(buf, (size_t)n)) {
+                state = State::Done;
+                return Step::Progress;
             }
+            continue;
         }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && wouldBlock()) {
+            // Сервер замолчал: накопленное в компрессоре клиент получает сейчас, а не с концом тела
+            if (compressPending && !relayCompressed(nullptr, 0, true)) {
+                state = State::Done;
+                return Step::Progress;
+            }
+            return Step::Blocked;
+        }
+
+        if (n < 0 || chunked || haveContentLength) {
+            // Соединение с сервером оборвалось до конца тела
+            LOG_ERROR("ConnectionHandler: Error streaming response body");
+        }
+        upstreamKeepAlive = false;
+        bodyError = bodyError || n < 0 || chunked || haveContentLength;
+        bodyDone = true;
+    }
+}
+
+ConnectionHandler::Step ConnectionHandler::flushToClient() {
+    if (loop.asyncSend()) {
+        // Отправляет цикл; здесь только ответ, который fail() оставил в clientOut
+        if (clientOutPos < clientOut.size()) {
+            loop.send(clientFd, clientOut.data() + clientOutPos, clientOut.size() - clientOutPos);
+            access.bytesOut += clientOut.size() - clientOutPos;
+            clientOut.clear();
+            clientOutPos = 0;
+        }
+        if (loop.sendFailed(clientFd)) {
+            LOG_ERROR("ConnectionHandler: client write error");
+            state = State::Done;
+            return Step::Progress;
+        }
+        return loop.sendPending(clientFd) ? Step::Blocked : Step::Progress;
+    }
+    while (clientOutPos < clientOut.size()) {
+        syscalls++;
+        ssize_t s = send(clientFd, clientOut.data() + clientOutPos, clientOut.size() - clientOutPos, MSG_NOSIGNAL);
+        if (s > 0) {
+            clientOutPos += (size_t)s;
+            access.bytesOut += (uint64_t)s;
+            continue;
+        }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && wouldBlock()) return Step::Blocked;
+        LOG_ERROR("ConnectionHandler: client write error");
+        state = State::Done;
+        return Step::Progress;
     }
+    clientOut.clear();
+    clientOutPos = 0;
+    return Step::Progress;
+}
 
-    send(clientFd, headers.data(), headers.size(), MSG_NOSIGNAL);
+size_t ConnectionHandler::spliceLimit() {
+    if (!useSplice || spliceFailed || capturing || leading || compressor || bodyDone) return 0;
+    size_t limit;
+    if (chunked) {
+        // Через канал идут только данные чанков, разметку разбираем сами
+        limit = chunkState == ChunkState::Data ? chunkRemaining : 0;
+    } else if (haveContentLength) {
+        limit = bodyRemaining;
+    } else {
+        limit = SIZE_MAX;
+    }
+    if (limit < kMinSpliceSize) return 0;
+    if (pipeFds[0] < 0 && !openPipe()) {
+        spliceFailed = true;
+        return 0;
+    }
+    return limit;
+}
+
+bool ConnectionHandler::openPipe() {
+    if (pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        LOG_ERROR("ConnectionHandler: pipe2 failed, falling back to copy");
+        return false;
+    }
+    // Больший канал - меньше переключений между сокетами; лимит ядра может не дать
+    fcntl(pipeFds[1], F_SETPIPE_SZ, kPipeSize);
+    int size = fcntl(pipeFds[1], F_GETPIPE_SZ);
+    pipeCapacity = size > 0 ? (size_t)size : 64 * 1024;
     return true;
 }
 
-bool ConnectionHandler::streamResponse(int serverFd, int clientFd) {
+void ConnectionHandler::closePipe() {
+    for (int &fd : pipeFds) {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    pipeBytes = 0;
+}
+
+ConnectionHandler::Step ConnectionHandler::flushPipe() {
+    while (pipeBytes > 0) {
+        syscalls++;
+        ssize_t s = splice(pipeFds[0], nullptr, clientFd, nullptr, pipeBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (s > 0) {
+            pipeBytes -= (size_t)s;
+            access.bytesOut += (uint64_t)s;
+            continue;
+        }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && wouldBlock()) return Step::Blocked;
+        LOG_ERROR("ConnectionHandler: client write error");
+        // В канале остались чужие байты: следующему ответу он не годится
+        closePipe();
+        state = State::Done;
+        return Step::Progress;
+    }
+    return Step::Progress;
+}
+
+void ConnectionHandler::consumeSpliced(size_t len) {
     if (chunked) {
-        return streamChunkedResponse(serverFd, clientFd);
+        chunkRemaining -= len;
+        if (chunkRemaining == 0) chunkState = ChunkState::DataEnd;
     } else if (haveContentLength) {
-        return streamWithContentLength(serverFd, clientFd, contentLength);
+        bodyRemaining -= len;
+        if (bodyRemaining == 0) bodyDone = true;
+    }
+}
+
+bool ConnectionHandler::relayBody(const char *data, size_t len) {
+    size_t used = consumeBody(data, len);
+    copiedBytes += used;
+    if (used < len) {
+        // После конца ответа пришли лишние байты: соединение нельзя переиспользовать
+        upstreamKeepAlive = false;
+    }
+    // Тело без chunked-разметки: для кеша, ведомых запросов, сжатия и клиента HTTP/1.0
+    const char *plain = chunked ? dechunked.data() : data;
+    size_t plainLen = chunked ? dechunked.size() : used;
+    if (capturing) captureBody.append(plain, plainLen);
+    if (capturing && captureBody.size() > ResponseCache::maxObjectSize()) {
+        capturing = false;
+        captureEntry.reset();
+        std::string().swap(captureBody);
+    }
+    publishBody(plain, plainLen);
+    bool ok;
+    if (compressor) {
+        ok = relayCompressed(plain, plainLen, false);
     } else {
-        return streamRawResponse(serverFd, clientFd);
+        ok = dechunk ? relayToClient(plain, plainLen) : relayToClient(data, used);
     }
+    dechunked.clear();
+    return ok;
+}
+
+bool ConnectionHandler::clientOutPending() const {
+    return clientOutPos < clientOut.size() || (loop.asyncSend() && loop.sendPending(clientFd));
 }
 
-bool ConnectionHandler::streamWithContentLength(int serverFd, int clientFd, size_t length) {
-    char buf[4096];
-    size_t bytesRemaining = length;
-    while (bytesRemaining > 0) {
-        size_t toRead = (bytesRemaining < sizeof(buf)) ? bytesRemaining : sizeof(buf);
-        ssize_t n = recv(serverFd, buf, toRead, 0);
-        if (n <= 0) {
+bool ConnectionHandler::relayToClient(const char *data, size_t len) {
+    if (len == 0) return true;
+    if (loop.asyncSend()) {
+        // Заявка SEND уйдёт в ядро вместе с ожиданием событий, без отдельного send()
+        if (!loop.send(clientFd, data, len)) {
+            LOG_ERROR("ConnectionHandler: client write error");
             return false;
         }
-        bytesRemaining -= (size_t)n;
-
-        size_t totalSent = 0;
-        while ((size_t)totalSent < (size_t)n) {
-            ssize_t s = send(clientFd, buf + totalSent, n - totalSent, MSG_NOSIGNAL);
-            if (s <= 0) return false;
-            totalSent += s;
+        access.bytesOut += len;
+        return true;
+    }
+    if (clientOutPos < clientOut.size()) {
+        clientOut.append(data, len);
+        return true;
+    }
+    size_t sent = 0;
+    while (sent < len) {
+        syscalls++;
+        ssize_t s = send(clientFd, data + sent, len - sent, MSG_NOSIGNAL);
+        if (s > 0) {
+            sent += (size_t)s;
+            access.bytesOut += (uint64_t)s;
+            continue;
         }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && wouldBlock()) break;
+        LOG_ERROR("ConnectionHandler: client write error");
+        return false;
     }
+    clientOut.assign(data + sent, len - sent);
+    clientOutPos = 0;
     return true;
 }
 
-bool ConnectionHandler::streamRawResponse(int serverFd, int clientFd) {
-    char buf[4096];
-    ssize_t n;
-    while ((n = recv(serverFd, buf, sizeof(buf), 0)) > 0) {
-        ssize_t totalSent = 0;
-        while (totalSent < n) {
-            ssize_t s = send(clientFd, buf + totalSent, n - totalSent, MSG_NOSIGNAL);
-            if (s <= 0) return false;
-            totalSent += s;
+void ConnectionHandler::fail(const std::string &response) {
+    setAccessStatus(response.data(), response.size());
+    closeServer();
+    stopLeading(false);
+    clientOut.append(response);
+    state = State::Closing;
+}
+
+std::string ConnectionHandler::rewriteResponseHeaders(const std::string &headers) {
+    std::string out;
+    if (compressor) {
+        // Длина и диапазоны относятся к несжатому телу, а сильный ETag - к его точным байтам
+        out = Utils::stripHeaders(headers, {"transfer-encoding", "content-length", "accept-ranges", "etag"});
+        std::string etag;
+        if (Utils::findHeader(headers, "etag", etag)) {
+            out += etag.compare(0, 2, "W/") == 0 ? "ETag: " + etag + "\r\n" : "ETag: W/" + etag + "\r\n";
         }
+        out += "Content-Encoding: ";
+        out += Compressor::name(compressor->encoding());
+        out += "\r\nVary: Accept-Encoding\r\n";
+        if (!clientHttp10) out += "Transfer-Encoding: chunked\r\n";
+    } else {
+        out = dechunk ? Utils::stripHeaders(headers, {"transfer-encoding"}) : Utils::stripHeaders(headers, {});
     }
-    return true;
+    out += keepClient ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    return out;
 }
 
-bool ConnectionHandler::streamChunkedResponse(int serverFd, int clientFd) {
-    while (true) {
-        std::string sizeLine;
-        char c;
-        bool lineDone = false;
-        while (!lineDone) {
-            ssize_t r = recv(serverFd, &c, 1, MSG_NOSIGNAL);
-            if (r <= 0) return false;
-            if (c == '\n') {
-                lineDone = true;
-            }
-            sizeLine.push_back(c);
-        }
+void ConnectionHandler::startCompression(const std::string &headers, int status) {
+    if (!CompressorPool::enabled() || status != 200 || bodyDone) return;
+    const std::pmr::string *accept = request.header("accept-encoding");
+    if (!accept) return;
+    auto encoding = CompressorPool::choose(*accept, headers, haveContentLength, contentLength);
+    if (encoding == Compressor::Encoding::None) return;
+    compressor = CompressorPool::local().acquire(encoding);
+    compressPending = false;
+}
+
+bool ConnectionHandler::relayCompressed(const char *data, size_t len, bool flush) {
+    compressOut.clear();
+    // Место под строку размера чанка: дописывается перед данными без лишнего копирования
+    constexpr size_t kChunkHeader = 18;
+    if (!clientHttp10) compressOut.resize(kChunkHeader);
+    size_t start = compressOut.size();
+    if (!compressor->write(data, len, flush, compressOut)) {
+        LOG_ERROR("ConnectionHandler: compression failed");
+        stopCompression();
+        return false;
+    }
+    compressPending = !flush && (compressPending || len > 0);
+    size_t produced = compressOut.size() - start;
+    CompressorPool::stats().bytesIn.fetch_add(len, std::memory_order_relaxed);
+    CompressorPool::stats().bytesOut.fetch_add(produced, std::memory_order_relaxed);
+    if (produced == 0) return true;
+    if (clientHttp10) return relayToClient(compressOut.data(), compressOut.size());
+
+    char sizeLine[kChunkHeader];
+    int n = snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", produced);
+    size_t offset = kChunkHeader - (size_t)n;
+    memcpy(&compressOut[offset], sizeLine, (size_t)n);
+    compressOut += "\r\n";
+    return relayToClient(compressOut.data() + offset, compressOut.size() - offset);
+}
+
+bool ConnectionHandler::finishCompression() {
+    if (bodyError) {
+        // Оборванное тело не завершаем: без последнего чанка клиент увидит, что ответ неполный
+        keepClient = false;
+        stopCompression();
+        return true;
+    }
+    compressOut.clear();
+    bool ok = compressor->finish(compressOut);
+    CompressorPool::stats().bytesOut.fetch_add(compressOut.size(), std::memory_order_relaxed);
+    CompressorPool::stats().responses.fetch_add(1, std::memory_order_relaxed);
+    stopCompression();
+    if (!ok) {
+        LOG_ERROR("ConnectionHandler: compression failed");
+        return false;
+    }
+    if (clientHttp10) return relayToClient(compressOut.data(), compressOut.size());
+    std::string tail;
+    if (!compressOut.empty()) {
+        char sizeLine[32];
+        int n = snprintf(sizeLine, sizeof(sizeLine), "%zx\r\n", compressOut.size());
+        tail.append(sizeLine, (size_t)n);
+        tail += compressOut;
+        tail += "\r\n";
+    }
+    tail += "0\r\n\r\n";
+    return relayToClient(tail.data(), tail.size());
+}
+
+void ConnectionHandler::stopCompression() {
+    if (!compressor) return;
+    CompressorPool::local().release(std::move(compressor));
+    compressPending = false;
+}
+
+bool ConnectionHandler::retryFresh() {
+    if (!serverReused) return false;
+    LOG_DEBUG("ConnectionHandler: pooled connection to " + upstreamHost + " is stale, reconnecting");
+    closeServer();
+    serverOutPos = 0;
+    serverIn.clear();
+    return connectToServer(upstreamHost, upstreamPort, false);
+}
+
+void ConnectionHandler::releaseServer() {
+    if (serverFd < 0) return;
+    if (!upstreamKeepAlive || !UpstreamPool::enabled()) {
+        closeServer();
+        return;
+    }
+    loop.remove(serverFd);
+    UpstreamPool::local().release(upstreamHost, upstreamPort, serverFd);
+    serverFd = -1;
+}
+
+void ConnectionHandler::startServeCached(std::shared_ptr<const CachedResponse> entry) {
+    cachedEntry = std::move(entry);
+    cachedPos = 0;
+    setAccessStatus(cachedEntry->data->data(), cachedEntry->headerSize);
+    auto age = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - cachedEntry->storedAt).count();
+    std::string suffix = "Age: " + std::to_string(age) + "\r\n" +
+                         (keepClient ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    if (!relayToClient(cachedEntry->data->data(), cachedEntry->headerSize) ||
+        !relayToClient(suffix.data(), suffix.size())) {
+        state = State::Done;
+        return;
+    }
+    state = State::ServeCached;
+}
 
-        sizeLine = Utils::trim(sizeLine);
-        if (sizeLine.empty()) {
-            // Пустая строка между чанками, продолжаем
+ConnectionHandler::Step ConnectionHandler::serveCached() {
+    if (clientOutPending()) {
+        if (flushToClient() == Step::Blocked) return Step::Blocked;
+        if (state == State::Done) return Step::Progress;
+    }
+    // Тело отправляется прямо из буфера записи кеша
+    while (cachedPos < cachedEntry->bodySize()) {
+        ssize_t s = send(clientFd, cachedEntry->body() + cachedPos, cachedEntry->bodySize() - cachedPos, MSG_NOSIGNAL);
+        if (s > 0) {
+            cachedPos += (size_t)s;
+            access.bytesOut += (uint64_t)s;
             continue;
         }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && wouldBlock()) return Step::Blocked;
+        LOG_ERROR("ConnectionHandler: client write error");
+        state = State::Done;
+        return Step::Progress;
+    }
+    cachedEntry.reset();
+    state = keepClient ? State::FinishResponse : State::Closing;
+    return Step::Progress;
+}
 
-        int chunkSize = 0;
-        {
-            std::istringstream iss(sizeLine);
-            iss >> std::hex >> chunkSize;
-            if (iss.fail()) return false;
-        }
+void ConnectionHandler::finishCapture() {
+    if (capturing && !bodyError) {
+        ResponseCache::instance().store(cacheKey, std::move(captureEntry), std::move(captureBody));
+    }
+    capturing = false;
+    captureEntry.reset();
+    captureBody.clear();
+}
 
-        if (chunkSize == 0) {
-            // Читаем трейлеры (игнорируем) до \r\n
-            std::string trailerLine;
-            while (true) {
-                char c2;
-                ssize_t r2 = recv(serverFd, &c2, 1, 0);
-                if (r2 <= 0) break;
-                trailerLine.push_back(c2);
-                if (trailerLine.size() >= 2 && trailerLine.substr(trailerLine.size()-2) == "\r\n") {
-                    break;
-                }
-            }
-            return true;
-        }
+bool ConnectionHandler::wantsKeepAlive(const HttpRequest &req) const {
+    // Тело у GET не поддерживаем: после такого запроса границы следующего неизвестны
+    if (req.header("content-length") || req.header("transfer-encoding")) {
+        return false;
+    }
+    const std::pmr::string *connection = req.header("connection");
+    if (!connection) connection = req.header("proxy-connection");
+    std::string_view value = connection ? std::string_view(*connection) : std::string_view();
+    if (req.version == "HTTP/1.1") {
+        return !containsToken(value, "close");
+    }
+    return containsToken(value, "keep-alive");
+}
 
-        int bytesToRead = chunkSize;
-        char buf[4096];
-        while (bytesToRead > 0) {
-            int toRead = (bytesToRead < (int)sizeof(buf)) ? bytesToRead : (int)sizeof(buf);
-            ssize_t n = recv(serverFd, buf, toRead, 0);
-            if (n <= 0) return false;
-            bytesToRead -= (int)n;
+void ConnectionHandler::resetForNextRequest() {
+    // Запрос отвязывается от арены до её сброса. Именно перемещением: присваивание
+    // пустого запроса оставило бы длинным строкам их буферы в арене, и следующий запрос
+    // писал бы в память, которую reset() уже отдал под другие выделения
+    {
+        HttpRequest finished(std::move(request));
+    }
+    arena.reset();
+    redirectCount = 0;
+    clientHttp10 = false;
+    dechunk = false;
+    dechunked.clear();
+    stopCompression();
+    serverIn.clear();
+    cacheKey.clear();
+    cachedEntry.reset();
+    cachedPos = 0;
+    captureEntry.reset();
+    captureBody.clear();
+    capturing = false;
+    leaveInflight();
+    stopLeading(false);
+    coalesceKey.clear();
+    requestsServed++;
+}
+
+void ConnectionHandler::armIdleTimer() {
+    if (idleTimer != 0) return;
+    idleTimer = loop.addTimer(keepAliveTimeout, [this] {
+        idleTimer = 0;
+        if (state != State::ReadRequest) return;
+        LOG_DEBUG("ConnectionHandler: idle timeout, closing client fd=" + std::to_string(clientFd));
+        state = State::Done;
+        drive();
+    });
+}
+
+void ConnectionHandler::cancelIdleTimer() {
+    if (idleTimer == 0) return;
+    loop.cancelTimer(idleTimer);
+    idleTimer = 0;
+}
+
+bool ConnectionHandler::waitingForClient() const {
+    return clientOutPending() || pipeBytes > 0;
+}
+
+std::chrono::steady_clock::time_point ConnectionHandler::nextDeadline() const {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point deadline = Clock::time_point::max();
+    auto limit = [&deadline](Clock::time_point from, std::chrono::milliseconds timeout) {
+        if (timeout.count() > 0) deadline = std::min(deadline, from + timeout);
+    };
+    switch (state) {
+        case State::Connecting:
+            limit(connectStart, connectTimeout);
+            break;
+        case State::SendRequest:
+            limit(lastActivity, writeTimeout);
+            break;
+        case State::ReadHeaders:
+        case State::SkipRedirectBody:
+            limit(lastActivity, readTimeout);
+            break;
+        case State::StreamBody:
+            limit(lastActivity, waitingForClient() ? writeTimeout : readTimeout);
+            break;
+        default:
+            // Обмена с сервером нет
+            return Clock::time_point::max();
+    }
+    limit(exchangeStart, totalTimeout);
+    return deadline;
+}
+
+void ConnectionHandler::armDeadlineTimer() {
+    cancelDeadlineTimer();
+    auto deadline = nextDeadline();
+    if (deadline == std::chrono::steady_clock::time_point::max()) return;
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    delay = std::min(delay + std::chrono::milliseconds(1), deadlineCheckInterval);
+    deadlineTimer = loop.addTimer(std::max(delay, std::chrono::milliseconds(1)), [this] {
+        deadlineTimer = 0;
+        checkDeadlines();
+    });
+}
+
+void ConnectionHandler::cancelDeadlineTimer() {
+    if (deadlineTimer == 0) return;
+    loop.cancelTimer(deadlineTimer);
+    deadlineTimer = 0;
+}
 
-            ssize_t totalSent = 0;
-            while (totalSent < n) {
-                ssize_t s = send(clientFd, buf + totalSent, n - totalSent, MSG_NOSIGNAL);
-                if (s <= 0) return false;
-                totalSent += s;
+void ConnectionHandler::checkDeadlines() {
+    // Таймер не переставляется на каждом событии: срок пересчитывается, когда он срабатывает
+    auto deadline = nextDeadline();
+    if (deadline == std::chrono::steady_clock::time_point::max()) return;
+    if (std::chrono::steady_clock::now() < deadline) {
+        armDeadlineTimer();
+        return;
+    }
+
+    std::string target = upstreamHost + ":" + std::to_string(upstreamPort);
+    access.flags |= AccessRecord::TimedOut;
+    switch (state) {
+        case State::Connecting:
+            LOG_ERROR("ConnectionHandler: connect to " + target + " timed out");
+            CircuitBreaker::instance().failure(breakerKey);
+            connectFailed(true);
+            break;
+        case State::SendRequest:
+        case State::ReadHeaders:
+        case State::SkipRedirectBody:
+            LOG_ERROR("ConnectionHandler: " + target + " did not respond in time");
+            CircuitBreaker::instance().failure(breakerKey);
+            fail("HTTP/1.0 504 Gateway Timeout\r\n\r\nUpstream server did not respond in time.\r\n");
+            break;
+        default: {
+            // Заголовки уже у клиента: остаётся только оборвать ответ
+            const char *reason = waitingForClient() ? "client write" : "server read";
+            if (totalTimeout.count() > 0 && std::chrono::steady_clock::now() >= exchangeStart + totalTimeout) {
+                reason = "request";
             }
+            LOG_ERROR("ConnectionHandler: response from " + target + " stalled (" + reason + " timeout)");
+            bodyError = true;
+            capturing = false;
+            captureEntry.reset();
+            closeServer();
+            stopLeading(false);
+            state = State::Done;
+            break;
         }
+    }
+    drive();
+}
+
+void ConnectionHandler::closeServer() {
+    if (serverFd >= 0) {
+        loop.remove(serverFd);
+        close(serverFd);
+        serverFd = -1;
+    }
+}
 
-        // Читаем завершающую \r\n после чанка
-        std::string endLine;
-        while (true) {
-            char c3;
-            ssize_t r3 = recv(serverFd, &c3, 1, 0);
-            if (r3 <= 0) return false;
-            endLine.push_back(c3);
-            if (endLine.size() >= 2 && endLine.substr(endLine.size()-2) == "\r\n") {
+size_t ConnectionHandler::consumeBody(const char *data, size_t len) {
+    if (bodyDone) return 0;
+    if (chunked) return consumeChunked(data, len);
+    if (haveContentLength) {
+        size_t n = std::min(len, bodyRemaining);
+        bodyRemaining -= n;
+        if (bodyRemaining == 0) bodyDone = true;
+        return n;
+    }
+    return len;
+}
+
+size_t ConnectionHandler::consumeChunked(const char *data, size_t len) {
+    size_t i = 0;
+    while (i < len && !bodyDone) {
+        switch (chunkState) {
+            case ChunkState::Size:
+            case ChunkState::Trailer: {
+                const char *nl = static_cast<const char*>(memchr(data + i, '\n', len - i));
+                size_t end = nl ? (size_t)(nl - data) : len;
+                if (!nl || !chunkLine.empty()) {
+                    chunkLine.append(data + i, end - i);
+                }
+                if (!nl) {
+                    i = end;
+                    if (chunkLine.size() > 4096) {
+                        LOG_ERROR("ConnectionHandler: chunk line too long");
+                        upstreamKeepAlive = false;
+                        bodyError = true;
+                        bodyDone = true;
+                    }
+                    break;
+                }
+                // Строка целиком в data разбирается на месте, без копии в chunkLine
+                std::string_view line = chunkLine.empty() ? trimView(data, i, end)
+                                                          : trimView(chunkLine.data(), 0, chunkLine.size());
+                i = end + 1; // '\n'
+                if (chunkState == ChunkState::Trailer) {
+                    // Трейлеры игнорируем, пустая строка завершает тело
+                    chunkLine.clear();
+                    if (line.empty()) bodyDone = true;
+                    break;
+                }
+                if (line.empty()) {
+                    chunkLine.clear();
+                    break;
+                }
+
+                uint64_t chunkSize = 0;
+                bool valid = HeaderScan::parseHex(line.data(), line.size(), chunkSize);
+                chunkLine.clear();
+                if (!valid) {
+                    LOG_ERROR("ConnectionHandler: invalid chunk size");
+                    upstreamKeepAlive = false;
+                    bodyError = true;
+                    bodyDone = true;
+                    break;
+                }
+                if (chunkSize == 0) {
+                    chunkState = ChunkState::Trailer;
+                } else {
+                    chunkRemaining = chunkSize;
+                    chunkState = ChunkState::Data;
+                }
+                break;
+            }
+            case ChunkState::Data: {
+                size_t take = std::min(chunkRemaining, len - i);
+                if (dechunk || capturing || leading || compressor) dechunked.append(data + i, take);
+                i += take;
+                chunkRemaining -= take;
+                if (chunkRemaining == 0) chunkState = ChunkState::DataEnd;
                 break;
             }
+            case ChunkState::DataEnd:
+                // Завершающая \r\n после данных чанка
+                if (data[i] == '\n') chunkState = ChunkState::Size;
+                i++;
+                break;
         }
     }
-
-    return true;
-}
\ No newline at end of file
+    return i;
+}
@@ -0,0 +1,333 @@
+#include "dns_resolver.hpp"
+#include "logger.hpp"
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <resolv.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+int DnsResolver::numThreads = 2;
+std::string DnsResolver::serverAddr;
+
+namespace {
+    constexpr std::chrono::seconds kMinTtl{1};
+    constexpr std::chrono::seconds kMaxTtl{300};
+    // Срок для отрицательных ответов и для адресов, полученных не из DNS (нет TTL)
+    constexpr std::chrono::seconds kNegativeTtl{5};
+    constexpr std::chrono::seconds kFallbackTtl{30};
+
+    std::string toLower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
+    }
+
+    bool parseNumeric(const std::string &host, ResolvedAddress &out) {
+        std::memset(&out, 0, sizeof(out));
+        auto *in4 = reinterpret_cast<sockaddr_in*>(&out.addr);
+        if (inet_pton(AF_INET, host.c_str(), &in4->sin_addr) == 1) {
+            in4->sin_family = AF_INET;
+            out.len = sizeof(sockaddr_in);
+            return true;
+        }
+        // IPv6 в URL записывается в квадратных скобках
+        std::string bare = host.size() > 2 && host.front() == '[' && host.back() == ']'
+                           ? host.substr(1, host.size() - 2) : host;
+        auto *in6 = reinterpret_cast<sockaddr_in6*>(&out.addr);
+        if (inet_pton(AF_INET6, bare.c_str(), &in6->sin6_addr) == 1) {
+            in6->sin6_family = AF_INET6;
+            out.len = sizeof(sockaddr_in6);
+            return true;
+        }
+        return false;
+    }
+
+    // Запрос одного типа записей; false - ответа нет, herr - причина
+    bool query(res_state st, const std::string &host, int type, std::vector<ResolvedAddress> &out,
+               uint32_t &minTtl, int &herr) {
+        unsigned char answer[4096];
+        int len = res_nsearch(st, host.c_str(), ns_c_in, type, answer, sizeof(answer));
+        if (len < 0) {
+            herr = st->res_h_errno;
+            return false;
+        }
+        ns_msg msg;
+        if (ns_initparse(answer, len, &msg) < 0) {
+            herr = NO_RECOVERY;
+            return false;
+        }
+        bool found = false;
+        for (int i = 0; i < ns_msg_count(msg, ns_s_an); i++) {
+            ns_rr rr;
+            if (ns_parserr(&msg, ns_s_an, i, &rr) < 0) break;
+            if (ns_rr_type(rr) != type) continue; // CNAME и прочее
+            ResolvedAddress addr;
+            std::memset(&addr, 0, sizeof(addr));
+            if (type == ns_t_a && ns_rr_rdlen(rr) == 4) {
+                auto *in4 = reinterpret_cast<sockaddr_in*>(&addr.addr);
+                in4->sin_family = AF_INET;
+                std::memcpy(&in4->sin_addr, ns_rr_rdata(rr), 4);
+                addr.len = sizeof(sockaddr_in);
+            } else if (type == ns_t_aaaa && ns_rr_rdlen(rr) == 16) {
+                auto *in6 = reinterpret_cast<sockaddr_in6*>(&addr.addr);
+                in6->sin6_family = AF_INET6;
+                std::memcpy(&in6->sin6_addr, ns_rr_rdata(rr), 16);
+                addr.len = sizeof(sockaddr_in6);
+            } else {
+                continue;
+            }
+            out.push_back(addr);
+            minTtl = std::min(minTtl, (uint32_t)ns_rr_ttl(rr));
+            found = true;
+        }
+        if (!found) herr = NO_DATA;
+        return found;
+    }
+}
+
+DnsResolver &DnsResolver::instance() {
+    static DnsResolver resolver;
+    return resolver;
+}
+
+void DnsResolver::configure(int threads, const std::string &server) {
+    numThreads = std::max(1, threads);
+    serverAddr = server;
+}
+
+bool DnsResolver::start() {
+    loadHosts();
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(&DnsResolver::workerFunc, this);
+    }
+    return true;
+}
+
+void DnsResolver::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        stopping = true;
+    }
+    queueCv.notify_all();
+    for (auto &t : workers) {
+        if (t.joinable()) t.join();
+    }
+    workers.clear();
+}
+
+DnsResolver::Shard &DnsResolver::shardFor(const std::string &host) {
+    return shards[std::hash<std::string>()(host) % kShards];
+}
+
+std::shared_ptr<const DnsResult> DnsResolver::lookupCached(const std::string &rawHost) {
+    ResolvedAddress numeric;
+    if (parseNumeric(rawHost, numeric)) {
+        auto result = std::make_shared<DnsResult>();
+        result->ok = true;
+        result->addresses.push_back(numeric);
+        return result;
+    }
+    std::string host = toLower(rawHost);
+    Shard &shard = shardFor(host);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.entries.find(host);
+    if (it != shard.entries.end() && it->second.result && std::chrono::steady_clock::now() < it->second.expires) {
+        counters.hits.fetch_add(1, std::memory_order_relaxed);
+        return it->second.result;
+    }
+    return nullptr;
+}
+
+void DnsResolver::resolve(const std::string &rawHost, EventLoop &loop, std::weak_ptr<void> owner, Callback callback) {
+    std::string host = toLower(rawHost);
+    Shard &shard = shardFor(host);
+    {
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        if (shard.entries.size() >= kMaxShardEntries && !shard.entries.count(host)) evict(shard);
+        Entry &entry = shard.entries[host];
+        if (entry.result && std::chrono::steady_clock::now() < entry.expires) {
+            // Результат появился, пока вызывающий проверял кеш
+            counters.hits.fetch_add(1, std::memory_order_relaxed);
+            auto result = entry.result;
+            loop.post([owner, callback, result] {
+                if (!owner.expired()) callback(result);
+            });
+            return;
+        }
+        entry.waiters.push_back({&loop, std::move(owner), std::move(callback)});
+        if (entry.pending) {
+            counters.coalesced.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        entry.pending = true;
+    }
+    counters.misses.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(queueMtx);
+        queue.push_back(host);
+    }
+    queueCv.notify_one();
+}
+
+void DnsResolver::evict(Shard &shard) {
+    auto now = std::chrono::steady_clock::now();
+    size_t before = shard.entries.size();
+    // Разрешаемые сейчас записи держат ожидающих, их не трогаем
+    std::erase_if(shard.entries, [now](const auto &item) {
+        return !item.second.pending && now >= item.second.expires;
+    });
+    // Все записи свежие: убираем восьмую часть ближайших к истечению, чтобы следующие
+    // вставки не проходили шард заново
+    size_t target = kMaxShardEntries - kMaxShardEntries / 8;
+    if (shard.entries.size() > target) {
+        std::vector<std::pair<std::chrono::steady_clock::time_point, const std::string *>> order;
+        order.reserve(shard.entries.size());
+        for (const auto &item : shard.entries) {
+            if (!item.second.pending) order.emplace_back(item.second.expires, &item.first);
+        }
+        size_t drop = std::min(order.size(), shard.entries.size() - target);
+        std::nth_element(order.begin(), order.begin() + drop, order.end());
+        std::vector<std::string> victims;
+        victims.reserve(drop);
+        for (size_t i = 0; i < drop; i++) victims.push_back(*order[i].second);
+        for (const std::string &host : victims) shard.entries.erase(host);
+    }
+    counters.evicted.fetch_add(before - shard.entries.size(), std::memory_order_relaxed);
+}
+
+void DnsResolver::workerFunc() {
+    struct __res_state st;
+    std::memset(&st, 0, sizeof(st));
+    if (res_ninit(&st) != 0) {
+        LOG_ERROR("DnsResolver: res_ninit failed");
+    }
+    if (!serverAddr.empty()) {
+        // Свой сервер имён вместо перечисленных в /etc/resolv.conf
+        std::string ip = serverAddr;
+        int port = 53;
+        size_t colon = serverAddr.rfind(':');
+        if (colon != std::string::npos && serverAddr.find(':') == colon) {
+            ip = serverAddr.substr(0, colon);
+            port = std::atoi(serverAddr.c_str() + colon + 1);
+        }
+        sockaddr_in ns{};
+        ns.sin_family = AF_INET;
+        ns.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, ip.c_str(), &ns.sin_addr) == 1) {
+            st.nsaddr_list[0] = ns;
+            st.nscount = 1;
+        } else {
+            LOG_ERROR("DnsResolver: invalid DNS server address " + serverAddr);
+        }
+    }
+
+    while (true) {
+        std::string host;
+        {
+            std::unique_lock<std::mutex> lock(queueMtx);
+            queueCv.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) break;
+            host = std::move(queue.front());
+            queue.pop_front();
+        }
+        std::chrono::seconds ttl;
+        auto result = lookup(&st, host, ttl);
+        complete(host, std::move(result), ttl);
+    }
+    res_nclose(&st);
+}
+
+std::shared_ptr<const DnsResult> DnsResolver::lookup(void *state, const std::string &host, std::chrono::seconds &ttl) {
+    auto result = std::make_shared<DnsResult>();
+    auto h = hosts.find(host);
+    if (h != hosts.end()) {
+        result->ok = true;
+        result->addresses = h->second;
+        ttl = kFallbackTtl;
+        return result;
+    }
+
+    res_state st = static_cast<res_state>(state);
+    uint32_t minTtl = UINT32_MAX;
+    int herr6 = 0, herr4 = 0;
+    query(st, host, ns_t_aaaa, result->addresses, minTtl, herr6);
+    query(st, host, ns_t_a, result->addresses, minTtl, herr4);
+    if (!result->addresses.empty()) {
+        result->ok = true;
+        ttl = std::min(kMaxTtl, std::max(kMinTtl, std::chrono::seconds(minTtl)));
+        return result;
+    }
+    if (herr4 == HOST_NOT_FOUND || (herr4 == NO_DATA && herr6 == NO_DATA)) {
+        // Сервер имён ответил, что адресов нет: запоминаем отказ ненадолго
+        result->error = "host not found";
+        ttl = kNegativeTtl;
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+        return result;
+    }
+
+    // DNS недоступен: системный резолвер может знать имя из других источников (nsswitch)
+    struct addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int rc = getaddrinfo(host.c_str(), nullptr, &hints, &res);
+    if (rc == 0) {
+        for (auto *ai = res; ai; ai = ai->ai_next) {
+            ResolvedAddress addr;
+            std::memset(&addr, 0, sizeof(addr));
+            std::memcpy(&addr.addr, ai->ai_addr, ai->ai_addrlen);
+            addr.len = ai->ai_addrlen;
+            result->addresses.push_back(addr);
+        }
+        freeaddrinfo(res);
+        result->ok = true;
+        ttl = kFallbackTtl;
+        return result;
+    }
+    result->error = gai_strerror(rc);
+    ttl = kNegativeTtl;
+    counters.failures.fetch_add(1, std::memory_order_relaxed);
+    return result;
+}
+
+void DnsResolver::complete(const std::string &host, std::shared_ptr<const DnsResult> result, std::chrono::seconds ttl) {
+    std::vector<Waiter> waiters;
+    {
+        Shard &shard = shardFor(host);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        Entry &entry = shard.entries[host];
+        entry.result = result;
+        entry.expires = std::chrono::steady_clock::now() + ttl;
+        entry.pending = false;
+        waiters.swap(entry.waiters);
+    }
+    if (!result->ok) {
+        LOG_ERROR("DnsResolver: cannot resolve " + host + ": " + result->error);
+    }
+    for (auto &w : waiters) {
+        auto owner = std::move(w.owner);
+        auto callback = std::move(w.callback);
+        w.loop->post([owner, callback, result] {
+            if (!owner.expired()) callback(result);
+        });
+    }
+}
+
+void DnsResolver::loadHosts() {
+    std::ifstream in("/etc/hosts");
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream iss(line);
+        std::string ip, name;
+        if (!(iss >> ip)) continue;
+        ResolvedAddress addr;
+        if (!parseNumeric(ip, addr)) continue;
+        while (iss >> name) {
+            hosts[toLower(name)].push_back(addr);
+        }
+    }
+}
@@ -0,0 +1,507 @@
+#include "event_loop.hpp"
+#include "logger.hpp"
+#include "uring.hpp"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+
+namespace {
+    constexpr int kMaxEvents = 256;
+    constexpr unsigned kRingEntries = 256;
+    // user_data заявок отмены: их завершения не нужны
+    constexpr uint64_t kCancelTag = ~0ull;
+    // user_data заявки: поколение регистрации, признаки accept и send, номер fd
+    constexpr uint64_t kAcceptBit = 1ull << 31;
+    constexpr uint64_t kSendBit = 1ull << 30;
+    constexpr uint64_t kFdMask = kSendBit - 1;
+
+    uint64_t requestTag(int fd, uint32_t generation, bool accepting) {
+        return (uint64_t)generation << 32 | (accepting ? kAcceptBit : 0) | (uint32_t)fd;
+    }
+
+    std::atomic<EventLoop::Engine> configuredEngine{EventLoop::Engine::Epoll};
+    // Сколько раз перепроверить работу после выполненных задач, прежде чем заснуть
+    constexpr int kIdleSpinRounds = 32;
+
+    thread_local EventLoop *currentLoop = nullptr;
+
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+}
+
+EventLoop::EventLoop() = default;
+
+EventLoop::~EventLoop() {
+    // Сначала уничтожаем обработчики: их деструкторы снимают fd с epoll
+    retired.clear();
+    owned.clear();
+    if (wakeFd >= 0) close(wakeFd);
+    if (epfd >= 0) close(epfd);
+}
+
+EventLoop::Engine EventLoop::configure(Engine engine) {
+    if (engine == Engine::Uring && !Uring::supported()) {
+        LOG_INFO("EventLoop: io_uring is not available in this kernel, using epoll");
+        engine = Engine::Epoll;
+    }
+    configuredEngine = engine;
+    return engine;
+}
+
+bool EventLoop::parseEngine(const std::string &name, Engine &engine) {
+    if (name == "epoll") {
+        engine = Engine::Epoll;
+    } else if (name == "uring" || name == "io_uring") {
+        engine = Engine::Uring;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::init() {
+    if (configuredEngine == Engine::Uring) {
+        ring = std::make_unique<Uring>();
+        if (!ring->init(kRingEntries)) {
+            // Например, не хватает RLIMIT_MEMLOCK на старом ядре
+            LOG_ERROR("EventLoop: cannot set up io_uring, falling back to epoll");
+            ring.reset();
+        }
+    }
+    if (!ring) {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+            LOG_ERROR("EventLoop: epoll_create1 failed");
+            return false;
+        }
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        LOG_ERROR("EventLoop: eventfd failed");
+        return false;
+    }
+    if (!add(wakeFd, EPOLLIN, nullptr)) {
+        LOG_ERROR("EventLoop: cannot register wakeup fd");
+        return false;
+    }
+    return true;
+}
+
+EventLoop *EventLoop::current() {
+    return currentLoop;
+}
+
+void EventLoop::run() {
+    currentLoop = this;
+    while (!(stopRequested && owned.empty())) {
+        int timeout = waitTimeoutMs();
+        if (!(ring ? waitUring(timeout) : waitEpoll(timeout))) break;
+        runTimers();
+        retired.clear();
+    }
+}
+
+bool EventLoop::waitEpoll(int timeout) {
+    epoll_event events[kMaxEvents];
+    int n = epoll_wait(epfd, events, kMaxEvents, timeout);
+    if (idleWork && timeout != 0) idleWork->unparked();
+    if (n < 0) {
+        if (errno == EINTR) return true;
+        LOG_ERROR("EventLoop: epoll_wait failed");
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        int fd = events[i].data.fd;
+        if (fd == wakeFd) {
+            drainWakeup();
+            continue;
+        }
+        if (fd < (int)watches.size() && watches[fd].handler) {
+            watches[fd].handler->onEvent(fd, events[i].events);
+        }
+    }
+    return true;
+}
+
+bool EventLoop::waitUring(int timeout) {
+    // Регистрации, отмены и отправки, накопленные за прошлый проход, уходят вместе с ожиданием
+    submitSends();
+    bool ok = ring->submitAndWait(timeout);
+    if (idleWork && timeout != 0) idleWork->unparked();
+    if (!ok) return false;
+    ring->forEachCompletion([this](const io_uring_cqe &cqe) { onCompletion(cqe); });
+    return true;
+}
+
+void EventLoop::onCompletion(const io_uring_cqe &cqe) {
+    if (cqe.user_data == kCancelTag) return;
+    if (cqe.user_data & kSendBit) {
+        onSendCompletion(cqe);
+        return;
+    }
+    int fd = (int)(cqe.user_data & kFdMask);
+    uint32_t generation = (uint32_t)(cqe.user_data >> 32);
+    if (fd >= (int)watches.size() || watches[fd].generation != generation) {
+        // Соединение, принятое уже снятой заявкой, никому не достанется
+        if ((cqe.user_data & kAcceptBit) && cqe.res >= 0) close(cqe.res);
+        return;
+    }
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (fd == wakeFd) {
+        drainWakeup();
+    } else if (watches[fd].accepting) {
+        if (cqe.res >= 0) {
+            watches[fd].handler->onAccepted(fd, cqe.res);
+        } else if (cqe.res == -EINVAL && !more) {
+            // Ядро без многоразового accept (до 5.19): слушаем готовность, accept4() делает обработчик
+            LOG_INFO("EventLoop: multishot accept is not supported, polling listener fd=" + std::to_string(fd));
+            watches[fd].accepting = false;
+            watches[fd].events = EPOLLIN | EPOLLET;
+            arm(fd);
+            watches[fd].handler->onEvent(fd, EPOLLIN);
+            return;
+        } else if (cqe.res == -EMFILE || cqe.res == -ENFILE) {
+            // Соединение осталось в очереди, а перезапущенная заявка упёрлась бы в тот же предел:
+            // обработчик разгружает очередь через accept4() с запасным дескриптором
+            watches[fd].handler->onEvent(fd, EPOLLIN);
+        } else {
+            // Прочие ошибки accept: соединение осталось в очереди, заявка продолжит работу
+            LOG_DEBUG("EventLoop: accept failed on fd=" + std::to_string(fd) + ": " + std::to_string(-cqe.res));
+        }
+    } else if (cqe.res >= 0) {
+        watches[fd].handler->onEvent(fd, (uint32_t)cqe.res);
+    } else {
+        LOG_DEBUG("EventLoop: poll failed on fd=" + std::to_string(fd) + ": " + std::to_string(-cqe.res));
+        watches[fd].handler->onEvent(fd, EPOLLERR);
+        return;
+    }
+    // Многоразовая заявка завершилась (например, при переполнении очереди завершений) -
+    // ставим заново, если обработчик тем временем не снял fd
+    if (!more && fd < (int)watches.size() && watches[fd].generation == generation) arm(fd);
+}
+
+EventLoop::Watch &EventLoop::watch(int fd) {
+    if (fd >= (int)watches.size()) watches.resize(fd + 1);
+    return watches[fd];
+}
+
+bool EventLoop::arm(int fd) {
+    io_uring_sqe *sqe = ring->sqe();
+    if (!sqe) return false;
+    Watch &w = watches[fd];
+    if (w.accepting) {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    } else {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = w.events;
+    }
+    sqe->fd = fd;
+    sqe->user_data = requestTag(fd, w.generation, w.accepting);
+    return true;
+}
+
+void EventLoop::cancel(int fd) {
+    Watch &w = watches[fd];
+    // Заявка держит ссылку на сокет: без отмены он не закроется и после close()
+    cancelRequest(requestTag(fd, w.generation, w.accepting));
+    w.generation++;
+}
+
+void EventLoop::cancelRequest(uint64_t tag) {
+    if (io_uring_sqe *sqe = ring->sqe()) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = tag;
+        sqe->user_data = kCancelTag;
+    }
+}
+
+bool EventLoop::send(int fd, const char *data, size_t len) {
+    Watch &w = watch(fd);
+    if (w.sendFailed) return false;
+    // Пока заявка в ядре, её буфер не трогаем
+    (w.sendTag ? w.outNext : w.out).append(data, len);
+    if (!w.sendTag) scheduleSend(fd);
+    return true;
+}
+
+void EventLoop::scheduleSend(int fd) {
+    Watch &w = watches[fd];
+    if (w.sendQueued) return;
+    w.sendQueued = true;
+    sendReady.push_back(fd);
+}
+
+bool EventLoop::sendPending(int fd) const {
+    if (fd >= (int)watches.size()) return false;
+    const Watch &w = watches[fd];
+    return w.sendTag || w.outPos < w.out.size() || !w.outNext.empty();
+}
+
+bool EventLoop::sendFailed(int fd) const {
+    return fd < (int)watches.size() && watches[fd].sendFailed;
+}
+
+void EventLoop::submitSends() {
+    // Всё, что обработчик дописал за проход, уходит одной заявкой на fd
+    std::vector<int> ready;
+    ready.swap(sendReady);
+    for (int fd : ready) {
+        Watch &w = watches[fd];
+        w.sendQueued = false;
+        if (!w.handler || w.sendTag || w.outPos == w.out.size()) continue;
+        if (!submitSend(fd)) scheduleSend(fd);
+    }
+}
+
+bool EventLoop::submitSend(int fd) {
+    io_uring_sqe *sqe = ring->sqe();
+    if (!sqe) return false;
+    Watch &w = watches[fd];
+    w.sendTag = requestTag(fd, w.generation, false) | kSendBit;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(w.out.data() + w.outPos);
+    sqe->len = (uint32_t)std::min<size_t>(w.out.size() - w.outPos, UINT32_MAX);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = w.sendTag;
+    return true;
+}
+
+void EventLoop::onSendCompletion(const io_uring_cqe &cqe) {
+    auto orphan = orphanSends.find(cqe.user_data);
+    if (orphan != orphanSends.end()) {
+        orphanSends.erase(orphan);
+        return;
+    }
+    int fd = (int)(cqe.user_data & kFdMask);
+    if (fd >= (int)watches.size() || watches[fd].sendTag != cqe.user_data) return;
+    Watch &w = watches[fd];
+    w.sendTag = 0;
+    if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+        scheduleSend(fd);
+        return;
+    }
+    if (cqe.res <= 0) {
+        LOG_DEBUG("EventLoop: send failed on fd=" + std::to_string(fd) + ": " + std::to_string(-cqe.res));
+        w.sendFailed = true;
+        std::string().swap(w.out);
+        std::string().swap(w.outNext);
+        w.outPos = 0;
+        if (w.handler) w.handler->onEvent(fd, EPOLLERR);
+        return;
+    }
+    w.outPos += (size_t)cqe.res;
+    if (w.outPos == w.out.size()) {
+        w.out.clear();
+        w.outPos = 0;
+        w.out.swap(w.outNext);
+    }
+    if (w.outPos < w.out.size()) {
+        // Остаток и дописанное за время заявки уходят со следующим io_uring_enter
+        scheduleSend(fd);
+        return;
+    }
+    if (w.handler) w.handler->onEvent(fd, EPOLLOUT);
+}
+
+void EventLoop::drainWakeup() {
+    uint64_t value;
+    while (read(wakeFd, &value, sizeof(value)) > 0) {}
+    runPosted();
+}
+
+int EventLoop::waitTimeoutMs() {
+    int timeout = nextTimeoutMs();
+    if (!idleWork) return timeout;
+    bool busy = idleWork->runPending();
+    // Только что была работа: вероятно, придёт ещё, засыпать рано
+    for (int i = 0; !busy && idleWorkBusy && i < kIdleSpinRounds; i++) {
+        cpuRelax();
+        busy = idleWork->runPending();
+    }
+    idleWorkBusy = busy;
+    // Задачи могли изменить таймеры или завершить соединения
+    runTimers();
+    retired.clear();
+    if (busy) return 0;
+    timeout = nextTimeoutMs();
+    if (timeout != 0 && !idleWork->prepareToPark()) return 0;
+    return timeout;
+}
+
+void EventLoop::stop() {
+    post([this] { beginShutdown(); });
+}
+
+void EventLoop::beginShutdown() {
+    if (stopRequested) return;
+    stopRequested = true;
+    std::vector<EventHandler*> active;
+    active.reserve(owned.size());
+    for (auto &entry : owned) active.push_back(entry.first);
+    for (auto *handler : active) {
+        // Обработчик мог быть удалён из owned предыдущим onShutdown()
+        if (owned.count(handler)) handler->onShutdown();
+    }
+}
+
+bool EventLoop::add(int fd, uint32_t events, EventHandler *handler) {
+    Watch &w = watch(fd);
+    if (ring) {
+        w.generation++;
+        w.events = events;
+        w.accepting = false;
+        if (!arm(fd)) {
+            LOG_ERROR("EventLoop: io_uring queue is full, cannot add fd=" + std::to_string(fd));
+            return false;
+        }
+    } else {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOG_ERROR("EventLoop: epoll_ctl ADD failed for fd=" + std::to_string(fd));
+            return false;
+        }
+    }
+    w.handler = handler;
+    return true;
+}
+
+bool EventLoop::modify(int fd, uint32_t events, EventHandler *handler) {
+    if (ring) {
+        // Новая заявка сразу проверяет готовность - как EPOLL_CTL_MOD
+        cancel(fd);
+        watches[fd].events = events;
+        if (!arm(fd)) {
+            LOG_ERROR("EventLoop: io_uring queue is full, cannot modify fd=" + std::to_string(fd));
+            return false;
+        }
+    } else {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+            LOG_ERROR("EventLoop: epoll_ctl MOD failed for fd=" + std::to_string(fd));
+            return false;
+        }
+    }
+    watches[fd].handler = handler;
+    return true;
+}
+
+void EventLoop::remove(int fd) {
+    if (fd >= (int)watches.size()) return;
+    Watch &w = watches[fd];
+    if (ring) {
+        if (w.handler) cancel(fd);
+        if (w.sendTag) {
+            // Буфер живёт до завершения отменённой заявки
+            cancelRequest(w.sendTag);
+            orphanSends.emplace(w.sendTag, std::move(w.out));
+            w.sendTag = 0;
+        }
+        std::string().swap(w.out);
+        std::string().swap(w.outNext);
+        w.outPos = 0;
+        w.sendFailed = false;
+    } else {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    w.handler = nullptr;
+    w.accepting = false;
+}
+
+bool EventLoop::acceptMultishot(int listenFd, EventHandler *handler) {
+    if (!ring) return false;
+    Watch &w = watch(listenFd);
+    w.generation++;
+    w.accepting = true;
+    if (!arm(listenFd)) {
+        w.accepting = false;
+        return false;
+    }
+    w.handler = handler;
+    return true;
+}
+
+void EventLoop::post(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(postMtx);
+        posted.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+uint64_t EventLoop::addTimer(std::chrono::milliseconds delay, std::function<void()> callback) {
+    uint64_t id = nextTimerId++;
+    timers.emplace(id, std::move(callback));
+    timerQueue.push({Clock::now() + delay, id});
+    return id;
+}
+
+void EventLoop::cancelTimer(uint64_t id) {
+    timers.erase(id);
+}
+
+int EventLoop::nextTimeoutMs() {
+    while (!timerQueue.empty() && !timers.count(timerQueue.top().id)) {
+        timerQueue.pop();
+    }
+    if (timerQueue.empty()) return -1;
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(timerQueue.top().deadline - Clock::now());
+    // Округляем вверх, чтобы не проснуться за миллисекунду до срока
+    return delay.count() < 0 ? 0 : (int)delay.count() + 1;
+}
+
+void EventLoop::runTimers() {
+    auto now = Clock::now();
+    while (!timerQueue.empty() && timerQueue.top().deadline <= now) {
+        uint64_t id = timerQueue.top().id;
+        timerQueue.pop();
+        auto it = timers.find(id);
+        if (it == timers.end()) continue;
+        auto callback = std::move(it->second);
+        timers.erase(it);
+        callback();
+    }
+}
+
+void EventLoop::adopt(std::unique_ptr<EventHandler> handler) {
+    EventHandler *raw = handler.get();
+    owned.emplace(raw, std::move(handler));
+}
+
+void EventLoop::retire(EventHandler *handler) {
+    auto it = owned.find(handler);
+    if (it == owned.end()) return;
+    retired.push_back(std::move(it->second));
+    owned.erase(it);
+}
+
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    ssize_t r = write(wakeFd, &one, sizeof(one));
+    (void)r;
+}
+
+void EventLoop::runPosted() {
+    std::vector<std::function<void()>> batch;
+    {
+        std::lock_guard<std::mutex> lock(postMtx);
+        batch.swap(posted);
+    }
+    for (auto &task : batch) task();
+}
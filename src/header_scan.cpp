@@ -0,0 +1,229 @@
+#include "header_scan.hpp"
+#include <strings.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEADER_SCAN_X86 1
+#endif
+
+namespace HeaderScan {
+namespace {
+    using ScanFn = Result (*)(const char *, size_t, size_t, std::vector<Line> &);
+
+    // Закрывает строку, заканчивающуюся '\n' в позиции nl; true - строка пустая
+    inline bool closeLine(const char *data, size_t begin, size_t nl, uint32_t colon, std::vector<Line> &lines) {
+        size_t end = nl;
+        if (end > begin && data[end - 1] == '\r') end--;
+        if (end == begin) return true;
+        lines.push_back({(uint32_t)begin, (uint32_t)end, colon < end ? colon : kNoColon});
+        return false;
+    }
+
+    // Побайтовый проход по хвосту (или по всему буферу в скалярной реализации)
+    inline Result scanTail(const char *data, size_t len, size_t i, size_t lineStart, uint32_t colon,
+                           std::vector<Line> &lines) {
+        for (; i < len; i++) {
+            char c = data[i];
+            if (c == ':') {
+                if (colon == kNoColon) colon = (uint32_t)i;
+            } else if (c == '\n') {
+                if (closeLine(data, lineStart, i, colon, lines)) return {i + 1, true};
+                lineStart = i + 1;
+                colon = kNoColon;
+            }
+        }
+        return {lineStart, false};
+    }
+
+    Result scanScalar(const char *data, size_t len, size_t from, std::vector<Line> &lines) {
+        return scanTail(data, len, from, from, kNoColon, lines);
+    }
+
+    // Разбор маски совпадений одного блока; true - найдена пустая строка
+    inline bool walkMask(const char *data, size_t base, uint32_t mask, size_t &lineStart, uint32_t &colon,
+                         std::vector<Line> &lines, size_t &consumed) {
+        while (mask) {
+            size_t p = base + (size_t)__builtin_ctz(mask);
+            mask &= mask - 1;
+            if (data[p] == ':') {
+                if (colon == kNoColon) colon = (uint32_t)p;
+                continue;
+            }
+            if (closeLine(data, lineStart, p, colon, lines)) {
+                consumed = p + 1;
+                return true;
+            }
+            lineStart = p + 1;
+            colon = kNoColon;
+        }
+        return false;
+    }
+
+#ifdef HEADER_SCAN_X86
+    Result scanSSE2(const char *data, size_t len, size_t from, std::vector<Line> &lines) {
+        const __m128i nl = _mm_set1_epi8('\n');
+        const __m128i colonByte = _mm_set1_epi8(':');
+        size_t lineStart = from;
+        uint32_t colon = kNoColon;
+        size_t consumed;
+        size_t i = from;
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, colonByte)));
+            if (walkMask(data, i, mask, lineStart, colon, lines, consumed)) return {consumed, true};
+        }
+        return scanTail(data, len, i, lineStart, colon, lines);
+    }
+
+    __attribute__((target("avx2")))
+    Result scanAVX2(const char *data, size_t len, size_t from, std::vector<Line> &lines) {
+        const __m256i nl = _mm256_set1_epi8('\n');
+        const __m256i colonByte = _mm256_set1_epi8(':');
+        size_t lineStart = from;
+        uint32_t colon = kNoColon;
+        size_t consumed;
+        size_t i = from;
+        for (; i + 32 <= len; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(v, nl), _mm256_cmpeq_epi8(v, colonByte)));
+            if (walkMask(data, i, mask, lineStart, colon, lines, consumed)) return {consumed, true};
+        }
+        return scanTail(data, len, i, lineStart, colon, lines);
+    }
+#endif
+
+    bool supported(Impl impl) {
+        switch (impl) {
+            case Impl::Scalar: return true;
+#ifdef HEADER_SCAN_X86
+            case Impl::SSE2: return __builtin_cpu_supports("sse2");
+            case Impl::AVX2: return __builtin_cpu_supports("avx2");
+#else
+            default: return false;
+#endif
+        }
+        return false;
+    }
+
+    ScanFn implFn(Impl impl) {
+#ifdef HEADER_SCAN_X86
+        if (impl == Impl::AVX2) return scanAVX2;
+        if (impl == Impl::SSE2) return scanSSE2;
+#endif
+        return scanScalar;
+    }
+
+    Impl detect() {
+        if (supported(Impl::AVX2)) return Impl::AVX2;
+        if (supported(Impl::SSE2)) return Impl::SSE2;
+        return Impl::Scalar;
+    }
+
+    Impl activeImpl = detect();
+    ScanFn activeFn = implFn(activeImpl);
+
+    // Значение шестнадцатеричной цифры, 0xFF - не цифра
+    struct HexTable {
+        uint8_t v[256];
+        constexpr HexTable() : v() {
+            for (int i = 0; i < 256; i++) v[i] = 0xFF;
+            for (int i = 0; i < 10; i++) v['0' + i] = (uint8_t)i;
+            for (int i = 0; i < 6; i++) {
+                v['a' + i] = (uint8_t)(10 + i);
+                v['A' + i] = (uint8_t)(10 + i);
+            }
+        }
+    };
+    constexpr HexTable kHex;
+
+    std::string_view trimView(const char *data, size_t begin, size_t end) {
+        auto space = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+        while (begin < end && space(data[begin])) begin++;
+        while (end > begin && space(data[end - 1])) end--;
+        return std::string_view(data + begin, end - begin);
+    }
+
+    bool headerIs(std::string_view name, std::string_view expected) {
+        return name.size() == expected.size() && strncasecmp(name.data(), expected.data(), expected.size()) == 0;
+    }
+}
+
+Result scan(const char *data, size_t len, size_t from, std::vector<Line> &lines) {
+    return activeFn(data, len, from, lines);
+}
+
+bool use(Impl impl) {
+    if (!supported(impl)) return false;
+    activeImpl = impl;
+    activeFn = implFn(impl);
+    return true;
+}
+
+const char *implName() {
+    switch (activeImpl) {
+        case Impl::AVX2: return "avx2";
+        case Impl::SSE2: return "sse2";
+        case Impl::Scalar: break;
+    }
+    return "scalar";
+}
+
+bool parseHex(const char *s, size_t len, uint64_t &value) {
+    uint64_t v = 0;
+    size_t i = 0;
+    // Не больше 15 цифр: значение гарантированно помещается в 64 бита
+    size_t limit = len < 16 ? len : 16;
+    for (; i < limit; i++) {
+        uint8_t d = kHex.v[(uint8_t)s[i]];
+        if (d == 0xFF) break;
+        v = (v << 4) | d;
+    }
+    if (i == 0 || i == 16) return false;
+    // После цифр допустимы только пробелы и расширения чанка (";name=value")
+    if (i < len && s[i] != ';' && s[i] != ' ' && s[i] != '\t' && s[i] != '\r') return false;
+    value = v;
+    return true;
+}
+
+bool parseDecimal(const char *s, size_t len, uint64_t &value) {
+    if (len == 0 || len > 19) return false;
+    uint64_t v = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned d = (unsigned)(uint8_t)s[i] - '0';
+        if (d > 9) return false;
+        v = v * 10 + d;
+    }
+    value = v;
+    return true;
+}
+
+bool inspectResponse(const char *data, const std::vector<Line> &lines, ResponseHead &head) {
+    if (lines.empty()) return false;
+    std::string_view startLine(data + lines[0].begin, lines[0].end - lines[0].begin);
+    head.http11 = startLine.compare(0, 8, "HTTP/1.1") == 0;
+    size_t sp = startLine.find(' ');
+    if (sp != std::string_view::npos) {
+        for (size_t i = sp + 1; i < startLine.size() && startLine[i] >= '0' && startLine[i] <= '9'; i++) {
+            head.status = head.status * 10 + (startLine[i] - '0');
+        }
+    }
+    for (size_t i = 1; i < lines.size(); i++) {
+        const Line &line = lines[i];
+        if (line.colon == kNoColon) continue;
+        std::string_view name = trimView(data, line.begin, line.colon);
+        std::string_view value = trimView(data, line.colon + 1, line.end);
+        if (headerIs(name, "location")) {
+            head.location = value;
+            head.haveLocation = true;
+        } else if (headerIs(name, "connection")) {
+            head.connection = value;
+        } else if (headerIs(name, "transfer-encoding")) {
+            head.transferEncoding = value;
+        } else if (headerIs(name, "content-length")) {
+            head.contentLength = value;
+            head.haveContentLength = true;
+        }
+    }
+    return true;
+}
+}
@@ -2,6 +2,11 @@
 #include "utils.hpp"
 #include <sstream>
 
+const std::pmr::string *HttpRequest::header(std::string_view lowerName) const {
+    auto it = headers.find(lowerName);
+    return it == headers.end() ? nullptr : &it->second;
+}
+
 bool HttpParser::parse(const std::string &data, HttpRequest &request) {
     std::istringstream iss(data);
     std::string line;
@@ -22,7 +27,7 @@ bool HttpParser::parse(const std::string &data, HttpRequest &request) {
         if (pos == std::string::npos) continue;
         std::string name = Utils::trim(line.substr(0, pos));
         std::string value = Utils::trim(line.substr(pos+1));
-        request.headers[toLower(name)] = value;
+        request.headers[std::pmr::string(toLower(name))] = value;
     }
 
     return true;
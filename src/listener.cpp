@@ -4,24 +4,34 @@
 #include <netinet/in.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 
 Listener::~Listener() {
     if (sockfd >= 0) {
         close(sockfd);
     }
+    if (spareFd >= 0) {
+        close(spareFd);
+    }
 }
 
-bool Listener::startListening(int port) {
-    sockfd = socket(AF_INET, SOCK_STREAM, 0);
+bool Listener::startListening(int port, bool reusePort) {
+    sockfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (sockfd < 0) {
-        Logger::error("Failed to create socket");
+        LOG_ERROR("Failed to create socket");
         return false;
     }
 
     int opt = 1;
     if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        Logger::error("Failed to set socket options");
+        LOG_ERROR("Failed to set socket options");
+        close(sockfd);
+        sockfd = -1;
+        return false;
+    }
+    if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR("Failed to set SO_REUSEPORT");
         close(sockfd);
         sockfd = -1;
         return false;
@@ -34,27 +44,28 @@ bool Listener::startListening(int port) {
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
 
     if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        Logger::error("Failed to bind socket");
+        LOG_ERROR("Failed to bind socket");
         close(sockfd);
         sockfd = -1;
         return false;
     }
 
     if (listen(sockfd, SOMAXCONN) < 0) {
-        Logger::error("Failed to listen on socket");
+        LOG_ERROR("Failed to listen on socket");
         close(sockfd);
         sockfd = -1;
         return false;
     }
 
     if (!setNonBlocking(sockfd)) {
-        Logger::error("Failed to set socket non-blocking");
+        LOG_ERROR("Failed to set socket non-blocking");
         close(sockfd);
         sockfd = -1;
         return false;
     }
 
-    Logger::info("Listening on port " + std::to_string(port));
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    LOG_INFO("Listening on port " + std::to_string(port));
     return true;
 }
 
@@ -63,8 +74,27 @@ int Listener::getSocketFd() const {
 }
 
 int Listener::acceptClient() {
+    while (true) {
+        int clientFd = accept4(sockfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd >= 0) {
+            accepted.fetch_add(1, std::memory_order_relaxed);
+            return clientFd;
+        }
+        // Клиент сбросил соединение, пока оно ждало в очереди: берём следующее
+        if (errno == EINTR || errno == ECONNABORTED) continue;
+        if ((errno != EMFILE && errno != ENFILE) || !shedOne()) return -1;
+    }
+}
+
+bool Listener::shedOne() {
+    if (spareFd < 0) return false;
+    close(spareFd);
     int clientFd = accept(sockfd, nullptr, nullptr);
-    return clientFd;
+    if (clientFd >= 0) close(clientFd);
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (clientFd < 0) return false;
+    LOG_ERROR("Out of file descriptors, connection closed on accept");
+    return true;
 }
 
 bool Listener::setNonBlocking(int fd) {
@@ -1,15 +1,238 @@
 #include "logger.hpp"
-#include <iostream>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
 
-static std::mutex logMutex;
+std::atomic<int> Logger::minLevel{(int)LogLevel::Info};
 
-void Logger::info(const std::string &msg) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    std::cout << "[INFO] " << msg << "\n";
+namespace {
+    constexpr size_t kRingSize = 64 * 1024; // на поток, степень двойки
+    constexpr auto kFlushInterval = std::chrono::milliseconds(20);
+
+    struct RecordHeader {
+        uint32_t length;
+        uint8_t level;
+    } __attribute__((packed));
+
+    // Кольцо одного потока: пишет только владелец, читает только фоновый поток
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head{0}; // сколько байт записано
+        alignas(64) std::atomic<uint64_t> tail{0}; // сколько байт прочитано
+        alignas(64) std::atomic<uint64_t> dropped{0};
+        std::atomic<bool> orphaned{false};          // поток-владелец завершился
+        char data[kRingSize];
+
+        bool push(LogLevel level, const std::string &msg) {
+            RecordHeader header{(uint32_t)msg.size(), (uint8_t)level};
+            uint64_t h = head.load(std::memory_order_relaxed);
+            uint64_t need = sizeof(header) + msg.size();
+            if (need > kRingSize - (h - tail.load(std::memory_order_acquire))) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            copyIn(h, &header, sizeof(header));
+            copyIn(h + sizeof(header), msg.data(), msg.size());
+            head.store(h + need, std::memory_order_release);
+            return true;
+        }
+
+        void copyIn(uint64_t pos, const void *src, size_t len) {
+            size_t offset = pos & (kRingSize - 1);
+            size_t first = std::min(len, kRingSize - offset);
+            std::memcpy(data + offset, src, first);
+            std::memcpy(data, static_cast<const char*>(src) + first, len - first);
+        }
+
+        void copyOut(uint64_t pos, void *dst, size_t len) const {
+            size_t offset = pos & (kRingSize - 1);
+            size_t first = std::min(len, kRingSize - offset);
+            std::memcpy(dst, data + offset, first);
+            std::memcpy(static_cast<char*>(dst) + first, data, len - first);
+        }
+    };
+
+    const char *prefix(LogLevel level) {
+        switch (level) {
+            case LogLevel::Debug: return "[DEBUG] ";
+            case LogLevel::Error: return "[ERROR] ";
+            default: return "[INFO] ";
+        }
+    }
+
+    void writeAll(int fd, const std::string &buf) {
+        size_t off = 0;
+        while (off < buf.size()) {
+            ssize_t n = ::write(fd, buf.data() + off, buf.size() - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return;
+            off += (size_t)n;
+        }
+    }
+
+    class Backend {
+    public:
+        static Backend &instance() {
+            static Backend backend;
+            return backend;
+        }
+
+        bool running() const { return active.load(std::memory_order_acquire); }
+
+        std::shared_ptr<Ring> registerRing() {
+            auto ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(ringsMtx);
+            rings.push_back(ring);
+            return ring;
+        }
+
+        void start() {
+            if (active.exchange(true)) return;
+            stopping = false;
+            flusher = std::thread([this] { run(); });
+        }
+
+        void stop() {
+            if (!active.load()) return;
+            {
+                std::lock_guard<std::mutex> lock(wakeMtx);
+                stopping = true;
+            }
+            wakeCv.notify_one();
+            flusher.join();
+            active.store(false, std::memory_order_release);
+            // Записи, сделанные, пока поток останавливался
+            drain();
+        }
+
+        uint64_t dropped() {
+            std::lock_guard<std::mutex> lock(ringsMtx);
+            return droppedTotal + droppedLive();
+        }
+
+        // Синхронный вывод (до start() и после stop())
+        void writeNow(LogLevel level, const std::string &msg) {
+            std::string line = prefix(level) + msg + "\n";
+            std::lock_guard<std::mutex> lock(syncMtx);
+            writeAll(level == LogLevel::Error ? STDERR_FILENO : STDOUT_FILENO, line);
+        }
+
+    private:
+        void run() {
+            std::unique_lock<std::mutex> lock(wakeMtx);
+            while (!stopping) {
+                wakeCv.wait_for(lock, kFlushInterval);
+                lock.unlock();
+                drain();
+                lock.lock();
+            }
+            lock.unlock();
+            drain();
+        }
+
+        uint64_t droppedLive() {
+            uint64_t sum = 0;
+            for (auto &ring : rings) sum += ring->dropped.load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        void drain() {
+            std::lock_guard<std::mutex> lock(ringsMtx);
+            out.clear();
+            err.clear();
+            for (auto it = rings.begin(); it != rings.end();) {
+                Ring &ring = **it;
+                // Флаг читаем до head: всё, что поток успел записать перед выходом, будет забрано
+                bool orphaned = ring.orphaned.load(std::memory_order_acquire);
+                uint64_t t = ring.tail.load(std::memory_order_relaxed);
+                uint64_t h = ring.head.load(std::memory_order_acquire);
+                while (t < h) {
+                    RecordHeader header;
+                    ring.copyOut(t, &header, sizeof(header));
+                    std::string &dst = header.level == (uint8_t)LogLevel::Error ? err : out;
+                    dst += prefix((LogLevel)header.level);
+                    size_t pos = dst.size();
+                    dst.resize(pos + header.length);
+                    ring.copyOut(t + sizeof(header), &dst[pos], header.length);
+                    dst += '\n';
+                    t += sizeof(header) + header.length;
+                }
+                ring.tail.store(t, std::memory_order_release);
+                if (orphaned) {
+                    droppedTotal += ring.dropped.load(std::memory_order_relaxed);
+                    it = rings.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            uint64_t dropped = droppedTotal + droppedLive();
+            if (dropped > droppedReported) {
+                err += "[ERROR] Logger: dropped " + std::to_string(dropped - droppedReported) +
+                       " messages, log buffers were full\n";
+                droppedReported = dropped;
+            }
+            std::lock_guard<std::mutex> syncLock(syncMtx);
+            writeAll(STDOUT_FILENO, out);
+            writeAll(STDERR_FILENO, err);
+        }
+
+        std::atomic<bool> active{false};
+        std::thread flusher;
+        std::mutex wakeMtx;
+        std::condition_variable wakeCv;
+        bool stopping = false;
+
+        std::mutex ringsMtx;
+        std::vector<std::shared_ptr<Ring>> rings;
+        uint64_t droppedTotal = 0;    // из колец завершившихся потоков
+        uint64_t droppedReported = 0;
+        std::string out, err;         // пачки одного прохода, память переиспользуется
+
+        std::mutex syncMtx;
+    };
+
+    // Кольцо текущего потока; при выходе потока оставшиеся записи дочитает фоновый поток
+    struct ThreadRing {
+        std::shared_ptr<Ring> ring;
+        ~ThreadRing() {
+            if (ring) ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+    thread_local ThreadRing threadRing;
+}
+
+void Logger::write(LogLevel level, const std::string &msg) {
+    Backend &backend = Backend::instance();
+    if (!backend.running()) {
+        backend.writeNow(level, msg);
+        return;
+    }
+    if (!threadRing.ring) threadRing.ring = backend.registerRing();
+    threadRing.ring->push(level, msg);
 }
 
-void Logger::error(const std::string &msg) {
-    std::lock_guard<std::mutex> lock(logMutex);
-    std::cerr << "[ERROR] " << msg << "\n";
-}
\ No newline at end of file
+bool Logger::parseLevel(const std::string &name, LogLevel &level) {
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "error") level = LogLevel::Error;
+    else if (name == "off") level = LogLevel::Off;
+    else return false;
+    return true;
+}
+
+void Logger::start() {
+    Backend::instance().start();
+}
+
+void Logger::stop() {
+    Backend::instance().stop();
+}
+
+uint64_t Logger::droppedCount() {
+    return Backend::instance().dropped();
+}
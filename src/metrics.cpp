@@ -0,0 +1,267 @@
+#include "metrics.hpp"
+#include "alloc_stats.hpp"
+#include <cstdio>
+
+namespace {
+    constexpr size_t kStages = 5;
+    const char *const kStageNames[kStages] = {"parse", "dns", "connect", "first_byte", "total"};
+    // Границы корзин гистограмм Prometheus, секунды
+    const double kBoundaries[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                                  0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60};
+    const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    // Классы кодов ответа; 0 - клиент не получил ответа
+    const char *const kStatusClasses[6] = {"none", "1xx", "2xx", "3xx", "4xx", "5xx"};
+
+    // Счётчик пишет только поток-владелец: чтение и запись без lock-префикса,
+    // сборщик метрик видит значение целиком
+    inline void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void bump(std::atomic<int64_t> &gauge, int64_t n) {
+        gauge.store(gauge.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void appendHeader(std::string &out, const std::string &name, const std::string &help, const char *type) {
+        out += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+    }
+
+    void appendValue(std::string &out, const std::string &series, double value) {
+        char buf[64];
+        snprintf(buf, sizeof(buf), " %.10g\n", value);
+        out += series;
+        out += buf;
+    }
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    bump(counts[bucketOf(us)]);
+    bump(sumUs, us);
+}
+
+void LatencyHistogram::addTo(std::array<uint64_t, kBuckets> &out, uint64_t &sum) const {
+    for (size_t i = 0; i < kBuckets; i++) out[i] += counts[i].load(std::memory_order_relaxed);
+    sum += sumUs.load(std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t us) {
+    if (us < kLinear) return (size_t)us;
+    int exp = 63 - __builtin_clzll(us);
+    size_t sub = (size_t)(us >> (exp - 3)) & (kSubBuckets - 1);
+    size_t bucket = kLinear + (size_t)(exp - 4) * kSubBuckets + sub;
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+uint64_t LatencyHistogram::upperBound(size_t bucket) {
+    if (bucket < kLinear) return bucket;
+    int exp = (int)((bucket - kLinear) / kSubBuckets) + 4;
+    uint64_t sub = (bucket - kLinear) % kSubBuckets;
+    uint64_t width = 1ull << (exp - 3);
+    return ((kSubBuckets + sub) << (exp - 3)) + width - 1;
+}
+
+// Счётчики одного потока
+struct alignas(64) Metrics::Shard {
+    std::atomic<uint64_t> requests[6] = {};
+    std::atomic<uint64_t> bytesIn{0};
+    std::atomic<uint64_t> bytesOut{0};
+    std::atomic<uint64_t> cacheHits{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> reusedConnections{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> aborted{0};
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> allocationRequests{0};
+    std::atomic<int64_t> activeConnections{0};
+    std::atomic<int64_t> upstreamIdle{0};
+    LatencyHistogram stages[kStages];
+};
+
+Metrics &Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+std::shared_ptr<Metrics::Shard> Metrics::registerShard() {
+    auto shard = std::make_shared<Shard>();
+    std::lock_guard<std::mutex> lock(mtx);
+    shards.push_back(shard);
+    return shard;
+}
+
+Metrics::Shard &Metrics::local() {
+    thread_local std::shared_ptr<Shard> shard = instance().registerShard();
+    return *shard;
+}
+
+void Metrics::requestFinished(const AccessRecord &rec) {
+    Shard &shard = local();
+    bump(shard.requests[rec.status >= 100 && rec.status < 600 ? rec.status / 100 : 0]);
+    bump(shard.bytesIn, rec.bytesIn);
+    bump(shard.bytesOut, rec.bytesOut);
+    if (rec.flags & AccessRecord::CacheHit) bump(shard.cacheHits);
+    if (rec.flags & AccessRecord::Coalesced) bump(shard.coalesced);
+    if (rec.flags & AccessRecord::ReusedConn) bump(shard.reusedConnections);
+    if (rec.flags & AccessRecord::TimedOut) bump(shard.timeouts);
+    if (rec.flags & AccessRecord::Aborted) bump(shard.aborted);
+    if (rec.parseUs != AccessRecord::kNotReached) {
+        shard.stages[(size_t)LatencyStage::Parse].record(rec.parseUs);
+    }
+    if (rec.firstByteUs != AccessRecord::kNotReached) {
+        shard.stages[(size_t)LatencyStage::FirstByte].record(rec.firstByteUs);
+    }
+    if (rec.lastByteUs != AccessRecord::kNotReached) {
+        shard.stages[(size_t)LatencyStage::Total].record(rec.lastByteUs);
+    }
+}
+
+void Metrics::observe(LatencyStage stage, std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    local().stages[(size_t)stage].record(us > 0 ? (uint64_t)us : 0);
+}
+
+void Metrics::connectionOpened() {
+    bump(local().activeConnections, 1);
+}
+
+void Metrics::connectionClosed() {
+    bump(local().activeConnections, -1);
+}
+
+void Metrics::setUpstreamIdle(size_t count) {
+    local().upstreamIdle.store((int64_t)count, std::memory_order_relaxed);
+}
+
+void Metrics::requestAllocations(uint64_t count) {
+    Shard &shard = local();
+    bump(shard.allocations, count);
+    bump(shard.allocationRequests);
+}
+
+void Metrics::allocationTotals(uint64_t &allocations, uint64_t &requests) {
+    allocations = requests = 0;
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto &shard : shards) {
+        allocations += shard->allocations.load(std::memory_order_relaxed);
+        requests += shard->allocationRequests.load(std::memory_order_relaxed);
+    }
+}
+
+void Metrics::addCounter(const std::string &name, const std::string &help, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mtx);
+    external.push_back({name, help, "counter", std::move(read)});
+}
+
+void Metrics::addGauge(const std::string &name, const std::string &help, std::function<double()> read) {
+    std::lock_guard<std::mutex> lock(mtx);
+    external.push_back({name, help, "gauge", std::move(read)});
+}
+
+std::string Metrics::render() {
+    // Суммы по всем потокам; воркеры тем временем продолжают писать в свои наборы
+    uint64_t requests[6] = {};
+    uint64_t bytesIn = 0, bytesOut = 0, cacheHits = 0, coalesced = 0, reused = 0, timeouts = 0, aborted = 0;
+    uint64_t allocations = 0;
+    int64_t active = 0, upstreamIdle = 0;
+    std::array<uint64_t, LatencyHistogram::kBuckets> buckets[kStages] = {};
+    uint64_t sums[kStages] = {};
+    std::vector<External> sources;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto &shard : shards) {
+            for (size_t i = 0; i < 6; i++) requests[i] += shard->requests[i].load(std::memory_order_relaxed);
+            bytesIn += shard->bytesIn.load(std::memory_order_relaxed);
+            bytesOut += shard->bytesOut.load(std::memory_order_relaxed);
+            cacheHits += shard->cacheHits.load(std::memory_order_relaxed);
+            coalesced += shard->coalesced.load(std::memory_order_relaxed);
+            reused += shard->reusedConnections.load(std::memory_order_relaxed);
+            timeouts += shard->timeouts.load(std::memory_order_relaxed);
+            aborted += shard->aborted.load(std::memory_order_relaxed);
+            allocations += shard->allocations.load(std::memory_order_relaxed);
+            active += shard->activeConnections.load(std::memory_order_relaxed);
+            upstreamIdle += shard->upstreamIdle.load(std::memory_order_relaxed);
+            for (size_t s = 0; s < kStages; s++) shard->stages[s].addTo(buckets[s], sums[s]);
+        }
+        sources = external;
+    }
+
+    std::string out;
+    out.reserve(8192);
+    appendHeader(out, "http_proxy_requests_total", "Requests handled, by response status class.", "counter");
+    for (size_t i = 0; i < 6; i++) {
+        appendValue(out, std::string("http_proxy_requests_total{code=\"") + kStatusClasses[i] + "\"}", (double)requests[i]);
+    }
+    struct { const char *name; const char *help; uint64_t value; } counters[] = {
+            {"http_proxy_received_bytes_total", "Request bytes read from clients.", bytesIn},
+            {"http_proxy_sent_bytes_total", "Response bytes written to clients.", bytesOut},
+            {"http_proxy_cache_hits_total", "Requests answered from the response cache without an upstream exchange.", cacheHits},
+            {"http_proxy_coalesced_requests_total", "Requests served from an identical in-flight request.", coalesced},
+            {"http_proxy_upstream_reused_total", "Requests sent over a pooled upstream connection.", reused},
+            {"http_proxy_timeouts_total", "Requests that hit an upstream connect, read, write or total deadline.", timeouts},
+            {"http_proxy_aborted_responses_total", "Responses cut short by an upstream or client error.", aborted},
+    };
+    for (auto &counter : counters) {
+        appendHeader(out, counter.name, counter.help, "counter");
+        appendValue(out, counter.name, (double)counter.value);
+    }
+    if (AllocStats::kEnabled) {
+        appendHeader(out, "http_proxy_request_allocations_total", "Heap allocations made while handling requests.", "counter");
+        appendValue(out, "http_proxy_request_allocations_total", (double)allocations);
+    }
+    appendHeader(out, "http_proxy_active_connections", "Open client connections.", "gauge");
+    appendValue(out, "http_proxy_active_connections", (double)active);
+    appendHeader(out, "http_proxy_upstream_idle_connections", "Idle keep-alive upstream connections in worker pools.", "gauge");
+    appendValue(out, "http_proxy_upstream_idle_connections", (double)upstreamIdle);
+    for (auto &source : sources) {
+        appendHeader(out, source.name, source.help, source.type);
+        appendValue(out, source.name, source.read());
+    }
+
+    appendHeader(out, "http_proxy_stage_duration_seconds",
+                 "Time from request start (accept for the first request of a connection) to parse, first upstream "
+                 "byte and last byte; dns and connect are durations of the lookup and of the connect itself.", "histogram");
+    for (size_t s = 0; s < kStages; s++) {
+        std::string label = std::string("{stage=\"") + kStageNames[s] + "\"";
+        // Корзина HDR, пересекающая границу, засчитывается в следующую границу
+        uint64_t cumulative = 0;
+        size_t bucket = 0;
+        for (double boundary : kBoundaries) {
+            uint64_t limitUs = (uint64_t)(boundary * 1e6);
+            while (bucket < LatencyHistogram::kBuckets && LatencyHistogram::upperBound(bucket) <= limitUs) {
+                cumulative += buckets[s][bucket++];
+            }
+            char le[32];
+            snprintf(le, sizeof(le), "%g", boundary);
+            appendValue(out, "http_proxy_stage_duration_seconds_bucket" + label + ",le=\"" + le + "\"}", (double)cumulative);
+        }
+        uint64_t count = 0;
+        for (uint64_t c : buckets[s]) count += c;
+        appendValue(out, "http_proxy_stage_duration_seconds_bucket" + label + ",le=\"+Inf\"}", (double)count);
+        appendValue(out, "http_proxy_stage_duration_seconds_sum" + label + "}", sums[s] / 1e6);
+        appendValue(out, "http_proxy_stage_duration_seconds_count" + label + "}", (double)count);
+    }
+
+    // Перцентили по полной гистограмме, без огрубления до границ выше
+    appendHeader(out, "http_proxy_stage_duration_quantile_seconds",
+                 "Latency quantiles since start, from the full-resolution histograms (upper bound of the bucket).", "gauge");
+    for (size_t s = 0; s < kStages; s++) {
+        uint64_t count = 0;
+        for (uint64_t c : buckets[s]) count += c;
+        if (count == 0) continue;
+        for (double q : kQuantiles) {
+            uint64_t rank = (uint64_t)(q * (double)count);
+            if (rank >= count) rank = count - 1;
+            uint64_t seen = 0;
+            size_t bucket = 0;
+            for (; bucket < LatencyHistogram::kBuckets; bucket++) {
+                seen += buckets[s][bucket];
+                if (seen > rank) break;
+            }
+            char series[128];
+            snprintf(series, sizeof(series), "http_proxy_stage_duration_quantile_seconds{stage=\"%s\",quantile=\"%g\"}",
+                     kStageNames[s], q);
+            appendValue(out, series, LatencyHistogram::upperBound(bucket) / 1e6);
+        }
+    }
+    return out;
+}
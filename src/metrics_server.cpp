@@ -0,0 +1,101 @@
+#include "metrics_server.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <string>
+
+namespace {
+    constexpr int kPollIntervalMs = 200;   // как часто поток проверяет флаг остановки
+    constexpr int kClientTimeoutMs = 1000; // на чтение запроса и отправку ответа
+    constexpr size_t kMaxRequestSize = 8192;
+
+    bool waitFor(int fd, short events) {
+        pollfd pfd = {fd, events, 0};
+        int r;
+        while ((r = poll(&pfd, 1, kClientTimeoutMs)) < 0 && errno == EINTR) {}
+        return r > 0;
+    }
+
+    void sendAll(int fd, const std::string &data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t s = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (s > 0) {
+                sent += (size_t)s;
+                continue;
+            }
+            if (s < 0 && errno == EINTR) continue;
+            if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(fd, POLLOUT)) continue;
+            return;
+        }
+    }
+
+    std::string response(const char *status, const char *contentType, const std::string &body) {
+        return std::string("HTTP/1.1 ") + status + "\r\nContent-Type: " + contentType +
+               "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    }
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(int port) {
+    if (!listener.startListening(port)) {
+        LOG_ERROR("MetricsServer: cannot listen on port " + std::to_string(port));
+        return false;
+    }
+    thread = std::thread(&MetricsServer::serve, this);
+    LOG_INFO("MetricsServer: serving /metrics on port " + std::to_string(port));
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!thread.joinable()) return;
+    stopping.store(true);
+    thread.join();
+}
+
+void MetricsServer::serve() {
+    pollfd pfd = {listener.getSocketFd(), POLLIN, 0};
+    while (!stopping.load()) {
+        if (poll(&pfd, 1, kPollIntervalMs) <= 0) continue;
+        int clientFd;
+        while ((clientFd = listener.acceptClient()) >= 0) {
+            handleClient(clientFd);
+            close(clientFd);
+        }
+    }
+}
+
+void MetricsServer::handleClient(int fd) {
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestSize) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0) {
+            request.append(buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(fd, POLLIN)) continue;
+        return;
+    }
+
+    size_t lineEnd = request.find("\r\n");
+    std::string line = request.substr(0, lineEnd);
+    if (line.compare(0, 4, "GET ") != 0) {
+        sendAll(fd, response("405 Method Not Allowed", "text/plain", "Only GET is supported\n"));
+        return;
+    }
+    size_t pathEnd = line.find(' ', 4);
+    std::string path = line.substr(4, pathEnd == std::string::npos ? std::string::npos : pathEnd - 4);
+    if (path != "/metrics") {
+        sendAll(fd, response("404 Not Found", "text/plain", "Try /metrics\n"));
+        return;
+    }
+    sendAll(fd, response("200 OK", "text/plain; version=0.0.4; charset=utf-8", Metrics::instance().render()));
+}
@@ -1,19 +1,65 @@
 #include "proxy_app.hpp"
 #include "logger.hpp"
 #include "signal_handler.hpp"
+#include "upstream_pool.hpp"
+#include "connection_handler.hpp"
+#include "response_cache.hpp"
+#include "request_coalescer.hpp"
+#include "redirect_handler.hpp"
+#include "compressor.hpp"
+#include "dns_resolver.hpp"
+#include "circuit_breaker.hpp"
+#include "admission_control.hpp"
+#include "access_log.hpp"
+#include "metrics.hpp"
+#include "alloc_stats.hpp"
+#include "event_loop.hpp"
 #include <getopt.h>
+#include <poll.h>
+#include <sys/select.h>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 
 void ProxyApp::parseArgs(int argc, char** argv) {
     static struct option long_options[] = {
             {"help", no_argument, nullptr, 'h'},
             {"port", required_argument, nullptr, 'p'},
             {"max-client-threads", required_argument, nullptr, 'm'},
+            {"listeners", required_argument, nullptr, 'l'},
+            {"pin-cpus", no_argument, nullptr, 'c'},
+            {"io-engine", required_argument, nullptr, 'e'},
+            {"max-queued", required_argument, nullptr, 'q'},
+            {"max-connections", required_argument, nullptr, 'x'},
+            {"queue-timeout", required_argument, nullptr, 'Q'},
+            {"lifo-overload", no_argument, nullptr, 'o'},
+            {"max-per-client", required_argument, nullptr, 'P'},
+            {"upstream-max-idle", required_argument, nullptr, 'i'},
+            {"upstream-idle-timeout", required_argument, nullptr, 't'},
+            {"keepalive-timeout", required_argument, nullptr, 'k'},
+            {"cache-size", required_argument, nullptr, 's'},
+            {"redirect-cache", required_argument, nullptr, 'F'},
+            {"no-coalesce", no_argument, nullptr, 'n'},
+            {"no-splice", no_argument, nullptr, 'z'},
+            {"compress", required_argument, nullptr, 'g'},
+            {"compress-min-size", required_argument, nullptr, 'G'},
+            {"compress-types", required_argument, nullptr, 'y'},
+            {"dns-threads", required_argument, nullptr, 'r'},
+            {"dns-server", required_argument, nullptr, 'd'},
+            {"connect-timeout", required_argument, nullptr, 'C'},
+            {"read-timeout", required_argument, nullptr, 'R'},
+            {"write-timeout", required_argument, nullptr, 'W'},
+            {"request-timeout", required_argument, nullptr, 'T'},
+            {"breaker-threshold", required_argument, nullptr, 'b'},
+            {"breaker-cooldown", required_argument, nullptr, 'B'},
+            {"log-level", required_argument, nullptr, 'L'},
+            {"access-log", required_argument, nullptr, 'a'},
+            {"metrics-port", required_argument, nullptr, 'M'},
             {nullptr, 0, nullptr, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "hp:m:", long_options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hp:m:l:ce:q:x:Q:oP:i:t:k:s:F:nzg:G:y:r:d:C:R:W:T:b:B:L:a:M:", long_options, nullptr)) != -1) {
         switch(opt) {
             case 'h':
                 helpFlag = true;
@@ -24,6 +70,93 @@ void ProxyApp::parseArgs(int argc, char** argv) {
             case 'm':
                 config.maxThreads = std::stoi(optarg);
                 break;
+            case 'l':
+                config.listeners = std::stoi(optarg);
+                break;
+            case 'c':
+                config.pinCpus = true;
+                break;
+            case 'e':
+                config.ioEngine = optarg;
+                break;
+            case 'q':
+                config.maxQueued = std::stoi(optarg);
+                break;
+            case 'x':
+                config.maxConnections = std::stoi(optarg);
+                break;
+            case 'Q':
+                config.queueTimeoutMs = std::stoi(optarg);
+                break;
+            case 'o':
+                config.lifoOverload = true;
+                break;
+            case 'P':
+                config.maxPerClient = std::stoi(optarg);
+                break;
+            case 'i':
+                config.upstreamMaxIdle = std::stoi(optarg);
+                break;
+            case 't':
+                config.upstreamIdleTimeout = std::stoi(optarg);
+                break;
+            case 'k':
+                config.keepAliveTimeout = std::stoi(optarg);
+                break;
+            case 's':
+                config.cacheSizeMb = std::stoi(optarg);
+                break;
+            case 'F':
+                config.redirectCacheSize = std::stoi(optarg);
+                break;
+            case 'n':
+                config.coalesce = false;
+                break;
+            case 'z':
+                config.splice = false;
+                break;
+            case 'g':
+                config.compress = optarg;
+                break;
+            case 'G':
+                config.compressMinSize = std::stoi(optarg);
+                break;
+            case 'y':
+                config.compressTypes = optarg;
+                break;
+            case 'r':
+                config.dnsThreads = std::stoi(optarg);
+                break;
+            case 'd':
+                config.dnsServer = optarg;
+                break;
+            case 'C':
+                config.connectTimeoutMs = std::stoi(optarg);
+                break;
+            case 'R':
+                config.readTimeoutMs = std::stoi(optarg);
+                break;
+            case 'W':
+                config.writeTimeoutMs = std::stoi(optarg);
+                break;
+            case 'T':
+                config.requestTimeoutMs = std::stoi(optarg);
+                break;
+            case 'b':
+                config.breakerThreshold = std::stoi(optarg);
+                break;
+            case 'B':
+                config.breakerCooldown = std::stoi(optarg);
+                break;
+            case 'L':
+                config.logLevel = optarg;
+                break;
+            case 'a':
+                config.accessLog = optarg;
+                break;
+            case 'M':
+                config.metricsPort = std::stoi(optarg);
+                break;
             default:
                 std::cerr << "Unknown option or missing argument. Use --help for usage.\n";
                 exit(1);
@@ -32,19 +165,89 @@ void ProxyApp::parseArgs(int argc, char** argv) {
 }
 
 void ProxyApp::init() {
+    LogLevel level;
+    if (!Logger::parseLevel(config.logLevel, level)) {
+        std::cerr << "Unknown log level: " << config.logLevel << "\n";
+        exit(1);
+    }
+    EventLoop::Engine engine;
+    if (!EventLoop::parseEngine(config.ioEngine, engine)) {
+        std::cerr << "Unknown I/O engine: " << config.ioEngine << "\n";
+        exit(1);
+    }
+    CompressorPool::Policy compression;
+    std::string compressError;
+    if (!CompressorPool::parseEncodings(config.compress, compression, compressError)) {
+        std::cerr << "Bad --compress value: " << compressError << "\n";
+        exit(1);
+    }
+    compression.minSize = (size_t)std::max(0, config.compressMinSize);
+    compression.types = config.compressTypes.empty() ? CompressorPool::defaultTypes()
+                                                     : CompressorPool::parseTypes(config.compressTypes);
+    Logger::setLevel(level);
+    Logger::start();
     SignalHandler::init();
-    if (!listener.startListening(config.port)) {
-        Logger::error("Cannot start listener");
+    engine = EventLoop::configure(engine);
+    LOG_INFO(std::string("I/O engine: ") + (engine == EventLoop::Engine::Uring ? "io_uring" : "epoll"));
+    if (config.listeners > 0) {
+        // Каждый воркер владеет своим слушающим сокетом
+        config.maxThreads = config.listeners;
+    } else if (!listener.startListening(config.port)) {
+        LOG_ERROR("Cannot start listener");
+        exit(1);
+    }
+    AdmissionControl::Limits limits;
+    limits.maxQueued = (size_t)std::max(0, config.maxQueued);
+    limits.maxConnections = (size_t)std::max(0, config.maxConnections);
+    limits.queueTimeout = std::chrono::milliseconds(std::max(0, config.queueTimeoutMs));
+    limits.lifoUnderOverload = config.lifoOverload;
+    limits.maxPerClient = (size_t)std::max(0, config.maxPerClient);
+    AdmissionControl::configure(limits);
+    UpstreamPool::configure(std::max(0, config.upstreamMaxIdle), config.upstreamIdleTimeout);
+    ConnectionHandler::configure(config.keepAliveTimeout, config.splice);
+    ConnectionHandler::configureTimeouts(std::max(0, config.connectTimeoutMs), std::max(0, config.readTimeoutMs),
+                                         std::max(0, config.writeTimeoutMs), std::max(0, config.requestTimeoutMs));
+    CircuitBreaker::configure(std::max(0, config.breakerThreshold), std::max(1, config.breakerCooldown));
+    ResponseCache::configure((size_t)std::max(0, config.cacheSizeMb) * 1024 * 1024);
+    RedirectHandler::configure((size_t)std::max(0, config.redirectCacheSize));
+    RequestCoalescer::configure(config.coalesce);
+    CompressorPool::configure(compression);
+    AccessLog::configure(config.accessLog);
+    if (!AccessLog::instance().start()) {
+        LOG_ERROR("Cannot open access log");
         exit(1);
     }
-    if (!pool.init(config.maxThreads)) {
-        Logger::error("Cannot init thread pool");
+    DnsResolver::configure(std::max(1, config.dnsThreads), config.dnsServer);
+    if (!DnsResolver::instance().start()) {
+        LOG_ERROR("Cannot start DNS resolver");
         exit(1);
     }
-    Logger::info("Initialized with port=" + std::to_string(config.port) + " threads=" + std::to_string(config.maxThreads));
+    if (config.maxThreads <= 0) {
+        config.maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (!pool.init(config.maxThreads, config.pinCpus)) {
+        LOG_ERROR("Cannot init thread pool");
+        exit(1);
+    }
+    if (config.listeners > 0 && !pool.startListeners(config.port)) {
+        LOG_ERROR("Cannot start SO_REUSEPORT listeners");
+        exit(1);
+    }
+    if (config.metricsPort > 0) {
+        registerMetrics();
+        if (!metricsServer.start(config.metricsPort)) {
+            LOG_ERROR("Cannot start metrics server");
+            exit(1);
+        }
+    }
+    LOG_INFO("Initialized with port=" + std::to_string(config.port) + " threads=" + std::to_string(config.maxThreads));
 }
 
 void ProxyApp::run() {
+    if (config.listeners > 0) {
+        runSharded();
+        return;
+    }
     int listenFd = listener.getSocketFd();
     while(!SignalHandler::shouldShutdown()) {
         fd_set readfds;
@@ -52,30 +255,203 @@ void ProxyApp::run() {
         FD_SET(listenFd, &readfds);
         int maxfd = listenFd;
 
-        int ret = select(maxfd+1, &readfds, nullptr, nullptr, nullptr);
+        // С --queue-timeout просыпаемся чаще: ждущим дольше срока отказ нужен сразу, а не через секунду
+        long waitMs = config.queueTimeoutMs > 0 ? std::clamp(config.queueTimeoutMs / 4, 10, 1000) : 1000;
+        struct timeval tv = {waitMs / 1000, (waitMs % 1000) * 1000};
+        int ret = select(maxfd+1, &readfds, nullptr, nullptr, &tv);
         if (ret < 0) {
             if (SignalHandler::shouldShutdown()) break;
-            Logger::error("select() failed");
+            LOG_ERROR("select() failed");
             break;
         }
 
         if (FD_ISSET(listenFd, &readfds)) {
-            int clientFd = listener.acceptClient();
-            if (clientFd >= 0) {
-                Logger::info("Accepted new client: fd=" + std::to_string(clientFd));
+            // Забираем всю очередь accept, соединения обслуживают циклы событий воркеров
+            int clientFd;
+            while ((clientFd = listener.acceptClient()) >= 0) {
+                LOG_DEBUG("Accepted new client: fd=" + std::to_string(clientFd));
                 pool.submitTask(clientFd);
             }
         }
+        // Ждущие дольше срока получают отказ, даже если все места заняты и очередь никто не берёт
+        AdmissionControl::instance().expire();
+        reportAcceptRate({listener.acceptedCount()});
     }
 }
 
+void ProxyApp::runSharded() {
+    // Соединения принимают сами воркеры, основной поток только ждёт сигнала
+    while (!SignalHandler::shouldShutdown()) {
+        poll(nullptr, 0, 1000);
+        reportAcceptRate(pool.listenerAcceptCounts());
+    }
+}
+
+void ProxyApp::reportAcceptRate(const std::vector<uint64_t> &counts) {
+    constexpr auto kReportInterval = std::chrono::seconds(10);
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastRateReport < kReportInterval) return;
+    double seconds = std::chrono::duration<double>(now - lastRateReport).count();
+    lastAcceptCounts.resize(counts.size(), 0);
+    for (size_t i = 0; i < counts.size(); i++) {
+        uint64_t delta = counts[i] - lastAcceptCounts[i];
+        if (delta > 0) {
+            LOG_INFO("Listener " + std::to_string(i) + ": " +
+                         std::to_string((uint64_t)(delta / seconds)) + " accepts/sec");
+        }
+    }
+    lastAcceptCounts = counts;
+    lastRateReport = now;
+}
+
+void ProxyApp::registerMetrics() {
+    Metrics &metrics = Metrics::instance();
+    metrics.addGauge("http_proxy_task_queue_depth", "Accepted connections and tasks not yet picked up by an event loop.",
+                     [this] { return (double)pool.queuedTasks(); });
+    metrics.addGauge("http_proxy_admission_queue_depth", "Accepted connections waiting for admission.",
+                     [] { return (double)AdmissionControl::instance().queued(); });
+    metrics.addGauge("http_proxy_admitted_connections", "Client connections currently being served.",
+                     [] { return (double)AdmissionControl::instance().serving(); });
+    metrics.addCounter("http_proxy_rejected_queue_full_total", "Connections rejected with 503 because the admission queue was full.",
+                       [] { return (double)AdmissionControl::instance().rejectedCount(AdmissionControl::Reason::QueueFull); });
+    metrics.addCounter("http_proxy_rejected_connection_limit_total", "Connections rejected with 503 at the concurrent connection limit.",
+                       [] { return (double)AdmissionControl::instance().rejectedCount(AdmissionControl::Reason::ConnectionLimit); });
+    metrics.addCounter("http_proxy_rejected_client_limit_total", "Connections rejected with 503 at the per-client connection limit.",
+                       [] { return (double)AdmissionControl::instance().rejectedCount(AdmissionControl::Reason::ClientLimit); });
+    metrics.addCounter("http_proxy_queue_expired_total", "Connections rejected with 503 after waiting longer than the queue timeout.",
+                       [] { return (double)AdmissionControl::instance().rejectedCount(AdmissionControl::Reason::Expired); });
+    metrics.addCounter("http_proxy_tasks_stolen_total", "Tasks an event loop took from another loop's queue.",
+                       [this] { return (double)pool.taskStats().stolen; });
+    metrics.addCounter("http_proxy_accepted_connections_total", "Client connections accepted.", [this] {
+        uint64_t accepted = listener.acceptedCount();
+        for (uint64_t count : pool.listenerAcceptCounts()) accepted += count;
+        return (double)accepted;
+    });
+    metrics.addCounter("http_proxy_collapsed_requests_total", "GET requests that joined an identical in-flight upstream fetch instead of sending their own.",
+                       [] { return (double)RequestCoalescer::instance().collapsedCount(); });
+    metrics.addCounter("http_proxy_cache_hits_total", "GET requests answered from the response cache without contacting the origin.",
+                       [] { return (double)ResponseCache::instance().stats().hits.load(); });
+    metrics.addCounter("http_proxy_cache_misses_total", "Cacheable GET requests with no fresh response cache entry for their Vary values.",
+                       [] { return (double)ResponseCache::instance().stats().misses.load(); });
+    metrics.addCounter("http_proxy_dns_cache_hits_total", "Upstream host lookups answered from the DNS cache.",
+                       [] { return (double)DnsResolver::instance().stats().hits.load(); });
+    metrics.addCounter("http_proxy_dns_cache_misses_total", "Upstream host lookups sent to the resolver threads.",
+                       [] { return (double)DnsResolver::instance().stats().misses.load(); });
+    metrics.addCounter("http_proxy_redirects_followed_total", "Upstream 3xx responses the proxy followed itself.",
+                       [] { return (double)RedirectHandler::instance().stats().followed.load(); });
+    metrics.addCounter("http_proxy_redirect_cache_hits_total", "Redirect hops taken from the permanent redirect table without an upstream request.",
+                       [] { return (double)RedirectHandler::instance().stats().hits.load(); });
+    metrics.addCounter("http_proxy_compressed_responses_total", "Responses compressed on the fly for the client.",
+                       [] { return (double)CompressorPool::stats().responses.load(); });
+    metrics.addCounter("http_proxy_compression_input_bytes_total", "Response body bytes fed to on-the-fly compression.",
+                       [] { return (double)CompressorPool::stats().bytesIn.load(); });
+    metrics.addCounter("http_proxy_compression_output_bytes_total", "Compressed response body bytes sent to clients.",
+                       [] { return (double)CompressorPool::stats().bytesOut.load(); });
+    metrics.addCounter("http_proxy_breaker_rejected_total", "Requests fast-failed by the circuit breaker.",
+                       [] { return (double)CircuitBreaker::instance().rejectedCount(); });
+    metrics.addGauge("http_proxy_breaker_hosts", "Upstream host:port entries with recent failures tracked by the circuit breaker.",
+                     [] { return (double)CircuitBreaker::instance().trackedCount(); });
+    metrics.addCounter("http_proxy_breaker_evicted_total", "Circuit breaker entries dropped because the table was full or the entry went stale.",
+                       [] { return (double)CircuitBreaker::instance().evictedCount(); });
+    metrics.addCounter("http_proxy_log_dropped_total", "Log messages dropped because a thread ring was full.",
+                       [] { return (double)Logger::droppedCount(); });
+}
+
 void ProxyApp::shutdown() {
-    Logger::info("Received shutdown signal");
+    LOG_INFO("Received shutdown signal");
+    metricsServer.stop();
     pool.shutdown();
-    Logger::info("All threads have finished");
-    Logger::info("Proxy finished");
+    LOG_INFO("All threads have finished");
+    auto tasks = pool.taskStats();
+    LOG_INFO("Tasks: executed=" + std::to_string(tasks.executed) + " stolen=" + std::to_string(tasks.stolen) +
+                 " injected=" + std::to_string(tasks.injected) + " wakeups=" + std::to_string(tasks.wakeups));
+    DnsResolver::instance().shutdown();
+    auto &dns = DnsResolver::instance().stats();
+    LOG_INFO("DNS lookups: hits=" + std::to_string(dns.hits.load()) + " misses=" + std::to_string(dns.misses.load()) +
+                 " coalesced=" + std::to_string(dns.coalesced.load()) + " failures=" + std::to_string(dns.failures.load()) +
+                 " evicted=" + std::to_string(dns.evicted.load()));
+    auto &admission = AdmissionControl::instance();
+    LOG_INFO("Admission: rejected queue_full=" + std::to_string(admission.rejectedCount(AdmissionControl::Reason::QueueFull)) +
+                 " connection_limit=" + std::to_string(admission.rejectedCount(AdmissionControl::Reason::ConnectionLimit)) +
+                 " client_limit=" + std::to_string(admission.rejectedCount(AdmissionControl::Reason::ClientLimit)) +
+                 " expired=" + std::to_string(admission.rejectedCount(AdmissionControl::Reason::Expired)));
+    auto &redirects = RedirectHandler::instance().stats();
+    LOG_INFO("Redirects: followed=" + std::to_string(redirects.followed.load()) + " from_table=" +
+                 std::to_string(redirects.hits.load()) + " remembered=" + std::to_string(redirects.stores.load()));
+    if (CompressorPool::enabled()) {
+        auto &compression = CompressorPool::stats();
+        LOG_INFO("Compression: responses=" + std::to_string(compression.responses.load()) + " in=" +
+                     std::to_string(compression.bytesIn.load()) + " out=" + std::to_string(compression.bytesOut.load()));
+    }
+    LOG_INFO("Collapsed requests: " + std::to_string(RequestCoalescer::instance().collapsedCount()));
+    auto &breaker = CircuitBreaker::instance();
+    LOG_INFO("Circuit breaker: tripped " + std::to_string(breaker.trippedCount()) + " times, rejected " +
+                 std::to_string(breaker.rejectedCount()) + " requests, evicted " +
+                 std::to_string(breaker.evictedCount()) + " entries");
+    uint64_t responses, syscalls;
+    ConnectionHandler::ioStats(responses, syscalls);
+    if (responses > 0) {
+        LOG_INFO("Upstream responses: " + std::to_string(responses) + ", syscalls per response: " +
+                     std::to_string((double)syscalls / responses));
+    }
+    if (AllocStats::kEnabled) {
+        uint64_t allocations, requests;
+        Metrics::instance().allocationTotals(allocations, requests);
+        if (requests > 0) {
+            LOG_INFO("Heap allocations per request: " + std::to_string((double)allocations / requests));
+        }
+    }
+    if (AccessLog::enabled()) {
+        AccessLog &accessLog = AccessLog::instance();
+        accessLog.shutdown();
+        LOG_INFO("Access log: " + std::to_string(accessLog.writtenCount()) + " records written, " +
+                     std::to_string(accessLog.droppedCount()) + " dropped");
+    }
+    uint64_t dropped = Logger::droppedCount();
+    if (dropped > 0) LOG_INFO("Log messages dropped: " + std::to_string(dropped));
+    LOG_INFO("Proxy finished");
+    Logger::stop();
 }
 
 void ProxyApp::printHelp() {
-    std::cout << "Usage: http_proxy [--port N] [--max-client-threads N] [--help]\n";
+    std::cout << "Usage: http_proxy [--port N] [--max-client-threads N] [--listeners N] [--pin-cpus]\n"
+              << "                  [--io-engine epoll|uring] [--max-queued N] [--max-connections N]\n"
+              << "                  [--queue-timeout MS] [--lifo-overload] [--max-per-client N]\n"
+              << "                  [--upstream-max-idle N] [--upstream-idle-timeout SEC]\n"
+              << "                  [--keepalive-timeout SEC] [--cache-size MB] [--redirect-cache N] [--no-coalesce]\n"
+              << "                  [--no-splice] [--compress gzip,br] [--compress-min-size BYTES]\n"
+              << "                  [--compress-types LIST] [--dns-threads N] [--dns-server IP[:PORT]]\n"
+              << "                  [--connect-timeout MS] [--read-timeout MS] [--write-timeout MS]\n"
+              << "                  [--request-timeout MS] [--breaker-threshold N] [--breaker-cooldown SEC]\n"
+              << "                  [--log-level LEVEL] [--access-log PATH] [--metrics-port N] [--help]\n"
+              << "  --max-client-threads N  number of event loop threads (default: one per CPU core)\n"
+              << "  --listeners N           N workers, each with its own SO_REUSEPORT listener\n"
+              << "  --pin-cpus              pin worker threads to CPU cores\n"
+              << "  --io-engine NAME        epoll or uring: event loops on io_uring, epoll if the kernel lacks it (default epoll)\n"
+              << "  --max-queued N          accepted connections waiting for a worker; beyond that 503 (default 4096, 0 - no limit)\n"
+              << "  --max-connections N     connections served at once, the rest wait in the queue (default 0, no limit)\n"
+              << "  --queue-timeout MS      answer 503 to connections that waited in the queue longer than MS (default 0, off)\n"
+              << "  --lifo-overload         when the queue is more than half full, serve the newest connections first\n"
+              << "  --max-per-client N      connections from one client IP, queued or served; beyond that 503 (default 0, no limit)\n"
+              << "  --upstream-max-idle N   idle keep-alive upstream connections per host:port (default 8, 0 disables)\n"
+              << "  --upstream-idle-timeout SEC  close idle upstream connections after SEC seconds (default 30)\n"
+              << "  --keepalive-timeout SEC close idle client connections after SEC seconds (default 15)\n"
+              << "  --cache-size MB         in-memory response cache budget (default 64, 0 disables)\n"
+              << "  --redirect-cache N      permanent redirects (301, 308) remembered and followed without a request (default 1024, 0 disables)\n"
+              << "  --no-coalesce           do not collapse concurrent identical GET requests into one upstream fetch\n"
+              << "  --no-splice             relay response bodies by copying instead of splice() through a pipe\n"
+              << "  --compress LIST         compress responses on the fly for clients that accept it: gzip, br or gzip,br (default off)\n"
+              << "  --compress-min-size BYTES  do not compress responses with a smaller Content-Length (default 1024)\n"
+              << "  --compress-types LIST   comma-separated content types to compress, \"text/\" covers all subtypes (default: text, JSON, JS, XML, SVG)\n"
+              << "  --dns-threads N         resolver threads for upstream host names (default 2)\n"
+              << "  --dns-server IP[:PORT]  DNS server to query instead of the one from /etc/resolv.conf\n"
+              << "  --connect-timeout MS    deadline for resolving and connecting to the upstream server (default 5000, 0 disables)\n"
+              << "  --read-timeout MS       close the exchange if the upstream server sends nothing for MS (default 30000)\n"
+              << "  --write-timeout MS      close the exchange if a send to the server or the client stalls for MS (default 30000)\n"
+              << "  --request-timeout MS    deadline for the whole upstream exchange (default 0, no limit)\n"
+              << "  --breaker-threshold N   consecutive failures before an upstream is fast-failed with 503 (default 5, 0 disables)\n"
+              << "  --breaker-cooldown SEC  how long a failing upstream is fast-failed before a probe request (default 10)\n"
+              << "  --log-level LEVEL       debug, info, error or off (default info); per-request messages are debug\n"
+              << "  --access-log PATH       append a binary record per request to PATH (read with access_log_analyzer)\n"
+              << "  --metrics-port N        serve Prometheus metrics at http://HOST:N/metrics (default 0, disabled)\n";
 }
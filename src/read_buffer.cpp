@@ -0,0 +1,58 @@
+#include "read_buffer.hpp"
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+
+ReadBuffer::Status ReadBuffer::fill(int fd) {
+    reserveBlock();
+    while (true) {
+        ssize_t n = recv(fd, buf.data() + end, buf.size() - end, 0);
+        if (n > 0) {
+            end += (size_t)n;
+            return Status::Ok;
+        }
+        if (n == 0) return Status::Eof;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return Status::WouldBlock;
+        return Status::Error;
+    }
+}
+
+void ReadBuffer::consume(size_t n) {
+    start += n;
+    scanPos = scanPos > n ? scanPos - n : 0;
+    if (start == end) start = end = 0;
+}
+
+void ReadBuffer::clear() {
+    start = end = scanPos = 0;
+}
+
+size_t ReadBuffer::findHeaderEnd() {
+    const char *base = data();
+    size_t len = size();
+    size_t pos = scanPos;
+    while (pos + 4 <= len) {
+        const void *cr = memchr(base + pos, '\r', len - pos - 3);
+        if (!cr) break;
+        pos = (size_t)(static_cast<const char*>(cr) - base);
+        if (memcmp(base + pos, "\r\n\r\n", 4) == 0) {
+            scanPos = pos;
+            return pos + 4;
+        }
+        pos++;
+    }
+    // Последние три байта могут оказаться началом разделителя
+    scanPos = len >= 3 ? len - 3 : 0;
+    return std::string::npos;
+}
+
+void ReadBuffer::reserveBlock() {
+    if (buf.size() - end >= blockSize) return;
+    if (start > 0) {
+        memmove(buf.data(), buf.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    if (buf.size() - end < blockSize) buf.resize(end + blockSize);
+}
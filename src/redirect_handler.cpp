@@ -1,3 +1,101 @@
-//
-// Created by denis on 20.12.24.
-//
+#include "redirect_handler.hpp"
+#include "response_cache.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <functional>
+
+size_t RedirectHandler::maxEntries = 1024;
+
+RedirectHandler &RedirectHandler::instance() {
+    static RedirectHandler handler;
+    return handler;
+}
+
+void RedirectHandler::configure(size_t entries) {
+    maxEntries = entries;
+}
+
+bool RedirectHandler::resolveLocation(std::string_view location, const Target &base, Target &target) {
+    // Фрагмент серверу не передаётся
+    location = location.substr(0, location.find('#'));
+    if (location.empty()) return false;
+
+    if (location.substr(0, 2) == "//") {
+        // Без схемы: та же, что у запроса, то есть http
+        std::string url = "http:";
+        url += location;
+        std::string scheme;
+        return Utils::parseUrl(url, scheme, target.host, target.port, target.path) && !target.host.empty();
+    }
+    if (location.front() == '/') {
+        target.host = base.host;
+        target.port = base.port;
+        target.path.assign(location);
+        return true;
+    }
+    size_t schemeEnd = location.find("://");
+    if (schemeEnd != std::string_view::npos && schemeEnd < location.find('/')) {
+        // https прокси не обслуживает: такой редирект получит клиент
+        std::string scheme;
+        return Utils::parseUrl(location, scheme, target.host, target.port, target.path) && scheme == "http" &&
+               !target.host.empty();
+    }
+    // Путь относительно каталога запрошенного URL
+    std::string_view dir(base.path);
+    dir = dir.substr(0, dir.find('?'));
+    size_t slash = dir.rfind('/');
+    target.host = base.host;
+    target.port = base.port;
+    target.path.assign(slash == std::string_view::npos ? "/" : dir.substr(0, slash + 1));
+    target.path += location;
+    return true;
+}
+
+RedirectHandler::Shard &RedirectHandler::shardFor(const std::string &key) {
+    return shards[std::hash<std::string>()(key) % kShards];
+}
+
+void RedirectHandler::remember(const std::string &key, const Target &target, const std::string &headers) {
+    if (!enabled()) return;
+    // Постоянный редирект хранится долго, если сервер явно не ограничил срок
+    std::chrono::seconds lifetime = kDefaultLifetime;
+    std::string value;
+    if (Utils::findHeader(headers, "cache-control", value) || Utils::findHeader(headers, "expires", value)) {
+        bool storable;
+        lifetime = ResponseCache::freshnessLifetime(headers, storable);
+        if (!storable || lifetime.count() == 0) return;
+    }
+
+    Shard &shard = shardFor(key);
+    size_t capacity = std::max<size_t>(1, maxEntries / kShards);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+    shard.lru.emplace_front(key, Entry{target, std::chrono::steady_clock::now() + lifetime});
+    shard.index[key] = shard.lru.begin();
+    while (shard.lru.size() > capacity) {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+    }
+    counters.stores.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool RedirectHandler::lookup(const std::string &key, Target &target) {
+    if (!enabled()) return false;
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) return false;
+    if (std::chrono::steady_clock::now() >= it->second->second.expires) {
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    target = it->second->second.target;
+    counters.hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
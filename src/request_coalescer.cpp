@@ -0,0 +1,178 @@
+#include "request_coalescer.hpp"
+#include <algorithm>
+#include <cstdint>
+
+bool RequestCoalescer::enabledFlag = true;
+
+void InflightResponse::publishHeaders(std::string headerPart, bool canShare, bool contentLength) {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        headers = std::make_shared<const std::string>(std::move(headerPart));
+        shareable = canShare;
+        haveContentLength = contentLength;
+        headersReady = true;
+    }
+    notifyAll();
+}
+
+void InflightResponse::publishBody(const char *data, size_t len) {
+    if (len == 0) return;
+    std::vector<std::shared_ptr<InflightSubscription>> lagging;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        segments.push_back(std::make_shared<const std::string>(data, len));
+        segmentOffsets.push_back(published);
+        published += len;
+        buffered += len;
+        if (buffered > kMaxBuffered) {
+            // Медленный клиент не должен заставлять лидера держать всё тело в памяти
+            for (auto it = subscribers.begin(); it != subscribers.end();) {
+                if (bytesFrom((*it)->consumed) > kMaxBuffered) {
+                    (*it)->detached = true;
+                    lagging.push_back(*it);
+                    it = subscribers.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (!lagging.empty()) trim();
+        }
+    }
+    for (auto &sub : lagging) notify(sub);
+    notifyAll();
+}
+
+void InflightResponse::complete() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        completed = true;
+    }
+    notifyAll();
+}
+
+void InflightResponse::fail() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (completed) return;
+        failed = true;
+    }
+    notifyAll();
+}
+
+bool InflightResponse::subscribe(const std::shared_ptr<InflightSubscription> &sub) {
+    std::lock_guard<std::mutex> lock(mtx);
+    // Начало тела уже освобождено: новому ведомому его не прочитать
+    if (failed || (headersReady && !shareable) || dropped > 0) return false;
+    sub->consumed = 0;
+    subscribers.push_back(sub);
+    return true;
+}
+
+void InflightResponse::unsubscribe(const std::shared_ptr<InflightSubscription> &sub) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = std::find(subscribers.begin(), subscribers.end(), sub);
+    if (it == subscribers.end()) return;
+    subscribers.erase(it);
+    trim();
+}
+
+bool InflightResponse::hasSubscribers() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return !subscribers.empty();
+}
+
+size_t InflightResponse::bufferedBytes() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return buffered;
+}
+
+InflightResponse::Snapshot InflightResponse::read(const std::shared_ptr<InflightSubscription> &sub,
+                                                   size_t fromSegment) {
+    std::lock_guard<std::mutex> lock(mtx);
+    Snapshot snap;
+    snap.headersReady = headersReady;
+    snap.shareable = shareable;
+    snap.complete = completed;
+    snap.failed = failed || sub->detached;
+    snap.haveContentLength = haveContentLength;
+    snap.headers = headers;
+    if (sub->detached) return snap;
+    if (fromSegment > sub->consumed) {
+        sub->consumed = fromSegment;
+        trim();
+    }
+    if (fromSegment < dropped + segments.size()) {
+        snap.segments.assign(segments.begin() + (fromSegment - dropped), segments.end());
+    }
+    return snap;
+}
+
+void InflightResponse::trim() {
+    // Без ведомых держим всё, пока можно подписаться с самого начала (объём ограничивает лидер)
+    if (subscribers.empty() && dropped == 0) return;
+    size_t keepFrom = SIZE_MAX;
+    for (auto &sub : subscribers) keepFrom = std::min(keepFrom, sub->consumed);
+    while (dropped < keepFrom && !segments.empty()) {
+        buffered -= segments.front()->size();
+        segments.pop_front();
+        segmentOffsets.pop_front();
+        dropped++;
+    }
+}
+
+uint64_t InflightResponse::bytesFrom(size_t index) const {
+    if (index < dropped) index = dropped;
+    if (index - dropped >= segments.size()) return 0;
+    return published - segmentOffsets[index - dropped];
+}
+
+void InflightResponse::notifyAll() {
+    std::vector<std::shared_ptr<InflightSubscription>> subs;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        subs = subscribers;
+    }
+    for (auto &sub : subs) notify(sub);
+}
+
+void InflightResponse::notify(const std::shared_ptr<InflightSubscription> &sub) {
+    // Одного ожидающего уведомления достаточно: ведомый дочитает всё, что накопилось
+    if (sub->pending.exchange(true)) return;
+    sub->loop->post([sub] {
+        sub->pending.store(false);
+        if (sub->active) sub->notify();
+    });
+}
+
+RequestCoalescer &RequestCoalescer::instance() {
+    static RequestCoalescer coalescer;
+    return coalescer;
+}
+
+void RequestCoalescer::configure(bool enabled) {
+    enabledFlag = enabled;
+}
+
+std::shared_ptr<InflightResponse> RequestCoalescer::join(const std::string &key,
+                                                         const std::shared_ptr<InflightSubscription> &sub,
+                                                         bool &leader) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = inflight.find(key);
+    if (it != inflight.end() && it->second->subscribe(sub)) {
+        collapsed.fetch_add(1, std::memory_order_relaxed);
+        leader = false;
+        return it->second;
+    }
+    auto stream = std::make_shared<InflightResponse>();
+    inflight[key] = stream;
+    leader = true;
+    return stream;
+}
+
+void RequestCoalescer::finish(const std::string &key, const std::shared_ptr<InflightResponse> &stream) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = inflight.find(key);
+    if (it != inflight.end() && it->second == stream) {
+        inflight.erase(it);
+    }
+}
@@ -0,0 +1,94 @@
+#include "request_parser.hpp"
+#include <cstring>
+#include <strings.h>
+
+namespace {
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    std::string_view trimmed(const char *data, size_t begin, size_t end) {
+        while (begin < end && isSpace(data[begin])) begin++;
+        while (end > begin && isSpace(data[end - 1])) end--;
+        return std::string_view(data + begin, end - begin);
+    }
+
+    // Следующее слово стартовой строки, пустое - слов больше нет
+    std::string_view nextWord(std::string_view &rest) {
+        size_t b = 0;
+        while (b < rest.size() && (rest[b] == ' ' || rest[b] == '\t')) b++;
+        size_t e = b;
+        while (e < rest.size() && rest[e] != ' ' && rest[e] != '\t') e++;
+        std::string_view word = rest.substr(b, e - b);
+        rest.remove_prefix(e);
+        return word;
+    }
+}
+
+const HeaderField *RequestView::find(std::string_view name) const {
+    for (const auto &field : headers) {
+        if (field.name.size() == name.size() &&
+            strncasecmp(field.name.data(), name.data(), name.size()) == 0) {
+            return &field;
+        }
+    }
+    return nullptr;
+}
+
+RequestParser::Result RequestParser::parse(const char *data, size_t len, RequestView &req, bool eof) {
+    while (true) {
+        HeaderScan::Result r = HeaderScan::scan(data, len, pos, lines);
+        pos = r.consumed;
+        if (r.complete) {
+            // Пустые строки перед стартовой строкой пропускаем
+            if (lines.empty()) continue;
+            return finish(data, req);
+        }
+        if (!eof) return Result::NeedMore;
+
+        // Соединение закрыто без пустой строки: недописанная строка - последняя
+        if (pos < len) {
+            size_t end = len;
+            if (data[end - 1] == '\r') end--;
+            const void *colon = memchr(data + pos, ':', end - pos);
+            lines.push_back({(uint32_t)pos, (uint32_t)end,
+                             colon ? (uint32_t)(static_cast<const char*>(colon) - data) : HeaderScan::kNoColon});
+            pos = len;
+        }
+        if (lines.empty()) return Result::Error;
+        return finish(data, req);
+    }
+}
+
+void RequestParser::reset() {
+    pos = 0;
+    lines.clear();
+}
+
+RequestParser::Result RequestParser::finish(const char *data, RequestView &req) {
+    std::string_view start = trimmed(data, lines[0].begin, lines[0].end);
+    req.method = nextWord(start);
+    req.path = nextWord(start);
+    req.version = nextWord(start);
+    if (req.method.empty() || req.path.empty() || req.version.empty()) return Result::Error;
+
+    req.headers.clear();
+    for (size_t i = 1; i < lines.size(); i++) {
+        const HeaderScan::Line &line = lines[i];
+        if (line.colon == HeaderScan::kNoColon) continue;
+        req.headers.push_back({trimmed(data, line.begin, line.colon), trimmed(data, line.colon + 1, line.end)});
+    }
+    return Result::Done;
+}
+
+void RequestParser::toRequest(const RequestView &view, HttpRequest &req) {
+    req.method.assign(view.method);
+    req.path.assign(view.path);
+    req.version.assign(view.version);
+    req.headers.clear();
+    for (const auto &field : view.headers) {
+        std::pmr::string name(field.name, req.headers.get_allocator());
+        for (auto &c : name) c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+        req.headers[std::move(name)].assign(field.value);
+    }
+}
@@ -0,0 +1,266 @@
+#include "response_cache.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <ctime>
+#include <functional>
+
+size_t ResponseCache::maxBytes = 0;
+size_t ResponseCache::maxObjectBytes = 0;
+
+namespace {
+    constexpr size_t kMaxObjectLimit = 8 * 1024 * 1024;
+    // Примерные накладные расходы на запись: узлы списка и хеш-таблицы, ключ
+    constexpr size_t kEntryOverhead = 256;
+
+    std::string toLower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+        return s;
+    }
+
+    // Значение директивы вида name=N из Cache-Control, -1 если директивы нет
+    long directiveSeconds(const std::string &cacheControl, const std::string &name) {
+        size_t pos = 0;
+        while ((pos = cacheControl.find(name, pos)) != std::string::npos) {
+            bool atStart = pos == 0 || cacheControl[pos - 1] == ' ' || cacheControl[pos - 1] == ',';
+            size_t eq = pos + name.size();
+            if (atStart && eq < cacheControl.size() && cacheControl[eq] == '=') {
+                std::string value = cacheControl.substr(eq + 1);
+                if (!value.empty() && value[0] == '"') value.erase(0, 1);
+                try {
+                    return std::max(0L, std::stol(value));
+                } catch (...) {
+                    return -1;
+                }
+            }
+            pos = eq;
+        }
+        return -1;
+    }
+
+    // Значение заголовка из Vary без пробелов вокруг запятых: "gzip, br" и "gzip,br" - один вариант
+    std::string varyValue(const HttpRequest &req, const std::string &name) {
+        const std::pmr::string *value = req.header(name);
+        std::string out;
+        if (!value) return out;
+        out.reserve(value->size());
+        for (char c : *value) {
+            if (c == ' ' || c == '\t') {
+                if (!out.empty() && out.back() != ',' && out.back() != ' ') out += ' ';
+                continue;
+            }
+            if (c == ',' && !out.empty() && out.back() == ' ') out.pop_back();
+            out += c;
+        }
+        if (!out.empty() && out.back() == ' ') out.pop_back();
+        return out;
+    }
+}
+
+size_t CachedResponse::cost() const {
+    size_t varyBytes = 0;
+    for (const auto &v : vary) varyBytes += v.first.size() + v.second.size();
+    return data->size() + etag.size() + lastModified.size() + varyBytes + kEntryOverhead;
+}
+
+bool CachedResponse::matches(const HttpRequest &req) const {
+    for (const auto &v : vary) {
+        if (varyValue(req, v.first) != v.second) return false;
+    }
+    return true;
+}
+
+ResponseCache &ResponseCache::instance() {
+    static ResponseCache cache;
+    return cache;
+}
+
+void ResponseCache::configure(size_t bytes) {
+    maxBytes = bytes;
+    maxObjectBytes = std::min(bytes / kShards, kMaxObjectLimit);
+}
+
+std::string ResponseCache::makeKey(const std::string &host, int port, const std::string &path) {
+    return toLower(host) + ":" + std::to_string(port) + path;
+}
+
+bool ResponseCache::requestCacheable(const HttpRequest &req) {
+    if (req.method != "GET") return false;
+    // Ответы на авторизованные, условные и частичные запросы проходят мимо кеша
+    for (const char *name : {"authorization", "if-none-match", "if-modified-since", "if-match", "range"}) {
+        if (req.header(name)) return false;
+    }
+    const std::pmr::string *cc = req.header("cache-control");
+    return !cc || toLower(std::string(*cc)).find("no-store") == std::string::npos;
+}
+
+bool ResponseCache::requestForcesRevalidation(const HttpRequest &req) {
+    if (const std::pmr::string *value = req.header("cache-control")) {
+        std::string cc = toLower(std::string(*value));
+        if (cc.find("no-cache") != std::string::npos || directiveSeconds(cc, "max-age") == 0) return true;
+    }
+    const std::pmr::string *pragma = req.header("pragma");
+    return pragma && toLower(std::string(*pragma)).find("no-cache") != std::string::npos;
+}
+
+std::chrono::seconds ResponseCache::freshnessLifetime(const std::string &headers, bool &storable) {
+    storable = true;
+    std::string cc;
+    if (Utils::findHeader(headers, "cache-control", cc)) {
+        cc = toLower(cc);
+        if (cc.find("no-store") != std::string::npos || cc.find("private") != std::string::npos) {
+            storable = false;
+            return std::chrono::seconds(0);
+        }
+        if (cc.find("no-cache") != std::string::npos) return std::chrono::seconds(0);
+        long seconds = directiveSeconds(cc, "s-maxage");
+        if (seconds < 0) seconds = directiveSeconds(cc, "max-age");
+        if (seconds >= 0) return std::chrono::seconds(seconds);
+    }
+    std::string pragma;
+    if (Utils::findHeader(headers, "pragma", pragma) && toLower(pragma).find("no-cache") != std::string::npos) {
+        return std::chrono::seconds(0);
+    }
+
+    std::string expiresStr;
+    std::time_t expires;
+    if (Utils::findHeader(headers, "expires", expiresStr)) {
+        if (!Utils::parseHttpDate(expiresStr, expires)) return std::chrono::seconds(0);
+        std::string dateStr;
+        std::time_t date;
+        if (!Utils::findHeader(headers, "date", dateStr) || !Utils::parseHttpDate(dateStr, date)) {
+            date = std::time(nullptr);
+        }
+        return std::chrono::seconds(std::max<std::time_t>(0, expires - date));
+    }
+    return std::chrono::seconds(0);
+}
+
+std::shared_ptr<CachedResponse> ResponseCache::prepare(const std::string &headers, int status, const HttpRequest &req) {
+    if (!enabled() || status != 200) return nullptr;
+
+    bool storable;
+    auto lifetime = freshnessLifetime(headers, storable);
+    if (!storable) return nullptr;
+    // Кеш общий для всех клиентов: чужая cookie из него не должна уйти другому клиенту
+    std::string cookie;
+    if (Utils::findHeader(headers, "set-cookie", cookie)) return nullptr;
+
+    auto entry = std::make_shared<CachedResponse>();
+    Utils::findHeader(headers, "etag", entry->etag);
+    Utils::findHeader(headers, "last-modified", entry->lastModified);
+    // Без срока свежести запись полезна только для условной перепроверки
+    if (lifetime.count() == 0 && !entry->hasValidators()) return nullptr;
+
+    std::string vary;
+    if (Utils::findHeader(headers, "vary", vary)) {
+        vary = toLower(vary);
+        if (vary.find('*') != std::string::npos) return nullptr;
+        size_t pos = 0;
+        while (pos <= vary.size()) {
+            size_t comma = vary.find(',', pos);
+            if (comma == std::string::npos) comma = vary.size();
+            std::string name = Utils::trim(vary.substr(pos, comma - pos));
+            if (!name.empty()) entry->vary.emplace_back(name, varyValue(req, name));
+            pos = comma + 1;
+        }
+    }
+
+    std::string ageStr;
+    long age = 0;
+    if (Utils::findHeader(headers, "age", ageStr)) {
+        age = std::atol(ageStr.c_str());
+    }
+    auto now = std::chrono::steady_clock::now();
+    entry->storedAt = now;
+    entry->expires = now + lifetime - std::chrono::seconds(std::min<long>(age, lifetime.count()));
+
+    // Сохраняем заголовки без hop-by-hop и без разметки тела: отдавать будем с Content-Length
+    std::string headerPart = Utils::stripHeaders(headers, {"transfer-encoding", "content-length", "age"});
+    entry->headerSize = headerPart.size();
+    entry->data = std::make_shared<const std::string>(std::move(headerPart));
+    return entry;
+}
+
+void ResponseCache::store(const std::string &key, std::shared_ptr<CachedResponse> entry, std::string &&body) {
+    if (body.size() > maxObjectBytes) return;
+    std::string buf;
+    buf.reserve(entry->headerSize + 32 + body.size());
+    buf.append(*entry->data);
+    buf += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    entry->headerSize = buf.size();
+    buf.append(body);
+    entry->data = std::make_shared<const std::string>(std::move(buf));
+    insert(key, std::move(entry));
+    counters.stores.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::refresh(const std::string &key,
+                                                             const std::shared_ptr<const CachedResponse> &old,
+                                                             const std::string &headers) {
+    auto entry = std::make_shared<CachedResponse>(*old);
+    bool storable;
+    auto lifetime = freshnessLifetime(headers, storable);
+    if (lifetime.count() == 0) {
+        // 304 без собственных указаний о свежести продлевает прежний срок
+        lifetime = std::chrono::duration_cast<std::chrono::seconds>(old->expires - old->storedAt);
+    }
+    Utils::findHeader(headers, "etag", entry->etag);
+    auto now = std::chrono::steady_clock::now();
+    entry->storedAt = now;
+    entry->expires = now + lifetime;
+    if (storable) insert(key, entry);
+    return entry;
+}
+
+std::shared_ptr<const CachedResponse> ResponseCache::lookup(const std::string &key, const HttpRequest &req) {
+    Shard &shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) return nullptr;
+    auto &variants = it->second;
+    for (size_t i = 0; i < variants.size(); i++) {
+        auto node = variants[i];
+        if (!node->second->matches(req)) continue;
+        std::rotate(variants.begin(), variants.begin() + i, variants.begin() + i + 1);
+        shard.lru.splice(shard.lru.begin(), shard.lru, node);
+        return node->second;
+    }
+    return nullptr;
+}
+
+ResponseCache::Shard &ResponseCache::shardFor(const std::string &key) {
+    return shards[std::hash<std::string>()(key) % kShards];
+}
+
+void ResponseCache::insert(const std::string &key, std::shared_ptr<const CachedResponse> entry) {
+    Shard &shard = shardFor(key);
+    size_t budget = maxBytes / kShards;
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    auto &variants = shard.index[key];
+    // Тот же вариант заменяется; если вариантов уже предел, уходит давно не использованный
+    auto same = std::find_if(variants.begin(), variants.end(),
+                             [&entry](const auto &node) { return node->second->vary == entry->vary; });
+    if (same == variants.end() && variants.size() >= kMaxVariants) {
+        same = variants.end() - 1;
+        counters.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (same != variants.end()) {
+        shard.bytes -= (*same)->second->cost();
+        shard.lru.erase(*same);
+        variants.erase(same);
+    }
+    shard.bytes += entry->cost();
+    shard.lru.emplace_front(key, std::move(entry));
+    variants.insert(variants.begin(), shard.lru.begin());
+
+    while (shard.bytes > budget && shard.lru.size() > 1) {
+        auto victim = std::prev(shard.lru.end());
+        auto owner = shard.index.find(victim->first);
+        auto &list = owner->second;
+        list.erase(std::find(list.begin(), list.end(), victim));
+        if (list.empty()) shard.index.erase(owner);
+        shard.bytes -= victim->second->cost();
+        shard.lru.erase(victim);
+        counters.evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
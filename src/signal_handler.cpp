@@ -14,6 +14,8 @@ void SignalHandler::init() {
     sa.sa_flags = 0;
     sigaction(SIGINT, &sa, nullptr);
     sigaction(SIGQUIT, &sa, nullptr);
+    // У splice() нет MSG_NOSIGNAL: запись в сокет, сброшенный клиентом, не должна убивать процесс
+    signal(SIGPIPE, SIG_IGN);
 }
 
 bool SignalHandler::shouldShutdown() {
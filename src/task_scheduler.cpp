@@ -0,0 +1,233 @@
+#include "task_scheduler.hpp"
+#include <chrono>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace {
+    // Сколько раз воркер перепроверяет очереди, прежде чем заснуть
+    constexpr int kSpinRounds = 64;
+    constexpr size_t kRunBudget = 64;
+
+    struct Binding {
+        TaskScheduler *scheduler = nullptr;
+        size_t index = 0;
+    };
+    thread_local Binding current;
+
+    inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+}
+
+TaskScheduler::TaskScheduler(size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        auto worker = std::make_unique<Worker>();
+        Worker *raw = worker.get();
+        worker->stealSeed = 0x9E3779B97F4A7C15ull * (i + 1);
+        worker->wake = [raw] {
+            std::lock_guard<std::mutex> lock(raw->parkMtx);
+            raw->notified = true;
+            raw->parkCv.notify_one();
+        };
+        workers.push_back(std::move(worker));
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    // Невыполненные задачи просто освобождаем
+    Task *task;
+    for (auto &worker : workers) {
+        while (worker->deque.pop(task)) delete task;
+    }
+    while (injected.pop(task)) delete task;
+    for (Task *t : overflow) delete t;
+}
+
+void TaskScheduler::bindCurrentThread(size_t index) {
+    current.scheduler = this;
+    current.index = index;
+}
+
+void TaskScheduler::setWaker(size_t index, std::function<void()> wake) {
+    workers[index]->wake = std::move(wake);
+}
+
+void TaskScheduler::submit(Task task) {
+    Task *item = new Task(std::move(task));
+    if (current.scheduler == this) {
+        if (workers[current.index]->deque.push(item)) {
+            // Свою задачу воркер выполнит сам; спящего соседа будим, чтобы он мог её украсть
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wakeOne();
+            return;
+        }
+    }
+    injectedCount.fetch_add(1, std::memory_order_relaxed);
+    if (!injected.push(item)) {
+        std::lock_guard<std::mutex> lock(overflowMtx);
+        overflow.push_back(item);
+        overflowSize.fetch_add(1, std::memory_order_release);
+    }
+    // Парная барьеру в prepareToPark(): либо воркер увидит задачу, либо мы увидим его спящим
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wakeOne();
+}
+
+TaskScheduler::Task *TaskScheduler::take(size_t index, bool &stolen) {
+    stolen = false;
+    Worker &self = *workers[index];
+    Task *task = nullptr;
+    if (self.deque.pop(task)) return task;
+    if (injected.pop(task)) return task;
+    if (overflowSize.load(std::memory_order_acquire) > 0) {
+        std::lock_guard<std::mutex> lock(overflowMtx);
+        if (!overflow.empty()) {
+            task = overflow.front();
+            overflow.pop_front();
+            overflowSize.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    // Крадём, начиная со случайного соседа, чтобы воры не толпились у одного дека
+    size_t n = workers.size();
+    if (n < 2) return nullptr;
+    self.stealSeed ^= self.stealSeed << 13;
+    self.stealSeed ^= self.stealSeed >> 7;
+    self.stealSeed ^= self.stealSeed << 17;
+    size_t start = self.stealSeed % n;
+    for (size_t i = 0; i < n; i++) {
+        size_t victim = (start + i) % n;
+        if (victim == index) continue;
+        if (workers[victim]->deque.steal(task)) {
+            stolen = true;
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+size_t TaskScheduler::runPending(size_t index, size_t budget) {
+    Worker &self = *workers[index];
+    size_t done = 0;
+    uint64_t stolenNow = 0;
+    while (done < budget) {
+        bool stolen;
+        Task *task = take(index, stolen);
+        if (!task) break;
+        if (stolen) stolenNow++;
+        (*task)();
+        delete task;
+        done++;
+    }
+    if (done > 0) {
+        self.executed.store(self.executed.load(std::memory_order_relaxed) + done, std::memory_order_relaxed);
+        self.stolen.store(self.stolen.load(std::memory_order_relaxed) + stolenNow, std::memory_order_relaxed);
+    }
+    return done;
+}
+
+bool TaskScheduler::hasWork(size_t index) const {
+    // Чужие деки не проверяем: их задачи в любом случае выполнят владельцы
+    return !injected.empty() || overflowSize.load(std::memory_order_acquire) > 0 ||
+           !workers[index]->deque.empty();
+}
+
+bool TaskScheduler::prepareToPark(size_t index) {
+    Worker &self = *workers[index];
+    // Флаг у каждого воркера свой: засыпание не трогает общих строк кеша
+    self.parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (hasWork(index)) {
+        unpark(index);
+        return false;
+    }
+    return true;
+}
+
+bool TaskScheduler::unpark(size_t index) {
+    std::atomic<bool> &parked = workers[index]->parked;
+    if (!parked.load(std::memory_order_relaxed)) return false;
+    bool expected = true;
+    return parked.compare_exchange_strong(expected, false, std::memory_order_acq_rel);
+}
+
+void TaskScheduler::unparked(size_t index) {
+    unpark(index);
+}
+
+void TaskScheduler::wakeOne() {
+    // Воркер, который сейчас ищет работу, найдёт и эту задачу: будить никого не нужно
+    if (spinning.load(std::memory_order_relaxed) > 0) return;
+    size_t n = workers.size();
+    size_t start = nextWake.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < n; i++) {
+        size_t index = (start + i) % n;
+        // Снимаем флаг сами: второй submit() не станет будить того же воркера
+        if (unpark(index)) {
+            wakeupCount.fetch_add(1, std::memory_order_relaxed);
+            workers[index]->wake();
+            return;
+        }
+    }
+}
+
+void TaskScheduler::wakeAll() {
+    for (size_t i = 0; i < workers.size(); i++) {
+        unpark(i);
+        workers[i]->wake();
+    }
+}
+
+void TaskScheduler::runWorker(size_t index, const std::atomic<bool> &stop) {
+    bindCurrentThread(index);
+    Worker &self = *workers[index];
+    while (!stop.load(std::memory_order_relaxed)) {
+        if (runPending(index, kRunBudget) > 0) continue;
+
+        // Прокрутка: работа часто появляется сразу после того, как кончилась
+        bool found = false;
+        spinning.fetch_add(1, std::memory_order_seq_cst);
+        for (int spin = 0; spin < kSpinRounds && !found; spin++) {
+            // Вторая половина прокрутки уступает процессор: потоков может быть больше, чем ядер
+            if (spin < kSpinRounds / 2) {
+                cpuRelax();
+            } else {
+                std::this_thread::yield();
+            }
+            found = runPending(index, kRunBudget) > 0;
+        }
+        spinning.fetch_sub(1, std::memory_order_seq_cst);
+        if (found || !prepareToPark(index)) continue;
+        {
+            std::unique_lock<std::mutex> lock(self.parkMtx);
+            self.parkCv.wait_for(lock, std::chrono::milliseconds(100), [&] {
+                return self.notified || stop.load(std::memory_order_relaxed);
+            });
+            self.notified = false;
+        }
+        unparked(index);
+    }
+}
+
+TaskScheduler::Stats TaskScheduler::stats() const {
+    Stats s;
+    for (auto &worker : workers) {
+        s.executed += worker->executed.load(std::memory_order_relaxed);
+        s.stolen += worker->stolen.load(std::memory_order_relaxed);
+    }
+    s.injected = injectedCount.load(std::memory_order_relaxed);
+    s.wakeups = wakeupCount.load(std::memory_order_relaxed);
+    return s;
+}
+
+size_t TaskScheduler::queuedCount() const {
+    size_t count = injected.size() + overflowSize.load(std::memory_order_relaxed);
+    for (auto &worker : workers) count += worker->deque.size();
+    return count;
+}
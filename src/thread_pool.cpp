@@ -1,100 +1,194 @@
 #include "thread_pool.hpp"
 #include "logger.hpp"
-#include "http_parser.hpp"
+#include "listener.hpp"
 #include "connection_handler.hpp"
+#include <csignal>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
 #include <unistd.h>
-#include <sys/socket.h>
 
-bool ThreadPool::init(int numThreads) {
+// Собственный слушающий сокет воркера, зарегистрированный в его цикле событий
+class ThreadPool::ShardAcceptor : public EventHandler {
+public:
+    explicit ShardAcceptor(EventLoop &loop) : loop(loop) {}
+
+    bool start(int port) {
+        return listener.startListening(port, true);
+    }
+
+    void attach() {
+        if (!loop.acceptMultishot(listener.getSocketFd(), this)) {
+            loop.add(listener.getSocketFd(), EPOLLIN | EPOLLET, this);
+        }
+    }
+
+    void detach() {
+        loop.remove(listener.getSocketFd());
+    }
+
+    void onEvent(int, uint32_t) override {
+        int clientFd;
+        while ((clientFd = listener.acceptClient()) >= 0) {
+            serve(clientFd);
+        }
+    }
+
+    void onAccepted(int, int clientFd) override {
+        listener.countAccepted();
+        serve(clientFd);
+    }
+
+    uint64_t acceptedCount() const { return listener.acceptedCount(); }
+
+private:
+    // Очереди у шарда нет: соединение обслуживается сразу или получает отказ
+    void serve(int clientFd) {
+        LOG_DEBUG("Accepted new client: fd=" + std::to_string(clientFd));
+        AdmissionControl::Ticket ticket;
+        if (!AdmissionControl::instance().admit(clientFd, ticket)) return;
+        ThreadPool::startConnection(loop, clientFd, std::chrono::steady_clock::now(), std::move(ticket));
+    }
+
+    EventLoop &loop;
+    Listener listener;
+};
+
+// Связка цикла событий воркера с планировщиком задач: цикл спит в epoll_wait,
+// планировщик будит его через eventfd
+class ThreadPool::WorkerTasks : public IdleWork {
+public:
+    WorkerTasks(TaskScheduler &scheduler, size_t index) : scheduler(scheduler), index(index) {}
+
+    bool runPending() override { return scheduler.runPending(index, kBudget) > 0; }
+    bool prepareToPark() override { return scheduler.prepareToPark(index); }
+    void unparked() override { scheduler.unparked(index); }
+
+private:
+    // Задач за один проход цикла: события epoll не должны ждать долго
+    static constexpr size_t kBudget = 64;
+
+    TaskScheduler &scheduler;
+    size_t index;
+};
+
+bool ThreadPool::init(int numThreads, bool pinCpus) {
+    scheduler = std::make_unique<TaskScheduler>(numThreads);
     for (int i = 0; i < numThreads; i++) {
-        workers.emplace_back(&ThreadPool::workerFunc, this);
+        auto loop = std::make_unique<EventLoop>();
+        if (!loop->init()) return false;
+        EventLoop *raw = loop.get();
+        scheduler->setWaker(i, [raw] { raw->wakeup(); });
+        workerTasks.push_back(std::make_unique<WorkerTasks>(*scheduler, i));
+        loop->setIdleWork(workerTasks.back().get());
+        loops.push_back(std::move(loop));
+    }
+    // Освободилось место для ждущего соединения
+    AdmissionControl::instance().setWakeup([this] { submit(&ThreadPool::serveQueued); });
+
+    // Сигналы завершения должны приходить в основной поток, чтобы прервать его ожидание
+    sigset_t blocked, old;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    unsigned cpus = std::thread::hardware_concurrency();
+    for (size_t i = 0; i < loops.size(); i++) {
+        workers.emplace_back(&ThreadPool::workerFunc, this, i);
+        if (pinCpus && cpus > 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % cpus, &set);
+            if (pthread_setaffinity_np(workers.back().native_handle(), sizeof(set), &set) != 0) {
+                LOG_ERROR("ThreadPool: cannot pin worker " + std::to_string(i) + " to CPU");
+            }
+        }
     }
+    pthread_sigmask(SIG_SETMASK, &old, nullptr);
     return true;
 }
 
+ThreadPool::ThreadPool() = default;
+
 ThreadPool::~ThreadPool() {
     shutdown();
 }
 
 void ThreadPool::shutdown() {
-    {
-        std::lock_guard<std::mutex> lock(mtx);
-        stop.store(true, std::memory_order_relaxed);
+    AdmissionControl::instance().setWakeup({});
+    for (size_t i = 0; i < loops.size(); i++) {
+        EventLoop *loop = loops[i].get();
+        if (i < acceptors.size()) {
+            ShardAcceptor *acceptor = acceptors[i].get();
+            loop->post([acceptor] { acceptor->detach(); });
+        }
+        loop->stop();
     }
-    cv.notify_all();
     for (auto &w : workers) {
         if (w.joinable()) w.join();
     }
+    AdmissionControl::instance().clear();
 }
 
 void ThreadPool::submitTask(int clientFd) {
-    {
-        std::lock_guard<std::mutex> lock(mtx);
-        tasks.push(clientFd);
+    if (loops.empty()) {
+        close(clientFd);
+        return;
     }
-    cv.notify_one();
+    // Время в очереди допуска и планировщика входит в задержку первого запроса
+    if (!AdmissionControl::instance().enqueue(clientFd)) return;
+    submit(&ThreadPool::serveQueued);
 }
 
+void ThreadPool::serveQueued() {
+    AdmissionControl::Ticket ticket;
+    std::chrono::steady_clock::time_point acceptedAt;
+    int clientFd = AdmissionControl::instance().take(ticket, acceptedAt);
+    if (clientFd < 0) return;
+    startConnection(*EventLoop::current(), clientFd, acceptedAt, std::move(ticket));
+}
 
-void ThreadPool::workerFunc() {
-    while (true) {
-        int clientFd;
-        {
-            std::unique_lock<std::mutex> lock(mtx);
-            cv.wait(lock, [this] { return stop.load(std::memory_order_relaxed) || !tasks.empty(); });
-            if (stop.load(std::memory_order_relaxed) && tasks.empty()) break;
-            clientFd = tasks.front();
-            tasks.pop();
-        }
-
-        Logger::info("ThreadPool: Handling new client fd=" + std::to_string(clientFd));
+void ThreadPool::submit(std::function<void()> task) {
+    scheduler->submit(std::move(task));
+}
 
-        std::string buffer;
-        char buf[1024];
-        ssize_t n = read(clientFd, buf, sizeof(buf)-1);
-        if (n <= 0) {
-            Logger::error("ThreadPool: client closed connection or read error");
-            close(clientFd);
-            continue;
-        }
-        buf[n] = '\0';
-        buffer = buf;
-
-        HttpRequest req;
-        HttpParser parser;
-        if (!parser.parse(buffer, req)) {
-            Logger::error("ThreadPool: Failed to parse HTTP request");
-            std::string err = "HTTP/1.0 400 Bad Request\r\n\r\nBad Request\r\n";
-            send(clientFd, err.data(), err.size(), 0);
-            close(clientFd);
-            continue;
-        }
+TaskScheduler::Stats ThreadPool::taskStats() const {
+    return scheduler ? scheduler->stats() : TaskScheduler::Stats();
+}
 
-        if (req.method != "GET") {
-            Logger::info("ThreadPool: Request method not implemented: " + req.method);
-            std::string err = "HTTP/1.0 501 Not Implemented\r\n\r\nMethod Not Implemented\r\n";
-            send(clientFd, err.data(), err.size(), 0);
-            close(clientFd);
-            continue;
-        }
+size_t ThreadPool::queuedTasks() const {
+    return scheduler ? scheduler->queuedCount() : 0;
+}
 
-        Logger::info("ThreadPool: Parsed request: " + req.method + " " + req.path + " " + req.version);
-        auto h = req.headers.find("host");
-        if (h != req.headers.end()) {
-            Logger::info("ThreadPool: Host: " + h->second);
-        }
+bool ThreadPool::startListeners(int port) {
+    for (auto &loop : loops) {
+        auto acceptor = std::make_unique<ShardAcceptor>(*loop);
+        if (!acceptor->start(port)) return false;
+        ShardAcceptor *raw = acceptor.get();
+        acceptors.push_back(std::move(acceptor));
+        loop->post([raw] { raw->attach(); });
+    }
+    return true;
+}
 
-        ConnectionHandler handler;
-        if (!handler.processRequest(req, clientFd)) {
-            Logger::error("ThreadPool: processRequest failed, sending error to client");
-            std::string err = "HTTP/1.0 502 Bad Gateway\r\n\r\nError processing request\r\n";
-            send(clientFd, err.data(), err.size(), 0);
-        }
+std::vector<uint64_t> ThreadPool::listenerAcceptCounts() const {
+    std::vector<uint64_t> counts;
+    for (auto &acceptor : acceptors) {
+        counts.push_back(acceptor->acceptedCount());
+    }
+    return counts;
+}
 
-        // В этот момент данные уже отправлены клиенту внутри processRequest,
-        // либо в случае ошибки мы отправили сообщение об ошибке.
+void ThreadPool::startConnection(EventLoop &loop, int clientFd, std::chrono::steady_clock::time_point acceptedAt,
+                                 AdmissionControl::Ticket ticket) {
+    LOG_DEBUG("ThreadPool: Handling new client fd=" + std::to_string(clientFd));
+    auto handler = std::make_unique<ConnectionHandler>(loop, clientFd, acceptedAt, std::move(ticket));
+    ConnectionHandler *raw = handler.get();
+    loop.adopt(std::move(handler));
+    raw->start();
+}
 
-        close(clientFd);
-        Logger::info("ThreadPool: Finished handling client");
-    }
+void ThreadPool::workerFunc(size_t index) {
+    scheduler->bindCurrentThread(index);
+    loops[index]->run();
 }
@@ -0,0 +1,131 @@
+#include "upstream_connector.hpp"
+#include "logger.hpp"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+    constexpr uint32_t kWatchEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    // Задержка перед следующей попыткой, рекомендованная RFC 8305
+    constexpr std::chrono::milliseconds kAttemptDelay{250};
+}
+
+UpstreamConnector::UpstreamConnector(EventLoop &loop, EventHandler *owner, std::function<void()> wake)
+        : loop(loop), owner(owner), wake(std::move(wake)) {}
+
+UpstreamConnector::~UpstreamConnector() {
+    reset();
+}
+
+bool UpstreamConnector::start(const DnsResult &result, int port) {
+    reset();
+    candidates.clear();
+    next = 0;
+
+    // Чередуем семейства, начиная с IPv6: недоступная сеть одного семейства
+    // стоит не больше одной задержки
+    std::vector<ResolvedAddress> v6, v4;
+    for (const auto &addr : result.addresses) {
+        (addr.addr.ss_family == AF_INET6 ? v6 : v4).push_back(addr);
+    }
+    for (size_t i = 0; i < v6.size() || i < v4.size(); i++) {
+        if (i < v6.size()) candidates.push_back(v6[i]);
+        if (i < v4.size()) candidates.push_back(v4[i]);
+    }
+    for (auto &candidate : candidates) {
+        if (candidate.addr.ss_family == AF_INET6) {
+            reinterpret_cast<sockaddr_in6*>(&candidate.addr)->sin6_port = htons((uint16_t)port);
+        } else {
+            reinterpret_cast<sockaddr_in*>(&candidate.addr)->sin_port = htons((uint16_t)port);
+        }
+    }
+    return launchNext();
+}
+
+bool UpstreamConnector::launchNext() {
+    while (next < candidates.size()) {
+        const ResolvedAddress &candidate = candidates[next++];
+        int fd = socket(candidate.addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) continue;
+        bool ready = false;
+        if (connect(fd, reinterpret_cast<const sockaddr*>(&candidate.addr), candidate.len) == 0) {
+            ready = true;
+        } else if (errno != EINPROGRESS) {
+            LOG_ERROR("UpstreamConnector: connect failed: " + std::string(strerror(errno)));
+            close(fd);
+            continue;
+        }
+        if (!loop.add(fd, kWatchEvents, owner)) {
+            close(fd);
+            continue;
+        }
+        attempts.push_back({fd, ready});
+        armDelay();
+        return true;
+    }
+    cancelDelay();
+    return false;
+}
+
+void UpstreamConnector::armDelay() {
+    cancelDelay();
+    if (next >= candidates.size()) return;
+    delayTimer = loop.addTimer(kAttemptDelay, [this] {
+        delayTimer = 0;
+        // Текущие попытки не отменяем: какая ответит первой, та и победит
+        if (!launchNext() && attempts.empty()) wake();
+    });
+}
+
+void UpstreamConnector::cancelDelay() {
+    if (delayTimer == 0) return;
+    loop.cancelTimer(delayTimer);
+    delayTimer = 0;
+}
+
+bool UpstreamConnector::onEvent(int fd) {
+    for (auto &attempt : attempts) {
+        if (attempt.fd == fd) {
+            attempt.ready = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+UpstreamConnector::Status UpstreamConnector::poll(int &fd) {
+    for (size_t i = 0; i < attempts.size();) {
+        if (!attempts[i].ready) {
+            i++;
+            continue;
+        }
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+            fd = attempts[i].fd;
+            attempts.erase(attempts.begin() + i);
+            reset();
+            return Status::Connected;
+        }
+        LOG_ERROR("UpstreamConnector: connect failed: " + std::string(strerror(err)));
+        closeAttempt(i);
+        // Ошибка не ждёт задержки: сразу пробуем следующий адрес
+        launchNext();
+    }
+    if (!attempts.empty() || next < candidates.size()) return Status::Pending;
+    return Status::Failed;
+}
+
+void UpstreamConnector::closeAttempt(size_t index) {
+    loop.remove(attempts[index].fd);
+    close(attempts[index].fd);
+    attempts.erase(attempts.begin() + index);
+}
+
+void UpstreamConnector::reset() {
+    cancelDelay();
+    while (!attempts.empty()) closeAttempt(attempts.size() - 1);
+}
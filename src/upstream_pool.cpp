@@ -0,0 +1,95 @@
+#include "upstream_pool.hpp"
+#include "metrics.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+
+size_t UpstreamPool::maxIdlePerHost = 8;
+std::chrono::seconds UpstreamPool::idleTimeout{30};
+
+UpstreamPool::~UpstreamPool() {
+    for (auto &entry : idle) {
+        for (auto &conn : entry.second) close(conn.fd);
+    }
+}
+
+UpstreamPool &UpstreamPool::local() {
+    thread_local UpstreamPool pool;
+    return pool;
+}
+
+void UpstreamPool::configure(size_t maxIdle, int idleTimeoutSec) {
+    maxIdlePerHost = maxIdle;
+    idleTimeout = std::chrono::seconds(idleTimeoutSec);
+}
+
+int UpstreamPool::acquire(const std::string &host, int port) {
+    if (!enabled()) return -1;
+    auto it = idle.find(key(host, port));
+    if (it == idle.end()) return -1;
+
+    auto now = std::chrono::steady_clock::now();
+    auto &conns = it->second;
+    // Берём самое свежее соединение: у него меньше шансов быть закрытым сервером
+    while (!conns.empty()) {
+        IdleConnection conn = conns.back();
+        conns.pop_back();
+        countIdle(-1);
+        if (now - conn.since < idleTimeout && isAlive(conn.fd)) {
+            if (conns.empty()) idle.erase(it);
+            return conn.fd;
+        }
+        close(conn.fd);
+    }
+    idle.erase(it);
+    return -1;
+}
+
+void UpstreamPool::release(const std::string &host, int port, int fd) {
+    if (!enabled()) {
+        close(fd);
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    auto &conns = idle[key(host, port)];
+    if (conns.size() >= maxIdlePerHost) {
+        close(conns.front().fd);
+        conns.pop_front();
+        countIdle(-1);
+    }
+    conns.push_back({fd, now});
+    countIdle(1);
+
+    if (now - lastPrune >= idleTimeout) {
+        pruneExpired(now);
+        lastPrune = now;
+    }
+}
+
+std::string UpstreamPool::key(const std::string &host, int port) {
+    return host + ":" + std::to_string(port);
+}
+
+bool UpstreamPool::isAlive(int fd) {
+    // Простаивающее соединение не должно быть ни закрыто сервером, ни содержать данных
+    char c;
+    ssize_t r = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+void UpstreamPool::pruneExpired(std::chrono::steady_clock::time_point now) {
+    for (auto it = idle.begin(); it != idle.end();) {
+        auto &conns = it->second;
+        while (!conns.empty() && now - conns.front().since >= idleTimeout) {
+            close(conns.front().fd);
+            conns.pop_front();
+            countIdle(-1);
+        }
+        it = conns.empty() ? idle.erase(it) : std::next(it);
+    }
+}
+
+void UpstreamPool::countIdle(long delta) {
+    idleCount += delta;
+    Metrics::setUpstreamIdle(idleCount);
+}
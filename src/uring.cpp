@@ -0,0 +1,184 @@
+#include "uring.hpp"
+#include "logger.hpp"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+namespace {
+    int setup(unsigned entries, io_uring_params &params) {
+        return (int)syscall(__NR_io_uring_setup, entries, &params);
+    }
+
+    // Ядро не будит поток ради завершений (IPI), они дожидаются очередного входа в ядро -
+    // цикл и так входит в него в io_uring_enter. Флаг появился в 5.19, на старых ядрах без него
+    int setupRing(unsigned entries, io_uring_params &params) {
+        unsigned baseFlags = params.flags;
+        params.flags = baseFlags | IORING_SETUP_COOP_TASKRUN;
+        int fd = setup(entries, params);
+        if (fd < 0 && errno == EINVAL) {
+            unsigned cqEntries = params.cq_entries;
+            memset(&params, 0, sizeof(params));
+            params.flags = baseFlags;
+            params.cq_entries = cqEntries;
+            fd = setup(entries, params);
+        }
+        return fd;
+    }
+
+    bool opSupported(const io_uring_probe *probe, unsigned op) {
+        return op <= probe->last_op && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    // Многоразовый poll проверяется в деле: заявка на eventfd должна остаться взведённой
+    // (IORING_CQE_F_MORE) и сообщить о каждой из двух записей. EPOLLET ядра до 5.19 отбрасывают,
+    // но poll-заявка io_uring и так срабатывает по пробуждению файла, а не на каждом ожидании,
+    // как уровневый epoll: событий не меньше, чем фронтов, и обработчикам, читающим до EAGAIN,
+    // этого достаточно. Не прошедшее проверку ядро работает на epoll
+    bool multishotPollWorks() {
+        Uring ring;
+        if (!ring.init(4)) return false;
+        int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd < 0) return false;
+        bool armed = false;
+        if (io_uring_sqe *sqe = ring.sqe()) {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = efd;
+            sqe->len = IORING_POLL_ADD_MULTI;
+            sqe->poll32_events = EPOLLIN | EPOLLET;
+            sqe->user_data = 1;
+            armed = true;
+        }
+        int notified = 0;
+        for (int i = 0; i < 2 && armed; i++) {
+            uint64_t one = 1;
+            if (write(efd, &one, sizeof(one)) != sizeof(one) || !ring.submitAndWait(100)) break;
+            bool got = false;
+            ring.forEachCompletion([&](const io_uring_cqe &cqe) {
+                if (cqe.res > 0 && (cqe.res & EPOLLIN)) got = true;
+                if (!(cqe.flags & IORING_CQE_F_MORE)) armed = false;
+            });
+            if (got) notified++;
+        }
+        close(efd);
+        return armed && notified == 2;
+    }
+}
+
+Uring::~Uring() {
+    if (sqes) munmap(sqes, sqesSize);
+    if (ringMem) munmap(ringMem, ringSize);
+    if (ringFd >= 0) close(ringFd);
+}
+
+bool Uring::supported() {
+    io_uring_params params{};
+    int fd = setup(4, params);
+    if (fd < 0) return false;
+    // EXT_ARG (5.11) - таймаут ожидания в io_uring_enter; RSRC_TAGS (5.13) - ядро,
+    // в котором уже есть многоразовый poll
+    constexpr unsigned kRequired = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG |
+                                   IORING_FEAT_RSRC_TAGS;
+    bool ok = (params.features & kRequired) == kRequired;
+    if (ok) {
+        std::vector<char> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+        ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+             opSupported(probe, IORING_OP_POLL_ADD) && opSupported(probe, IORING_OP_ASYNC_CANCEL) &&
+             opSupported(probe, IORING_OP_ACCEPT) && opSupported(probe, IORING_OP_SEND);
+    }
+    close(fd);
+    return ok && multishotPollWorks();
+}
+
+bool Uring::init(unsigned entries) {
+    io_uring_params params{};
+    // Многоразовые poll дают по завершению на каждое пробуждение сокета: очередь
+    // завершений берём с запасом
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    ringFd = setupRing(entries, params);
+    if (ringFd < 0) {
+        LOG_ERROR("Uring: io_uring_setup failed: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // SINGLE_MMAP: кольца отправки и завершений лежат в одной области
+    ringSize = sqSize > cqSize ? sqSize : cqSize;
+    ringMem = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (ringMem == MAP_FAILED) {
+        ringMem = nullptr;
+        LOG_ERROR("Uring: cannot map rings");
+        return false;
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqeMem = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqeMem == MAP_FAILED) {
+        LOG_ERROR("Uring: cannot map submission entries");
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe *>(sqeMem);
+
+    auto *base = static_cast<char *>(ringMem);
+    sqHead = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+    sqArray = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+    sqMask = *reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqeTail = *sqTail;
+    cqHead = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(base + params.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe *Uring::sqe() {
+    unsigned pending = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (pending >= sqEntries) {
+        // Очередь полна: отдаём накопленное ядру, не дожидаясь конца пачки событий
+        __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+        enter(pending, 0, 0, nullptr, 0);
+        if (sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) return nullptr;
+    }
+    unsigned index = sqeTail & sqMask;
+    io_uring_sqe *entry = &sqes[index];
+    memset(entry, 0, sizeof(*entry));
+    sqArray[index] = index;
+    sqeTail++;
+    return entry;
+}
+
+bool Uring::submitAndWait(int timeoutMs) {
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+    unsigned toSubmit = sqeTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if (timeoutMs == 0) {
+        // Не ждём, но входим в ядро в любом случае: там же выполняются отложенные завершения
+        return enter(toSubmit, 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+    }
+    timespec ts{};
+    io_uring_getevents_arg arg{};
+    if (timeoutMs > 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+    return enter(toSubmit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+bool Uring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void *arg, size_t argSize) {
+    long ret = syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, arg, argSize);
+    if (ret >= 0) return true;
+    // ETIME - истёк таймаут, EINTR - сигнал, EBUSY/EAGAIN - переполнена очередь завершений
+    // (заявки отправятся со следующим вызовом, после разбора завершений)
+    if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) return true;
+    LOG_ERROR("Uring: io_uring_enter failed: " + std::string(strerror(errno)));
+    return false;
+}
@@ -1,5 +1,16 @@
 #include "utils.hpp"
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <strings.h>
+
+namespace {
+    std::string_view trimView(std::string_view s) {
+        while (!s.empty() && std::isspace((unsigned char)s.front())) s.remove_prefix(1);
+        while (!s.empty() && std::isspace((unsigned char)s.back())) s.remove_suffix(1);
+        return s;
+    }
+}
 
 std::string Utils::trim(const std::string &s) {
     if (s.empty()) return s;
@@ -19,20 +30,21 @@ std::string Utils::trim(const std::string &s) {
     return s.substr(start, end - start + 1);
 }
 
-bool Utils::parseUrl(const std::string &url, std::string &scheme, std::string &host, int &port, std::string &path) {
+bool Utils::parseUrl(std::string_view url, std::string &scheme, std::string &host, int &port, std::string &path) {
     port = 80;
     scheme.clear();
     host.clear();
-    path = "/";
+    path.clear();
 
-    std::string u = trim(url);
+    // Части URL - срезы исходной строки; копируются только результаты
+    std::string_view u = trimView(url);
     if (u.empty()) return false;
 
     // Ищем "://"
     auto schemePos = u.find("://");
-    if (schemePos != std::string::npos) {
-        scheme = u.substr(0, schemePos);
-        u = u.substr(schemePos + 3); // пропускаем "://"
+    if (schemePos != std::string_view::npos) {
+        scheme.assign(u.substr(0, schemePos));
+        u.remove_prefix(schemePos + 3); // пропускаем "://"
     } else {
         // Если нет схемы, считаем, что схема http
         scheme = "http";
@@ -49,27 +61,87 @@ bool Utils::parseUrl(const std::string &url, std::string &scheme, std::string &h
     // Теперь в u: host[:port]/path или просто host или host/path
     // Находим первый '/'
     auto slashPos = u.find('/');
-    std::string hostPort = (slashPos == std::string::npos) ? u : u.substr(0, slashPos);
-    if (slashPos != std::string::npos && slashPos+1 <= u.size()) {
-        path = u.substr(slashPos);
-        if (path.empty()) path = "/";
+    std::string_view hostPort = u.substr(0, slashPos);
+    // Путь присваивается один раз: без '/' после хоста это корень
+    if (slashPos != std::string_view::npos) {
+        path.assign(u.substr(slashPos));
+    } else {
+        path.assign(1, '/');
     }
 
     // Разбираем hostPort на host[:port]
     auto colonPos = hostPort.find(':');
-    if (colonPos != std::string::npos) {
-        host = trim(hostPort.substr(0, colonPos));
-        std::string portStr = trim(hostPort.substr(colonPos+1));
+    if (colonPos != std::string_view::npos) {
+        host.assign(trimView(hostPort.substr(0, colonPos)));
+        std::string_view portStr = trimView(hostPort.substr(colonPos + 1));
         if (portStr.empty()) return false;
-        try {
-            port = std::stoi(portStr);
-        } catch (...) {
-            return false;
-        }
+        auto res = std::from_chars(portStr.data(), portStr.data() + portStr.size(), port);
+        if (res.ec != std::errc()) return false;
     } else {
-        host = trim(hostPort);
+        host.assign(trimView(hostPort));
     }
 
     if (host.empty() || port <= 0) return false;
     return true;
 }
+
+bool Utils::isHopByHopHeader(std::string_view name) {
+    for (const char *hop : {"connection", "proxy-connection", "keep-alive", "te", "upgrade"}) {
+        if (name.size() == strlen(hop) && strncasecmp(name.data(), hop, name.size()) == 0) return true;
+    }
+    return false;
+}
+
+std::string Utils::stripHeaders(const std::string &headers, std::initializer_list<const char*> drop) {
+    std::string out;
+    out.reserve(headers.size());
+    size_t pos = 0;
+    bool first = true;
+    while (pos < headers.size()) {
+        size_t end = headers.find("\r\n", pos);
+        if (end == std::string::npos || end == pos) break;
+        if (!first) {
+            size_t colon = headers.find(':', pos);
+            if (colon == std::string::npos || colon > end) colon = end;
+            std::string name = headers.substr(pos, colon - pos);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            bool skip = isHopByHopHeader(name);
+            for (const char *d : drop) {
+                if (name == d) skip = true;
+            }
+            if (skip) {
+                pos = end + 2;
+                continue;
+            }
+        }
+        first = false;
+        out.append(headers, pos, end + 2 - pos);
+        pos = end + 2;
+    }
+    return out;
+}
+
+bool Utils::findHeader(const std::string &headers, const std::string &name, std::string &value) {
+    // Первая строка - стартовая, заголовки начинаются после первого \r\n
+    size_t pos = headers.find("\r\n");
+    while (pos != std::string::npos) {
+        pos += 2;
+        size_t end = headers.find("\r\n", pos);
+        if (end == std::string::npos || end == pos) return false;
+        if (end - pos > name.size() && headers[pos + name.size()] == ':' &&
+            strncasecmp(headers.data() + pos, name.data(), name.size()) == 0) {
+            value = trim(headers.substr(pos + name.size() + 1, end - pos - name.size() - 1));
+            return true;
+        }
+        pos = end;
+    }
+    return false;
+}
+
+bool Utils::parseHttpDate(const std::string &s, std::time_t &out) {
+    struct tm tm{};
+    const char *end = strptime(s.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end) return false;
+    out = timegm(&tm);
+    return out != (std::time_t)-1;
+}
@@ -0,0 +1,231 @@
+// Разбор двоичного журнала доступа (--access-log): распределение кодов ответа,
+// перцентили задержек по этапам, объём трафика и самые нагруженные серверы.
+// Использование: access_log_analyzer [-n N] FILE...
+#include "access_log.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+    struct HostStats {
+        uint64_t requests = 0;
+        uint64_t errors = 0; // 5xx и оборванные ответы
+        uint64_t bytesOut = 0;
+        std::vector<uint32_t> totalUs;
+    };
+
+    struct Summary {
+        uint64_t records = 0;
+        uint64_t firstUs = UINT64_MAX;
+        uint64_t lastUs = 0;
+        uint64_t bytesIn = 0;
+        uint64_t bytesOut = 0;
+        uint64_t redirected = 0;
+        std::map<uint16_t, uint64_t> statuses;
+        uint64_t flags[5] = {};
+        std::vector<uint32_t> parseUs, connectUs, firstByteUs, totalUs;
+        std::unordered_map<std::string, HostStats> hosts;
+    };
+
+    // Значение перцентиля p (0..1) в отсортированном массиве, ближайший ранг
+    uint32_t percentile(const std::vector<uint32_t> &sorted, double p) {
+        if (sorted.empty()) return 0;
+        size_t rank = (size_t)(p * (double)sorted.size());
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    std::string formatUs(uint32_t us) {
+        char buf[32];
+        if (us < 1000) snprintf(buf, sizeof(buf), "%uus", us);
+        else if (us < 1000000) snprintf(buf, sizeof(buf), "%.2fms", us / 1000.0);
+        else snprintf(buf, sizeof(buf), "%.2fs", us / 1e6);
+        return buf;
+    }
+
+    std::string formatBytes(uint64_t bytes) {
+        const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+        double value = (double)bytes;
+        size_t unit = 0;
+        while (value >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+            value /= 1024;
+            unit++;
+        }
+        char buf[32];
+        snprintf(buf, sizeof(buf), unit == 0 ? "%.0f%s" : "%.1f%s", value, units[unit]);
+        return buf;
+    }
+
+    void add(Summary &sum, const AccessRecord &rec) {
+        sum.records++;
+        sum.firstUs = std::min(sum.firstUs, rec.startUnixUs);
+        sum.lastUs = std::max(sum.lastUs, rec.startUnixUs);
+        sum.bytesIn += rec.bytesIn;
+        sum.bytesOut += rec.bytesOut;
+        if (rec.redirects > 0) sum.redirected++;
+        sum.statuses[rec.status]++;
+        for (int bit = 0; bit < 5; bit++) {
+            if (rec.flags & (1u << bit)) sum.flags[bit]++;
+        }
+        if (rec.parseUs != AccessRecord::kNotReached) sum.parseUs.push_back(rec.parseUs);
+        if (rec.connectUs != AccessRecord::kNotReached) sum.connectUs.push_back(rec.connectUs);
+        if (rec.firstByteUs != AccessRecord::kNotReached) sum.firstByteUs.push_back(rec.firstByteUs);
+        if (rec.lastByteUs != AccessRecord::kNotReached) sum.totalUs.push_back(rec.lastByteUs);
+
+        std::string host(rec.host, strnlen(rec.host, sizeof(rec.host)));
+        if (host.empty()) {
+            host.assign(1, '-');
+        } else {
+            host += ':';
+            host += std::to_string(rec.port);
+        }
+        HostStats &stats = sum.hosts[host];
+        stats.requests++;
+        stats.bytesOut += rec.bytesOut;
+        if (rec.status >= 500 || (rec.flags & AccessRecord::Aborted)) stats.errors++;
+        if (rec.lastByteUs != AccessRecord::kNotReached) stats.totalUs.push_back(rec.lastByteUs);
+    }
+
+    // Файл отображается в память целиком: записи фиксированного размера читаются на месте
+    bool readFile(const char *path, Summary &sum) {
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(AccessLogHeader)) {
+            fprintf(stderr, "%s: not an access log\n", path);
+            close(fd);
+            return false;
+        }
+        size_t size = (size_t)st.st_size;
+        void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "%s: mmap: %s\n", path, strerror(errno));
+            return false;
+        }
+        const char *data = static_cast<const char*>(map);
+        AccessLogHeader expected;
+        AccessLogHeader header;
+        memcpy(&header, data, sizeof(header));
+        if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version || header.recordSize != expected.recordSize) {
+            fprintf(stderr, "%s: unsupported access log format\n", path);
+            munmap(map, size);
+            return false;
+        }
+        size_t count = (size - sizeof(header)) / sizeof(AccessRecord);
+        if ((size - sizeof(header)) % sizeof(AccessRecord) != 0) {
+            // Хвост от прерванной записи не разбираем
+            fprintf(stderr, "%s: ignoring %zu trailing bytes\n", path, (size - sizeof(header)) % sizeof(AccessRecord));
+        }
+        sum.parseUs.reserve(sum.parseUs.size() + count);
+        sum.totalUs.reserve(sum.totalUs.size() + count);
+        for (size_t i = 0; i < count; i++) {
+            AccessRecord rec;
+            memcpy(&rec, data + sizeof(header) + i * sizeof(AccessRecord), sizeof(rec));
+            add(sum, rec);
+        }
+        munmap(map, size);
+        return true;
+    }
+
+    void printLatency(const char *name, std::vector<uint32_t> &values) {
+        if (values.empty()) {
+            printf("  %-12s %10s\n", name, "-");
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        printf("  %-12s %10zu %10s %10s %10s %10s %10s\n", name, values.size(),
+               formatUs(percentile(values, 0.5)).c_str(), formatUs(percentile(values, 0.9)).c_str(),
+               formatUs(percentile(values, 0.99)).c_str(), formatUs(percentile(values, 0.999)).c_str(),
+               formatUs(values.back()).c_str());
+    }
+
+    void printSummary(Summary &sum, size_t topHosts) {
+        double span = sum.lastUs > sum.firstUs ? (sum.lastUs - sum.firstUs) / 1e6 : 0.0;
+        printf("records: %llu over %.1fs", (unsigned long long)sum.records, span);
+        if (span > 0) printf(" (%.1f req/s)", sum.records / span);
+        printf("\n\nstatus:\n");
+        for (auto &status : sum.statuses) {
+            printf("  %-5s %10llu %6.2f%%\n", status.first ? std::to_string(status.first).c_str() : "none",
+                   (unsigned long long)status.second, 100.0 * status.second / sum.records);
+        }
+
+        printf("\nlatency from request start:\n  %-12s %10s %10s %10s %10s %10s %10s\n",
+               "stage", "count", "p50", "p90", "p99", "p99.9", "max");
+        printLatency("parsed", sum.parseUs);
+        printLatency("connected", sum.connectUs);
+        printLatency("first byte", sum.firstByteUs);
+        printLatency("last byte", sum.totalUs);
+
+        const char *flagNames[] = {"cache hits", "coalesced", "reused conns", "timed out", "aborted"};
+        printf("\ntraffic: in %s, out %s; redirected %llu\n", formatBytes(sum.bytesIn).c_str(),
+               formatBytes(sum.bytesOut).c_str(), (unsigned long long)sum.redirected);
+        for (int bit = 0; bit < 5; bit++) {
+            printf("  %-13s %10llu %6.2f%%\n", flagNames[bit], (unsigned long long)sum.flags[bit],
+                   100.0 * sum.flags[bit] / sum.records);
+        }
+
+        std::vector<std::pair<std::string, HostStats*>> hosts;
+        for (auto &host : sum.hosts) hosts.emplace_back(host.first, &host.second);
+        std::sort(hosts.begin(), hosts.end(), [](const auto &a, const auto &b) {
+            return a.second->requests != b.second->requests ? a.second->requests > b.second->requests
+                                                            : a.first < b.first;
+        });
+        if (hosts.size() > topHosts) hosts.resize(topHosts);
+        printf("\ntop %zu hosts:\n  %-40s %10s %8s %10s %10s %10s\n", hosts.size(), "host", "requests",
+               "errors", "p50", "p99", "out");
+        for (auto &host : hosts) {
+            HostStats &stats = *host.second;
+            std::sort(stats.totalUs.begin(), stats.totalUs.end());
+            printf("  %-40s %10llu %8llu %10s %10s %10s\n", host.first.c_str(), (unsigned long long)stats.requests,
+                   (unsigned long long)stats.errors, formatUs(percentile(stats.totalUs, 0.5)).c_str(),
+                   formatUs(percentile(stats.totalUs, 0.99)).c_str(), formatBytes(stats.bytesOut).c_str());
+        }
+    }
+
+    void usage() {
+        fprintf(stderr, "Usage: access_log_analyzer [-n TOP_HOSTS] FILE...\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t topHosts = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:h")) != -1) {
+        if (opt == 'n') {
+            topHosts = std::strtoul(optarg, nullptr, 10);
+        } else {
+            usage();
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        usage();
+        return 1;
+    }
+
+    Summary sum;
+    bool ok = true;
+    for (int i = optind; i < argc; i++) {
+        ok = readFile(argv[i], sum) && ok;
+    }
+    if (sum.records == 0) {
+        fprintf(stderr, "no records\n");
+        return ok ? 0 : 1;
+    }
+    printSummary(sum, topHosts);
+    return ok ? 0 : 1;
+}